@@ -0,0 +1,158 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iostream>
+#include <fstream>
+
+#include "fast_simple_lcsk/all_vs_all.h"
+
+using namespace std;
+
+namespace {
+
+vector<string> ReadSequences(const string& path) {
+  ifstream infile(path);
+  vector<string> sequences;
+  for (string line; getline(infile, line);) {
+    if (line.size()) sequences.push_back(line);
+  }
+  return sequences;
+}
+
+int Plan(char** argv) {
+  ShardManifest manifest;
+  manifest.k = stoi(argv[2]);
+  manifest.options.min_score = stoi(argv[3]);
+  manifest.num_shards = stoi(argv[4]);
+  manifest.input_path = argv[5];
+  const vector<string> sequences = ReadSequences(manifest.input_path);
+  manifest.num_sequences = sequences.size();
+  manifest.fingerprint = CollectionFingerprint(sequences);
+  printf("Number of sequences: %d\n", manifest.num_sequences);
+  if (!WriteShardManifest(manifest, argv[6])) {
+    printf("Cannot write %s\n", argv[6]);
+    return 1;
+  }
+  return 0;
+}
+
+int Run(char** argv) {
+  const string manifest_path = argv[2];
+  const int shard = stoi(argv[3]);
+  ShardManifest manifest;
+  if (!ReadShardManifest(manifest_path, &manifest)) {
+    printf("Cannot read %s\n", argv[2]);
+    return 1;
+  }
+  if (shard < 0 || shard >= manifest.num_shards) {
+    printf("No shard %d of %d\n", shard, manifest.num_shards);
+    return 1;
+  }
+  const vector<string> sequences = ReadSequences(manifest.input_path);
+  if ((int)sequences.size() != manifest.num_sequences ||
+      CollectionFingerprint(sequences) != manifest.fingerprint) {
+    printf("%s has changed since the manifest was written\n",
+           manifest.input_path.c_str());
+    return 1;
+  }
+
+  KmerCollectionIndex index(sequences, manifest.k);
+  ShardStats stats;
+  if (!RunAllVsAllShard(index, manifest, shard, stoi(argv[4]),
+                        ShardPath(manifest_path, shard), &stats)) {
+    printf("Cannot write %s\n", ShardPath(manifest_path, shard).c_str());
+    return 1;
+  }
+  printf("Pairs of shard %d: %lld\n", shard, stats.num_pairs);
+  printf("Pairs resumed: %lld\n", stats.num_pairs_resumed);
+  return 0;
+}
+
+int Merge(char** argv) {
+  const string manifest_path = argv[2];
+  ShardManifest manifest;
+  if (!ReadShardManifest(manifest_path, &manifest)) {
+    printf("Cannot read %s\n", argv[2]);
+    return 1;
+  }
+  vector<string> shard_paths;
+  for (int shard = 0; shard < manifest.num_shards; ++shard) {
+    shard_paths.push_back(ShardPath(manifest_path, shard));
+  }
+  vector<SimilarityEntry> entries;
+  vector<int> incomplete_shards;
+  if (!MergeAllVsAllShards(manifest, shard_paths, &entries,
+                           &incomplete_shards)) {
+    printf("Incomplete shards:");
+    for (int shard : incomplete_shards) printf(" %d", shard);
+    printf("\n");
+    return 1;
+  }
+  printf("Pairs reported: %d\n", (int)entries.size());
+  ofstream outfile(argv[3]);
+  WriteSimilarityMatrix(entries, outfile);
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const string mode = argc > 1 ? argv[1] : "";
+  if (mode == "plan" && argc == 7) return Plan(argv);
+  if (mode == "run" && argc == 5) return Run(argv);
+  if (mode == "merge" && argc == 4) return Merge(argv);
+  if (argc != 6) {
+    printf(
+      "Compute LCSk++ of all pairs of sequences in a collection.\n\n"
+      "Usage: ./all_vs_all k min_score num_threads input output\n"
+      "       ./all_vs_all plan k min_score num_shards input manifest\n"
+      "       ./all_vs_all run manifest shard num_threads\n"
+      "       ./all_vs_all merge manifest output\n\n"
+      "Example: ./all_vs_all 10 50 8 reads.txt matrix.txt\n"
+      "reads one sequence per line of `reads.txt` and writes a line\n"
+      "`i j LCS10++` to `matrix.txt` for every pair i < j of sequences\n"
+      "whose LCS10++ is at least 50\n\n"
+      "The same matrix can be computed in 16 shards, possibly on several\n"
+      "hosts sharing the filesystem:\n"
+      "  ./all_vs_all plan 10 50 16 reads.txt reads.manifest\n"
+      "  ./all_vs_all run reads.manifest 0 8  (and so on up to shard 15)\n"
+      "  ./all_vs_all merge reads.manifest matrix.txt\n"
+      "A shard writes its pairs to `reads.manifest.shard<shard>` as it\n"
+      "goes and, if interrupted, resumes from them when run again\n"
+    );
+    return 0;
+  };
+
+  int k = stoi(argv[1]);
+  AllVsAllOptions options;
+  options.min_score = stoi(argv[2]);
+  options.num_threads = stoi(argv[3]);
+
+  vector<string> sequences = ReadSequences(argv[4]);
+  printf("Number of sequences: %d\n", (int)sequences.size());
+
+  KmerCollectionIndex index(sequences, k);
+  vector<SimilarityEntry> entries;
+  AllVsAllStats stats;
+  AllVsAll(index, options, &entries, &stats);
+
+  printf("Pairs: %lld\n", stats.num_pairs);
+  printf("Pairs pruned by shared k-mers: %lld\n", stats.num_pairs_pruned);
+  printf("Pairs compared: %lld\n", stats.num_pairs_compared);
+  printf("Pairs reported: %d\n", (int)entries.size());
+
+  ofstream outfile(argv[5]);
+  WriteSimilarityMatrix(entries, outfile);
+  return 0;
+}
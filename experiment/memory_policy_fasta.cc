@@ -0,0 +1,74 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "../fast_simple_lcsk/lcsk.h"
+#include "../fast_simple_lcsk/memory_policy.h"
+#include "../util/sequence_reader.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+  if (argc != 4 && argc != 5) {
+    printf(
+      "Example: ./memory_policy_fasta 20 a.fa b.fa [repetitions]\n"
+      "computes LCS20++ of the inputs with the index and the match pairs\n"
+      "allocated under every memory policy (regular, transparent and explicit\n"
+      "huge pages, each with and without binding to the local NUMA node), and\n"
+      "outputs the median time of each relative to the default policy\n"
+    );
+    return 0;
+  };
+
+  const int k = stoi(argv[1]);
+  string a;
+  string b;
+  if (!ReadSequenceFile(argv[2], /*acgt_only=*/true, &a) ||
+      !ReadSequenceFile(argv[3], /*acgt_only=*/true, &b)) {
+    cerr << "Cannot read the inputs" << endl;
+    return 1;
+  }
+  const int repetitions = argc == 5 ? max(1, stoi(argv[4])) : 3;
+  cerr << "a.size()=" << a.size() << " b.size()=" << b.size() << endl;
+
+  const char* huge_pages_names[] = {"regular", "transparent", "explicit"};
+  double default_seconds = 0;
+  for (HugePages huge_pages :
+       {NO_HUGE_PAGES, TRANSPARENT_HUGE_PAGES, EXPLICIT_HUGE_PAGES}) {
+    for (bool bind_to_local_node : {false, true}) {
+      vector<double> seconds;
+      vector<pair<int, int>> recon;
+      for (int r = 0; r < repetitions; ++r) {
+        const auto start = chrono::steady_clock::now();
+        LcsKSparseFastWithMemoryPolicy(
+            a, b, k, /*lcsk_plus=*/true,
+            MemoryPolicy(huge_pages, bind_to_local_node), &recon);
+        seconds.push_back(
+            chrono::duration<double>(chrono::steady_clock::now() - start)
+                .count());
+      }
+      sort(seconds.begin(), seconds.end());
+      const double median = seconds[seconds.size() / 2];
+      if (default_seconds == 0) default_seconds = median;
+      cout << "pages=" << huge_pages_names[huge_pages]
+           << " local_node=" << bind_to_local_node
+           << " lcskpp=" << recon.size() << " seconds=" << median
+           << " speedup=" << default_seconds / median << endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,104 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+
+#include <malloc.h>
+
+#include "../fast_simple_lcsk/lcsk.h"
+#include "../fast_simple_lcsk/match_maker.h"
+#include "../util/sequence_reader.h"
+
+using namespace std;
+
+// Bytes currently allocated with operator new.
+long long live_bytes = 0;
+
+void* operator new(size_t size) {
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) throw bad_alloc();
+  live_bytes += malloc_usable_size(p);
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  if (p == nullptr) return;
+  live_bytes -= malloc_usable_size(p);
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+
+// Builds a match maker with make_match_maker, and computes LCSk++ with it.
+// Prints the memory taken by the match maker, the length and the time.
+template <typename MakeMatchMaker>
+int Run(const char* name, const string& a, const string& b, int k,
+        MakeMatchMaker make_match_maker, long long* index_bytes) {
+  const auto start = chrono::steady_clock::now();
+  const long long bytes_before = live_bytes;
+  unique_ptr<MatchMaker> match_maker = make_match_maker();
+  *index_bytes = live_bytes - bytes_before;
+  vector<pair<int, int>> recon;
+  LcsKSparseFastWithMatchMaker(match_maker.get(), a.size(), b.size(), k,
+                               /*lcsk_plus=*/true, -1, false, &recon,
+                               nullptr);
+  const double seconds =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  cout << name << ": index_bytes=" << *index_bytes
+       << " lcskpp=" << recon.size() << " seconds=" << seconds << endl;
+  return recon.size();
+}
+
+int main(int argc, char** argv) {
+  if (argc != 5) {
+    printf(
+      "Example: ./minimizer_fasta 20 10 query.fa reference.fa\n"
+      "computes LCS20++ of the query and the reference with the exact index\n"
+      "of the reference and with the index of its (10,20)-minimizers, and\n"
+      "outputs the memory taken by both indices and the deviation of the\n"
+      "approximate LCSk++ from the exact one\n"
+    );
+    return 0;
+  };
+
+  const int k = stoi(argv[1]);
+  const int w = stoi(argv[2]);
+  string a;
+  string b;
+  if (!ReadSequenceFile(argv[3], /*acgt_only=*/true, &a) ||
+      !ReadSequenceFile(argv[4], /*acgt_only=*/true, &b)) {
+    cerr << "Cannot read the inputs" << endl;
+    return 1;
+  }
+  cerr << "a.size()=" << a.size() << " b.size()=" << b.size() << endl;
+
+  long long exact_bytes = 0;
+  long long minimizer_bytes = 0;
+  const int exact = Run("exact", a, b, k, [&]() {
+    return MatchMaker::Create(a, b, k, FastestMatchMakerType(a, b, k));
+  }, &exact_bytes);
+  const int approximate = Run("minimizer", a, b, k, [&]() {
+    return unique_ptr<MatchMaker>(new MinimizerMatchMaker(a, b, k, w));
+  }, &minimizer_bytes);
+
+  cout << "memory_reduction=" << (double)exact_bytes / max(1LL, minimizer_bytes)
+       << "x lcskpp_deviation="
+       << (exact == 0 ? 0.0 : 100.0 * (exact - approximate) / exact) << "%"
+       << endl;
+  return 0;
+}
@@ -20,8 +20,9 @@
 #include <unordered_map>
 
 #include "../fast_simple_lcsk/lcsk.h"
+#include "../fast_simple_lcsk/match_estimator.h"
 #include "../fast_simple_lcsk/match_pair.h"
-#include "../fast_simple_lcsk/rolling_hasher.h"
+#include "../util/sequence_reader.h"
 
 using namespace std;
 
@@ -31,72 +32,39 @@ using namespace std;
 #define TRACE(x) cout << #x << " = " << x << endl
 #define _ << " _ " <<
 
-long long CountMatchPairs(const string& s, const int k) {
-  vector<char> char_to_id(256);
-  char_to_id['A'] = 0;
-  char_to_id['C'] = 1;
-  char_to_id['T'] = 2;
-  char_to_id['G'] = 3;
-  RollingHasher rolling_hasher(s, k, char_to_id,
-                               /*alphabet_size=*/4);
-  unordered_map<unsigned long long, long long> kmer_counts;
-  for (unsigned long long hash = -1;
-       rolling_hasher.Next(&hash);) {
-    ++kmer_counts[hash];
-  }
-  long long num_match_pairs = 0;
-  for (const auto& kmer_count : kmer_counts) {
-    num_match_pairs += kmer_count.second * kmer_count.second;
-  }
-  return num_match_pairs;
-}
-
 int main(int argc, char** argv) {
-  if (argc != 3) {
+  if (argc != 3 && !(argc == 4 && string(argv[3]) == "repeats")) {
     printf(
-      "Example: ./stats_fasta 4 input.fa\n"
+      "Example: ./stats_fasta 4 input.fa [repeats]\n"
       "outputs lcskpplen, number of matchpair objects created, max number of matchpair objects alive\n"
+      "with `repeats`, only the matches above the main diagonal are considered\n"
     );
     return 0;
   };
+  const bool repeats = argc == 4;
 
   int k = stoi(argv[1]);
-  ifstream infile(argv[2]);
-
-  vector<string> sequences;
-  string line;
-  string current_seq;
-  bool first = true;
-  while (getline(infile, line)) {
-    if (!line.size()) continue;
-
-    if (line[0] == '>') {
-      if (!first) {
-        sequences.push_back(current_seq);
-      }
-      current_seq = "";
-      first = false;
-    } else if (line[0] == ',') {
-      continue;
-    } else {
-      current_seq += line;
-    }
-  }
-  sequences.push_back(current_seq);
-
-  string input = "";
-  for (string& sequence : sequences) {
-    for (char c : sequence) {
-      if (c == 'A' || c == 'G' || c == 'T' || c == 'C') input.push_back(c);
-    }
+  string input;
+  if (!ReadSequenceFile(argv[2], /*acgt_only=*/true, &input)) {
+    cerr << "Cannot read " << argv[2] << endl;
+    return 1;
   }
 
   const int n = input.size();
   cerr << "input.size()=" << n << endl;
 
-  const long long num_match_pairs = CountMatchPairs(input, k);
+  MatchEstimate estimate;
+  EstimateMatches(input, input, k, /*sampling_rate=*/1.0, &estimate);
+  long long num_match_pairs = estimate.num_match_pairs;
   vector<pair<int, int>> recon;
-  LcsKSparseFast(input, input, k, &recon);
+  if (repeats) {
+    // Drop the main diagonal and the mirrored matches below it.
+    const long long num_kmers = max(0, n - k + 1);
+    num_match_pairs = (num_match_pairs - num_kmers) / 2;
+    LcsKSparseFastSelf(input, k, &recon);
+  } else {
+    LcsKSparseFast(input, input, k, &recon);
+  }
 
   // '+1' comes from a single dummy MatchPair object in the first row of the
   // compressed table.
@@ -106,6 +74,6 @@ int main(int argc, char** argv) {
   cout << n << " "
        << length << " "
        << num_match_pairs << " "
-       << ObjectCounter<MatchPair>::max_objects_alive << endl;
+       << ObjectCounter<MatchPair>::max_objects_alive.load() << endl;
   return 0;
 }
@@ -0,0 +1,67 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include "../fast_simple_lcsk/lcsk.h"
+#include "../fast_simple_lcsk/sweep_timeline.h"
+#include "../util/sequence_reader.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+  if (argc != 6) {
+    printf(
+      "Example: ./timeline_fasta 20 a.fa b.fa 10000 timeline.csv\n"
+      "computes LCS20++ of the inputs, sweeping the rows of a.fa, and writes\n"
+      "a sample every 10000 rows (live match pairs, compressed table size,\n"
+      "begin and end events and time of the last 10000 rows) to\n"
+      "timeline.csv, or to a binary timeline file (see sweep_timeline.h) if\n"
+      "the output does not end with .csv\n"
+    );
+    return 0;
+  };
+
+  const int k = stoi(argv[1]);
+  string a;
+  string b;
+  if (!ReadSequenceFile(argv[2], /*acgt_only=*/true, &a) ||
+      !ReadSequenceFile(argv[3], /*acgt_only=*/true, &b)) {
+    cerr << "Cannot read the inputs" << endl;
+    return 1;
+  }
+  cerr << "a.size()=" << a.size() << " b.size()=" << b.size() << endl;
+
+  SweepTimeline timeline(max(1, stoi(argv[4])));
+  vector<pair<int, int>> recon;
+  LcsKSparseFastWithTimeline(a, b, k, /*lcsk_plus=*/true, &timeline, &recon);
+  cerr << "lcskpp=" << recon.size()
+       << " samples=" << timeline.samples().size() << endl;
+
+  const string output = argv[5];
+  if (output.size() >= 4 && output.compare(output.size() - 4, 4, ".csv") == 0) {
+    ofstream out(output);
+    timeline.WriteCsv(out);
+    if (!out) {
+      cerr << "Cannot write " << output << endl;
+      return 1;
+    }
+  } else if (!timeline.WriteBinary(output)) {
+    cerr << "Cannot write " << output << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,473 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <cassert>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "all_vs_all.h"
+#include "lcsk.h"
+#include "match_maker.h"
+#include "rolling_hasher.h"
+#include "row_sweeper.h"
+
+using namespace std;
+
+namespace {
+
+// MatchMaker enumerating the matches between sequences a_id and b_id of a
+// shared KmerCollectionIndex.
+class CollectionMatchMaker : public MatchMaker {
+ public:
+  CollectionMatchMaker(const KmerCollectionIndex& index, int a_id, int b_id)
+      : index_(index), a_id_(a_id), b_id_(b_id), row_(0) {}
+
+  bool GetNextMatches(std::vector<int>* matches) override {
+    matches->clear();
+    const vector<unsigned long long>& hashes = index_.hashes(a_id_);
+    // Are there more matches to generate?
+    if (row_ >= hashes.size()) return false;
+
+    index_.Positions(hashes[row_], b_id_, matches);
+    ++row_;  // Not forgetting to update this!
+    return true;
+  }
+
+ private:
+  const KmerCollectionIndex& index_;
+  int a_id_;
+  int b_id_;
+  int row_;
+};
+
+// For every other sequence y of the collection, computes the number of
+// positions of sequence x covered by k-mers which also occur in y.
+void CoveredPositions(const KmerCollectionIndex& index, const int x,
+                      unordered_map<int, int>* covered) {
+  const int k = index.k();
+  // y -> end of the last covered interval of x.
+  unordered_map<int, int> last_end;
+  covered->clear();
+
+  const vector<unsigned long long>& hashes = index.hashes(x);
+  for (int p = 0; p < hashes.size(); ++p) {
+    const auto& occurrences = index.Occurrences(hashes[p]);
+    for (size_t i = 0; i < occurrences.size(); ++i) {
+      const int y = occurrences[i].first;
+      if (y == x || (i > 0 && occurrences[i - 1].first == y)) continue;
+
+      auto it = last_end.find(y);
+      const int covered_until = it == last_end.end() ? 0 : it->second;
+      (*covered)[y] += p + k - max(p, covered_until);
+      last_end[y] = p + k;
+    }
+  }
+}
+
+// Pairs (x, y), x < y, whose upper bound reaches min_score, sorted.
+void Candidates(const KmerCollectionIndex& index, int min_score,
+                vector<pair<int, int>>* candidates) {
+  const int n = index.num_sequences();
+  vector<unordered_map<int, int>> covered(n);
+  for (int x = 0; x < n; ++x) {
+    CoveredPositions(index, x, &covered[x]);
+  }
+
+  candidates->clear();
+  for (int x = 0; x < n; ++x) {
+    for (const auto& xy : covered[x]) {
+      const int y = xy.first;
+      if (y < x) continue;
+      const int upper_bound = min(xy.second, covered[y].at(x));
+      if (upper_bound >= min_score) {
+        candidates->push_back(make_pair(x, y));
+      }
+    }
+  }
+  sort(candidates->begin(), candidates->end());
+}
+
+// Compares the given pairs with options.num_threads threads, calling
+// done(thread, x, y, score) from the thread comparing (x, y), with score -1
+// if it is below options.min_score.
+void ComparePairs(const KmerCollectionIndex& index,
+                  const AllVsAllOptions& options,
+                  const vector<pair<int, int>>& pairs,
+                  const function<void(int, int, int, int)>& done) {
+  atomic<size_t> next_pair(0);
+  auto worker = [&](int t) {
+    vector<pair<int, int>> recon;
+    // Reused by all the comparisons of the thread.
+    SweepScratch scratch;
+    for (size_t i = next_pair++; i < pairs.size(); i = next_pair++) {
+      const int x = pairs[i].first;
+      const int y = pairs[i].second;
+      CollectionMatchMaker match_maker(index, x, y);
+      if (LcsKSparseFastWithMatchMaker(
+              &match_maker, index.sequence_size(x), index.sequence_size(y),
+              index.k(), options.lcsk_plus, options.min_score,
+              /*stop_when_reached=*/false, &recon, /*rows_skipped=*/nullptr,
+              &scratch)) {
+        done(t, x, y, recon.size());
+      } else {
+        done(t, x, y, -1);
+      }
+    }
+  };
+
+  vector<thread> threads;
+  for (int t = 1; t < options.num_threads; ++t) {
+    threads.emplace_back(worker, t);
+  }
+  worker(0);
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+const char kManifestMagic[] = "LCSKSHARDS1";
+const char kShardMagic[] = "LCSKSHARD1";
+// Completed pairs written to a shard file between two flushes.
+const int kPairsPerFlush = 256;
+
+// First line of the files of the shard, tying them to the manifest.
+string ShardHeader(const ShardManifest& manifest, int shard) {
+  ostringstream header;
+  header << "# " << kShardMagic << " " << hex << manifest.fingerprint << dec
+         << " " << manifest.num_sequences << " " << manifest.k << " "
+         << manifest.options.lcsk_plus << " " << manifest.options.min_score
+         << " " << shard << " " << manifest.num_shards;
+  return header.str();
+}
+
+// The contents of a shard file: the completed pairs with their score (-1 if
+// below min_score), whether the shard is complete, and the bytes up to the
+// last complete line, after which a killed process may have left a partial
+// line.
+struct ShardFile {
+  vector<SimilarityEntry> pairs;
+  bool complete = false;
+  long long num_pairs = -1;
+  long long valid_bytes = 0;
+};
+
+// Returns false if the file is missing or belongs to another shard.
+bool ReadShardFile(const string& path, const string& header,
+                   ShardFile* file) {
+  ifstream in(path);
+  string line;
+  if (!getline(in, line) || in.eof() || line != header) return false;
+  *file = ShardFile();
+  file->valid_bytes = line.size() + 1;
+  while (getline(in, line) && !in.eof()) {
+    istringstream fields(line);
+    SimilarityEntry entry;
+    if (fields >> entry.a_id >> entry.b_id >> entry.score) {
+      file->pairs.push_back(entry);
+    } else if (line.compare(0, 11, "# complete ") == 0) {
+      file->num_pairs = stoll(line.substr(11));
+      file->complete = true;
+    } else {
+      break;
+    }
+    file->valid_bytes += line.size() + 1;
+  }
+  return true;
+}
+
+}  // namespace
+
+KmerCollectionIndex::KmerCollectionIndex(
+    const std::vector<std::string>& sequences, int k)
+    : k_(k) {
+  vector<char> char_to_id(256, -1);
+  int alphabet_size = 0;
+  for (const string& sequence : sequences) {
+    for (unsigned char c : sequence) {
+      if (char_to_id[c] == -1) {
+        char_to_id[c] = alphabet_size++;
+      }
+    }
+  }
+
+  if (RollingHasher::Fits(alphabet_size, k_)) {
+    for (int id = 0; id < sequences.size(); ++id) {
+      sequence_sizes_.push_back(sequences[id].size());
+      hashes_.emplace_back();
+      RollingHasher hasher(sequences[id], k_, char_to_id, alphabet_size);
+      for (unsigned long long hash = 0; hasher.Next(&hash);) {
+        index_[hash].push_back(make_pair(id, (int)hashes_[id].size()));
+        hashes_[id].push_back(hash);
+      }
+    }
+    return;
+  }
+
+  // The polynomial hash is not injective, so the k-mers are numbered instead:
+  // the k-mers sharing a polynomial hash are told apart by comparing them with
+  // the first occurrence of each, and the distinct ones get distinct numbers.
+  const unsigned long long base = PolynomialRollingHasher::RandomBase();
+  // Polynomial hash -> (first occurrence, number) of each k-mer with it.
+  unordered_map<unsigned long long, vector<pair<Occurrence, int>>> numbers;
+  int num_kmers = 0;
+  for (int id = 0; id < sequences.size(); ++id) {
+    sequence_sizes_.push_back(sequences[id].size());
+    hashes_.emplace_back();
+    PolynomialRollingHasher hasher(sequences[id], k_, base);
+    for (unsigned long long hash = 0; hasher.Next(&hash);) {
+      const int j = hashes_[id].size();
+      vector<pair<Occurrence, int>>& kmers = numbers[hash];
+      auto kmer = find_if(kmers.begin(), kmers.end(),
+                          [&](const pair<Occurrence, int>& numbered) {
+                            const Occurrence& first = numbered.first;
+                            return memcmp(sequences[first.first].data() +
+                                              first.second,
+                                          sequences[id].data() + j, k_) == 0;
+                          });
+      if (kmer == kmers.end()) {
+        kmers.emplace_back(make_pair(id, j), num_kmers++);
+        kmer = kmers.end() - 1;
+      }
+      index_[kmer->second].push_back(make_pair(id, j));
+      hashes_[id].push_back(kmer->second);
+    }
+  }
+}
+
+const std::vector<KmerCollectionIndex::Occurrence>&
+KmerCollectionIndex::Occurrences(unsigned long long hash) const {
+  static const vector<Occurrence> kNoOccurrences;
+  auto it = index_.find(hash);
+  return it == index_.end() ? kNoOccurrences : it->second;
+}
+
+void KmerCollectionIndex::Positions(unsigned long long hash, int id,
+                                    std::vector<int>* positions) const {
+  positions->clear();
+  const auto& occurrences = Occurrences(hash);
+  for (auto it = lower_bound(occurrences.begin(), occurrences.end(),
+                             make_pair(id, -1));
+       it != occurrences.end() && it->first == id; ++it) {
+    positions->push_back(it->second);
+  }
+}
+
+void AllVsAll(const KmerCollectionIndex& index, const AllVsAllOptions& options,
+              std::vector<SimilarityEntry>* entries, AllVsAllStats* stats) {
+  assert(entries != nullptr);
+  entries->clear();
+  const int n = index.num_sequences();
+
+  vector<pair<int, int>> candidates;
+  Candidates(index, options.min_score, &candidates);
+
+  vector<vector<SimilarityEntry>> thread_entries(max(1, options.num_threads));
+  ComparePairs(index, options, candidates,
+               [&thread_entries](int t, int x, int y, int score) {
+                 if (score >= 0) {
+                   thread_entries[t].push_back(SimilarityEntry{x, y, score});
+                 }
+               });
+
+  for (const auto& found : thread_entries) {
+    entries->insert(entries->end(), found.begin(), found.end());
+  }
+  sort(entries->begin(), entries->end(),
+       [](const SimilarityEntry& lhs, const SimilarityEntry& rhs) {
+         return make_pair(lhs.a_id, lhs.b_id) < make_pair(rhs.a_id, rhs.b_id);
+       });
+
+  if (stats != nullptr) {
+    stats->num_pairs = (long long)n * (n - 1) / 2;
+    stats->num_pairs_compared = candidates.size();
+    stats->num_pairs_pruned = stats->num_pairs - stats->num_pairs_compared;
+  }
+}
+
+void WriteSimilarityMatrix(const std::vector<SimilarityEntry>& entries,
+                           std::ostream& out) {
+  for (const auto& entry : entries) {
+    out << entry.a_id << " " << entry.b_id << " " << entry.score << "\n";
+  }
+}
+
+unsigned long long CollectionFingerprint(
+    const std::vector<std::string>& sequences) {
+  // 64-bit FNV-1a, over the sequences separated by newlines.
+  unsigned long long hash = 0xcbf29ce484222325ULL;
+  for (const string& sequence : sequences) {
+    for (unsigned char c : sequence) {
+      hash = (hash ^ c) * 0x100000001b3ULL;
+    }
+    hash = (hash ^ '\n') * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+bool WriteShardManifest(const ShardManifest& manifest,
+                        const std::string& path) {
+  ofstream out(path);
+  out << kManifestMagic << "\n"
+      << "input_path " << manifest.input_path << "\n"
+      << "k " << manifest.k << "\n"
+      << "lcsk_plus " << manifest.options.lcsk_plus << "\n"
+      << "min_score " << manifest.options.min_score << "\n"
+      << "num_shards " << manifest.num_shards << "\n"
+      << "num_sequences " << manifest.num_sequences << "\n"
+      << "fingerprint " << hex << manifest.fingerprint << dec << "\n";
+  out.close();
+  return !out.fail();
+}
+
+bool ReadShardManifest(const std::string& path, ShardManifest* manifest) {
+  ifstream in(path);
+  string line;
+  if (!getline(in, line) || line != kManifestMagic) return false;
+  *manifest = ShardManifest();
+  int num_fields = 0;
+  while (getline(in, line)) {
+    const size_t space = line.find(' ');
+    if (space == string::npos) return false;
+    const string key = line.substr(0, space);
+    const string value = line.substr(space + 1);
+    if (key == "input_path") {
+      manifest->input_path = value;
+    } else if (key == "k") {
+      manifest->k = stoi(value);
+    } else if (key == "lcsk_plus") {
+      manifest->options.lcsk_plus = stoi(value) != 0;
+    } else if (key == "min_score") {
+      manifest->options.min_score = stoi(value);
+    } else if (key == "num_shards") {
+      manifest->num_shards = stoi(value);
+    } else if (key == "num_sequences") {
+      manifest->num_sequences = stoi(value);
+    } else if (key == "fingerprint") {
+      manifest->fingerprint = stoull(value, nullptr, 16);
+    } else {
+      return false;
+    }
+    ++num_fields;
+  }
+  return num_fields == 7 && manifest->k > 0 && manifest->num_shards > 0;
+}
+
+std::string ShardPath(const std::string& manifest_path, int shard) {
+  return manifest_path + ".shard" + to_string(shard);
+}
+
+bool RunAllVsAllShard(const KmerCollectionIndex& index,
+                      const ShardManifest& manifest, int shard,
+                      int num_threads, const std::string& shard_path,
+                      ShardStats* stats) {
+  assert(index.k() == manifest.k);
+  assert(index.num_sequences() == manifest.num_sequences);
+  assert(0 <= shard && shard < manifest.num_shards);
+  vector<pair<int, int>> candidates;
+  Candidates(index, manifest.options.min_score, &candidates);
+  vector<pair<int, int>> pairs;
+  for (size_t i = shard; i < candidates.size(); i += manifest.num_shards) {
+    pairs.push_back(candidates[i]);
+  }
+
+  // Resumes from the pairs completed by earlier runs, dropping a partial
+  // last line, or starts the file over if it belongs to another manifest.
+  const string header = ShardHeader(manifest, shard);
+  ShardFile file;
+  FILE* out = nullptr;
+  if (ReadShardFile(shard_path, header, &file) &&
+      truncate(shard_path.c_str(), file.valid_bytes) == 0) {
+    out = file.complete ? nullptr : fopen(shard_path.c_str(), "a");
+  } else {
+    file = ShardFile();
+    out = fopen(shard_path.c_str(), "w");
+    if (out != nullptr) fprintf(out, "%s\n", header.c_str());
+  }
+  if (stats != nullptr) {
+    stats->num_pairs = pairs.size();
+    stats->num_pairs_resumed = file.pairs.size();
+  }
+  if (file.complete) return true;
+  if (out == nullptr) return false;
+
+  vector<pair<int, int>> done;
+  for (const auto& entry : file.pairs) {
+    done.push_back(make_pair(entry.a_id, entry.b_id));
+  }
+  sort(done.begin(), done.end());
+  vector<pair<int, int>> todo;
+  set_difference(pairs.begin(), pairs.end(), done.begin(), done.end(),
+                 back_inserter(todo));
+
+  AllVsAllOptions options = manifest.options;
+  options.num_threads = num_threads;
+  mutex out_mutex;
+  int num_unflushed = 0;
+  ComparePairs(index, options, todo,
+               [&](int, int x, int y, int score) {
+                 lock_guard<mutex> lock(out_mutex);
+                 fprintf(out, "%d %d %d\n", x, y, score);
+                 if (++num_unflushed == kPairsPerFlush) {
+                   fflush(out);
+                   num_unflushed = 0;
+                 }
+               });
+
+  fprintf(out, "# complete %lld\n", (long long)pairs.size());
+  const bool write_ok = !ferror(out);
+  return fclose(out) == 0 && write_ok;
+}
+
+bool MergeAllVsAllShards(const ShardManifest& manifest,
+                         const std::vector<std::string>& shard_paths,
+                         std::vector<SimilarityEntry>* entries,
+                         std::vector<int>* incomplete_shards) {
+  assert(shard_paths.size() == manifest.num_shards);
+  entries->clear();
+  if (incomplete_shards != nullptr) incomplete_shards->clear();
+  bool complete = true;
+  ShardFile file;
+  for (int shard = 0; shard < manifest.num_shards; ++shard) {
+    if (!ReadShardFile(shard_paths[shard], ShardHeader(manifest, shard),
+                       &file) ||
+        !file.complete || file.num_pairs != (long long)file.pairs.size()) {
+      complete = false;
+      if (incomplete_shards != nullptr) incomplete_shards->push_back(shard);
+      continue;
+    }
+    for (const auto& entry : file.pairs) {
+      if (entry.score >= 0) entries->push_back(entry);
+    }
+  }
+  sort(entries->begin(), entries->end(),
+       [](const SimilarityEntry& lhs, const SimilarityEntry& rhs) {
+         return make_pair(lhs.a_id, lhs.b_id) < make_pair(rhs.a_id, rhs.b_id);
+       });
+  return complete;
+}
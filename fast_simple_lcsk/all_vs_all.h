@@ -0,0 +1,162 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ALL_VS_ALL
+#define ALL_VS_ALL
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// A single k-mer index shared by all sequences of a collection. Every
+// sequence is hashed once and the positions of each k-mer are stored grouped
+// by the id of the sequence they occur in, so the k-mer matches between any
+// two sequences of the collection can be enumerated without building a
+// dedicated index for the pair.
+class KmerCollectionIndex {
+ public:
+  // Occurrence of a k-mer: (sequence id, position).
+  typedef std::pair<int, int> Occurrence;
+
+  KmerCollectionIndex(const std::vector<std::string>& sequences, int k);
+
+  int k() const { return k_; }
+  int num_sequences() const { return sequence_sizes_.size(); }
+  int sequence_size(int id) const { return sequence_sizes_[id]; }
+
+  // Hashes of all length k substrings of sequence id, in order. Two k-mers
+  // have the same hash only if they are equal: when the k-mers are too long
+  // for a perfect hash of the alphabet, the distinct k-mers are numbered
+  // instead, telling apart the ones sharing a polynomial hash.
+  const std::vector<unsigned long long>& hashes(int id) const {
+    return hashes_[id];
+  }
+
+  // Returns all occurrences of the k-mer with the given hash, sorted by
+  // sequence id and then by position. Never modifies the index.
+  const std::vector<Occurrence>& Occurrences(unsigned long long hash) const;
+
+  // Fills positions with the positions of the k-mer with the given hash in
+  // sequence id.
+  void Positions(unsigned long long hash, int id,
+                 std::vector<int>* positions) const;
+
+ private:
+  int k_;
+  std::vector<int> sequence_sizes_;
+  std::vector<std::vector<unsigned long long>> hashes_;
+  std::unordered_map<unsigned long long, std::vector<Occurrence>> index_;
+};
+
+// A single non-zero entry of the similarity matrix.
+struct SimilarityEntry {
+  int a_id;
+  int b_id;
+  int score;
+};
+
+struct AllVsAllOptions {
+  // Computes LCSkpp if set and LCSk otherwise.
+  bool lcsk_plus = true;
+  // Pairs scoring below min_score are not reported. Pairs whose upper bound
+  // is below min_score are never compared, and pairs sharing no k-mer are
+  // never reported.
+  int min_score = 1;
+  int num_threads = 1;
+};
+
+struct AllVsAllStats {
+  long long num_pairs = 0;
+  // Pairs skipped because no k-mer is shared or the upper bound derived from
+  // shared k-mers is below min_score.
+  long long num_pairs_pruned = 0;
+  // Pairs compared, including those aborted early by the threshold.
+  long long num_pairs_compared = 0;
+};
+
+// Computes LCSk/LCSkpp for every unordered pair of sequences in the
+// collection, returning the entries with score >= options.min_score sorted by
+// (a_id, b_id), a_id < b_id.
+//
+// Every position of a sequence covered by LCSk/LCSkpp is covered by some
+// k-mer shared with the other sequence, so the number of such covered
+// positions, computed from the shared index, bounds the score from above and
+// is used to skip hopeless pairs. The remaining pairs are compared in
+// parallel.
+void AllVsAll(const KmerCollectionIndex& index, const AllVsAllOptions& options,
+              std::vector<SimilarityEntry>* entries, AllVsAllStats* stats);
+
+// Writes entries as a sparse matrix, one "a_id b_id score" line per entry.
+void WriteSimilarityMatrix(const std::vector<SimilarityEntry>& entries,
+                           std::ostream& out);
+
+// Sharded execution, for collections needing more cores than one machine.
+//
+// The pairs left after pruning, sorted by (a_id, b_id), are dealt round-robin
+// into num_shards shards, which balances the shards and depends only on the
+// collection and the manifest. Every shard is run by an independent process,
+// possibly on another host sharing the filesystem, and records its completed
+// pairs into a shard file as it goes, so that it resumes where it stopped
+// when rerun. The complete shard files are then merged into the matrix
+// AllVsAll would have computed.
+struct ShardManifest {
+  // File with one sequence per line.
+  std::string input_path;
+  int k = 0;
+  // num_threads is chosen by every process running a shard.
+  AllVsAllOptions options;
+  int num_shards = 1;
+  // Identify the collection, so that shards never run on another one.
+  int num_sequences = 0;
+  unsigned long long fingerprint = 0;
+};
+
+struct ShardStats {
+  // Pairs of the shard, i.e. compared pairs it was dealt.
+  long long num_pairs = 0;
+  // Pairs already done in the shard file when the shard started.
+  long long num_pairs_resumed = 0;
+};
+
+// Hash of the sequences, stable across hosts.
+unsigned long long CollectionFingerprint(
+    const std::vector<std::string>& sequences);
+
+// Writes and reads a manifest as a text file. Return false on failure.
+bool WriteShardManifest(const ShardManifest& manifest,
+                        const std::string& path);
+bool ReadShardManifest(const std::string& path, ShardManifest* manifest);
+
+// Path of the file of the given shard, next to the manifest.
+std::string ShardPath(const std::string& manifest_path, int shard);
+
+// Runs the given shard of the manifest over index, which has to be built from
+// the manifest's collection with its k, resuming from the completed pairs
+// already in shard_path. Returns false if the shard file cannot be written.
+bool RunAllVsAllShard(const KmerCollectionIndex& index,
+                      const ShardManifest& manifest, int shard,
+                      int num_threads, const std::string& shard_path,
+                      ShardStats* stats);
+
+// Merges the files of all shards of the manifest into the entries AllVsAll
+// would return. Returns false, with the shards missing or incomplete in
+// incomplete_shards, unless all shards are complete.
+bool MergeAllVsAllShards(const ShardManifest& manifest,
+                         const std::vector<std::string>& shard_paths,
+                         std::vector<SimilarityEntry>* entries,
+                         std::vector<int>* incomplete_shards);
+
+#endif
@@ -0,0 +1,360 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "comparison_server.h"
+#include "lcsk.h"
+#include "row_sweeper.h"
+
+using namespace std;
+
+namespace {
+
+// Number of most recent requests whose latencies are kept.
+const size_t kLatencyWindow = 1 << 16;
+
+// Size of the fixed part of a request: type, flags and reference id.
+const size_t kRequestHeaderSize = 2 + sizeof(uint32_t);
+
+bool ReadFully(int fd, char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t n = read(fd, data, size);
+    if (n <= 0) return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool WriteFully(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    // MSG_NOSIGNAL: a client going away must not kill the server.
+    const ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+// Returns false on a connection error or if the payload is larger than
+// max_size bytes, in which case it is not read.
+bool ReadFrame(int fd, uint64_t max_size, string* payload) {
+  uint64_t size = 0;
+  if (!ReadFully(fd, reinterpret_cast<char*>(&size), sizeof(size)) ||
+      size > max_size) {
+    return false;
+  }
+  payload->resize(size);
+  return ReadFully(fd, &(*payload)[0], size);
+}
+
+bool WriteFrame(int fd, const string& payload) {
+  const uint64_t size = payload.size();
+  return WriteFully(fd, reinterpret_cast<const char*>(&size), sizeof(size)) &&
+         WriteFully(fd, payload.data(), payload.size());
+}
+
+template <typename T>
+void Append(const T& value, string* out) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T Extract(const string& in, size_t offset) {
+  T value;
+  memcpy(&value, in.data() + offset, sizeof(value));
+  return value;
+}
+
+bool MakeSocketAddress(const string& path, sockaddr_un* address) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address->sun_path)) return false;
+  strcpy(address->sun_path, path.c_str());
+  return true;
+}
+
+}  // namespace
+
+ComparisonServer::ComparisonServer(const std::vector<std::string>& references,
+                                   int k, int num_threads)
+    : ComparisonServer(references, k, num_threads, kDefaultMaxFrameSize) {}
+
+ComparisonServer::ComparisonServer(const std::vector<std::string>& references,
+                                   int k, int num_threads,
+                                   uint64_t max_frame_size)
+    : k_(k),
+      num_threads_(max(1, num_threads)),
+      max_frame_size_(max_frame_size),
+      listen_fd_(-1),
+      stopping_(false),
+      closed_(false),
+      num_requests_(0) {
+  for (const string& reference : references) {
+    indices_.emplace_back(new ReferenceIndex(reference, k_));
+  }
+}
+
+ComparisonServer::~ComparisonServer() {
+  if (listen_fd_ != -1) {
+    close(listen_fd_);
+    unlink(socket_path_.c_str());
+  }
+}
+
+bool ComparisonServer::Start(const std::string& socket_path) {
+  sockaddr_un address;
+  if (!MakeSocketAddress(socket_path, &address)) return false;
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd_ == -1) return false;
+
+  unlink(socket_path.c_str());
+  if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(listen_fd_, SOMAXCONN) != 0) {
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return false;
+  }
+  socket_path_ = socket_path;
+  return true;
+}
+
+void ComparisonServer::Run() {
+  vector<thread> threads;
+  for (int t = 0; t < num_threads_; ++t) {
+    threads.emplace_back(&ComparisonServer::Serve, this);
+  }
+
+  while (!stopping_) {
+    const int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd == -1) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    lock_guard<mutex> lock(connections_mutex_);
+    pending_connections_.push_back(fd);
+    connection_ready_.notify_one();
+  }
+
+  {
+    // Wakes up the threads blocked on reading from their clients.
+    lock_guard<mutex> lock(connections_mutex_);
+    closed_ = true;
+    for (int fd : pending_connections_) {
+      close(fd);
+    }
+    pending_connections_.clear();
+    for (int fd : active_connections_) {
+      shutdown(fd, SHUT_RDWR);
+    }
+    connection_ready_.notify_all();
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+void ComparisonServer::Stop() {
+  stopping_ = true;
+  shutdown(listen_fd_, SHUT_RDWR);
+}
+
+LatencyStats ComparisonServer::GetLatencyStats() const {
+  vector<int64_t> latencies;
+  LatencyStats stats;
+  {
+    lock_guard<mutex> lock(latency_mutex_);
+    latencies = latencies_;
+    stats.num_requests = num_requests_;
+  }
+
+  sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies](int p) -> int64_t {
+    if (latencies.empty()) return 0;
+    return latencies[(latencies.size() - 1) * p / 100];
+  };
+  stats.p50_us = percentile(50);
+  stats.p90_us = percentile(90);
+  stats.p99_us = percentile(99);
+  stats.max_us = percentile(100);
+  return stats;
+}
+
+void ComparisonServer::Serve() {
+  while (true) {
+    int fd = -1;
+    {
+      unique_lock<mutex> lock(connections_mutex_);
+      connection_ready_.wait(
+          lock, [this] { return !pending_connections_.empty() || closed_; });
+      if (pending_connections_.empty()) return;
+      fd = pending_connections_.front();
+      pending_connections_.pop_front();
+      active_connections_.insert(fd);
+    }
+
+    ServeConnection(fd);
+
+    lock_guard<mutex> lock(connections_mutex_);
+    active_connections_.erase(fd);
+    close(fd);
+  }
+}
+
+void ComparisonServer::ServeConnection(int fd) {
+  string request;
+  string response;
+  vector<pair<int, int>> recon;
+  // Reused by all the requests of the connection, so that the sweeps of the
+  // threads do not contend on the allocator.
+  SweepScratch scratch;
+  while (ReadFrame(fd, max_frame_size_, &request)) {
+    const auto start = chrono::steady_clock::now();
+    response.clear();
+
+    const uint8_t type =
+        request.size() >= kRequestHeaderSize ? request[0] : 0xff;
+    const uint8_t flags = request.size() >= kRequestHeaderSize ? request[1] : 0;
+    const uint32_t reference_id =
+        request.size() >= kRequestHeaderSize ? Extract<uint32_t>(request, 2)
+                                             : 0;
+    const size_t query_size = request.size() - kRequestHeaderSize;
+    if (type == STATS_REQUEST) {
+      Append<uint8_t>(0, &response);
+      Append(GetLatencyStats(), &response);
+      if (!WriteFrame(fd, response)) return;
+      continue;
+    }
+    if ((type != LCSK_REQUEST && type != LCSKPP_REQUEST) ||
+        reference_id >= indices_.size() ||
+        query_size > (size_t)numeric_limits<int>::max()) {
+      Append<uint8_t>(1, &response);
+      if (!WriteFrame(fd, response)) return;
+      continue;
+    }
+
+    // The rest of the request is the query.
+    request.erase(0, kRequestHeaderSize);
+    const string& query = request;
+    const ReferenceIndex& index = *indices_[reference_id];
+    ReferenceMatchMaker match_maker(index, query);
+    LcsKSparseFastWithMatchMaker(&match_maker, query.size(), index.size(), k_,
+                                 type == LCSKPP_REQUEST, -1, false, &recon,
+                                 nullptr, &scratch);
+
+    Append<uint8_t>(0, &response);
+    Append<int64_t>(recon.size(), &response);
+    if (flags & WITH_RECONSTRUCTION) {
+      for (const auto& match : recon) {
+        Append<int32_t>(match.first, &response);
+        Append<int32_t>(match.second, &response);
+      }
+    }
+    if (!WriteFrame(fd, response)) return;
+
+    RecordLatency(chrono::duration_cast<chrono::microseconds>(
+                      chrono::steady_clock::now() - start)
+                      .count());
+  }
+}
+
+void ComparisonServer::RecordLatency(int64_t latency_us) {
+  lock_guard<mutex> lock(latency_mutex_);
+  if (latencies_.size() < kLatencyWindow) {
+    latencies_.push_back(latency_us);
+  } else {
+    latencies_[num_requests_ % kLatencyWindow] = latency_us;
+  }
+  ++num_requests_;
+}
+
+ComparisonClient::ComparisonClient() : fd_(-1) {}
+
+ComparisonClient::~ComparisonClient() {
+  if (fd_ != -1) close(fd_);
+}
+
+bool ComparisonClient::Connect(const std::string& socket_path) {
+  sockaddr_un address;
+  if (!MakeSocketAddress(socket_path, &address)) return false;
+  fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd_ == -1) return false;
+  return connect(fd_, reinterpret_cast<sockaddr*>(&address),
+                 sizeof(address)) == 0;
+}
+
+bool ComparisonClient::Compare(
+    int reference_id, const std::string& query, bool lcsk_plus,
+    int64_t* length, std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  string request;
+  Append<uint8_t>(lcsk_plus ? LCSKPP_REQUEST : LCSK_REQUEST, &request);
+  Append<uint8_t>(lcsk_reconstruction != nullptr ? WITH_RECONSTRUCTION : 0,
+                  &request);
+  Append<uint32_t>(reference_id, &request);
+  request += query;
+
+  string response;
+  if (!Call(request, &response)) return false;
+  if (response.size() < 1 + sizeof(int64_t)) return false;
+  *length = Extract<int64_t>(response, 1);
+  if (lcsk_reconstruction != nullptr) {
+    const size_t pair_size = 2 * sizeof(int32_t);
+    if (response.size() != 1 + sizeof(int64_t) + *length * pair_size) {
+      return false;
+    }
+    lcsk_reconstruction->clear();
+    for (int64_t i = 0; i < *length; ++i) {
+      const size_t offset = 1 + sizeof(int64_t) + i * pair_size;
+      lcsk_reconstruction->push_back(
+          make_pair(Extract<int32_t>(response, offset),
+                    Extract<int32_t>(response, offset + sizeof(int32_t))));
+    }
+  }
+  return true;
+}
+
+bool ComparisonClient::GetLatencyStats(LatencyStats* stats) {
+  string request;
+  Append<uint8_t>(STATS_REQUEST, &request);
+  Append<uint8_t>(0, &request);
+  Append<uint32_t>(0, &request);
+
+  string response;
+  if (!Call(request, &response)) return false;
+  if (response.size() != 1 + sizeof(LatencyStats)) return false;
+  *stats = Extract<LatencyStats>(response, 1);
+  return true;
+}
+
+bool ComparisonClient::Call(const std::string& request,
+                            std::string* response) {
+  if (fd_ == -1 || !WriteFrame(fd_, request) ||
+      !ReadFrame(fd_, numeric_limits<uint64_t>::max(), response)) {
+    return false;
+  }
+  // A non-zero status byte reports a rejected request.
+  return !response->empty() && (*response)[0] == 0;
+}
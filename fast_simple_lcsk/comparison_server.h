@@ -0,0 +1,143 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMPARISON_SERVER
+#define COMPARISON_SERVER
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "match_maker.h"
+
+// Protocol between ComparisonServer and ComparisonClient over a Unix socket.
+// Every message is a frame: a uint64_t payload size followed by the payload,
+// all in host byte order. A connection carries any number of requests, each
+// answered by one response before the next one is read.
+//
+// Request payload: uint8_t type (RequestType), uint8_t flags (RequestFlags),
+// uint32_t reference id, then the query string.
+// Response payload: uint8_t status (0 on success), then for comparisons an
+// int64_t length followed, if requested, by the reconstruction as int32_t
+// (i, j) pairs, and for STATS a LatencyStats.
+enum RequestType : uint8_t {
+  LCSK_REQUEST = 0,
+  LCSKPP_REQUEST = 1,
+  STATS_REQUEST = 2,
+};
+enum RequestFlags : uint8_t { WITH_RECONSTRUCTION = 1 };
+
+// Percentiles of the latencies of the most recent comparison requests, in
+// microseconds, measured from receiving a request until its response is
+// sent. num_requests counts all comparison requests served.
+struct LatencyStats {
+  int64_t num_requests;
+  int64_t p50_us;
+  int64_t p90_us;
+  int64_t p99_us;
+  int64_t max_us;
+};
+
+// Daemon answering LCSk/LCSk++ queries against a fixed set of references,
+// whose k-mer indices are built once at startup (the references themselves
+// are not kept). Connections are served by a
+// pool of num_threads threads, one connection per thread at a time.
+//
+// A connection sending a frame larger than max_frame_size bytes is closed
+// without reading the payload, so that a malformed or hostile size cannot
+// exhaust the memory of the server.
+class ComparisonServer {
+ public:
+  static const uint64_t kDefaultMaxFrameSize = 256ULL << 20;
+
+  ComparisonServer(const std::vector<std::string>& references, int k,
+                   int num_threads);
+  ComparisonServer(const std::vector<std::string>& references, int k,
+                   int num_threads, uint64_t max_frame_size);
+  ~ComparisonServer();
+
+  // Binds and listens on socket_path, replacing any stale socket file.
+  // Returns false on failure.
+  bool Start(const std::string& socket_path);
+
+  // Accepts and serves connections until Stop() is called.
+  void Run();
+
+  // Makes Run() return once the connections being served are closed. Only
+  // stores an atomic flag and shuts the listening socket down, so it may be
+  // called from a signal handler.
+  void Stop();
+
+  LatencyStats GetLatencyStats() const;
+
+ private:
+  void Serve();
+  void ServeConnection(int fd);
+  void RecordLatency(int64_t latency_us);
+
+  int k_;
+  int num_threads_;
+  uint64_t max_frame_size_;
+  std::vector<std::unique_ptr<ReferenceIndex>> indices_;
+
+  int listen_fd_;
+  std::string socket_path_;
+  std::atomic<bool> stopping_;
+
+  // Accepted connections waiting for a thread, and those being served.
+  std::mutex connections_mutex_;
+  std::condition_variable connection_ready_;
+  std::deque<int> pending_connections_;
+  std::set<int> active_connections_;
+  bool closed_;
+
+  // Ring buffer of the latencies of the last kLatencyWindow requests.
+  mutable std::mutex latency_mutex_;
+  std::vector<int64_t> latencies_;
+  int64_t num_requests_;
+};
+
+// Client side of the protocol. All methods return false on a connection or
+// protocol error (e.g. an unknown reference id).
+class ComparisonClient {
+ public:
+  ComparisonClient();
+  ~ComparisonClient();
+
+  bool Connect(const std::string& socket_path);
+
+  // Computes LCSkpp (LCSk if !lcsk_plus) of query and the given reference.
+  // lcsk_reconstruction may be nullptr, in which case only the length is
+  // transferred.
+  bool Compare(int reference_id, const std::string& query, bool lcsk_plus,
+               int64_t* length,
+               std::vector<std::pair<int, int>>* lcsk_reconstruction);
+
+  bool GetLatencyStats(LatencyStats* stats);
+
+ private:
+  bool Call(const std::string& request, std::string* response);
+
+  int fd_;
+};
+
+#endif
@@ -0,0 +1,122 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KMER_FILTER
+#define KMER_FILTER
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Approximate set of the k-mer hashes of a string, answering whether a hash
+// may be in the set. It is consulted before the index of the string, so that
+// the k-mers of the other string which do not occur in it (most of them, when
+// comparing divergent strings) are rejected without a hash table lookup.
+//
+// If the hashes are known to be below a bound which is small compared to the
+// number of keys, the filter is an exact bitmap indexed by the hash.
+// Otherwise, it is a blocked Bloom filter: every hash sets kNumProbes bits
+// within a single 512-bit block, so a query touches one cache line. With
+// kBitsPerKey bits per key, less than 1% of the absent hashes pass.
+class KmerFilter {
+ public:
+  // Filter for num_keys hashes, all of which are below hash_bound, or
+  // arbitrary if hash_bound is 0.
+  KmerFilter(unsigned long long hash_bound, uint64_t num_keys)
+      : bitmap_(IsBitmap(hash_bound, num_keys)), num_blocks_(0) {
+    if (bitmap_) {
+      words_.assign((hash_bound + 63) / 64, 0);
+    } else {
+      num_blocks_ = NumBlocks(num_keys);
+      words_.assign(num_blocks_ * kBlockWords, 0);
+    }
+  }
+
+  // Memory taken by the bits of the filter constructed with these arguments.
+  static uint64_t Bytes(unsigned long long hash_bound, uint64_t num_keys) {
+    const uint64_t num_words = IsBitmap(hash_bound, num_keys)
+                                   ? (hash_bound + 63) / 64
+                                   : NumBlocks(num_keys) * kBlockWords;
+    return num_words * sizeof(uint64_t);
+  }
+
+  void Insert(unsigned long long hash) {
+    if (bitmap_) {
+      words_[hash / 64] |= 1ULL << (hash % 64);
+      return;
+    }
+    uint64_t* block = &words_[BlockOffset(hash)];
+    for (uint64_t probes = Probes(hash), i = 0; i < (uint64_t)kNumProbes;
+         ++i, probes >>= 9) {
+      block[(probes >> 6) & 7] |= 1ULL << (probes & 63);
+    }
+  }
+
+  bool MayContain(unsigned long long hash) const {
+    if (bitmap_) {
+      return hash / 64 < words_.size() &&
+             (words_[hash / 64] >> (hash % 64)) & 1;
+    }
+    const uint64_t* block = &words_[BlockOffset(hash)];
+    uint64_t missing = 0;
+    for (uint64_t probes = Probes(hash), i = 0; i < (uint64_t)kNumProbes;
+         ++i, probes >>= 9) {
+      missing |= ~block[(probes >> 6) & 7] & (1ULL << (probes & 63));
+    }
+    return missing == 0;
+  }
+
+ private:
+  static const int kBitsPerKey = 16;
+  static const int kNumProbes = 6;
+  static const int kBlockBits = 512;
+  static const int kBlockWords = kBlockBits / 64;
+
+  static uint64_t BloomBits(uint64_t num_keys) {
+    return std::max<uint64_t>(num_keys, 1) * kBitsPerKey;
+  }
+
+  static bool IsBitmap(unsigned long long hash_bound, uint64_t num_keys) {
+    return hash_bound != 0 &&
+           hash_bound <= std::max<uint64_t>(BloomBits(num_keys), 1 << 20);
+  }
+
+  static uint64_t NumBlocks(uint64_t num_keys) {
+    return (BloomBits(num_keys) + kBlockBits - 1) / kBlockBits;
+  }
+
+  // The finalizer of splitmix64, spreading the structured k-mer hashes over
+  // all 64 bits.
+  static uint64_t Mix(uint64_t hash) {
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+  }
+
+  uint64_t BlockOffset(unsigned long long hash) const {
+    return Mix(hash) % num_blocks_ * kBlockWords;
+  }
+
+  // kNumProbes 9-bit positions within the block, taken from the bits of a
+  // second mix.
+  static uint64_t Probes(unsigned long long hash) {
+    return Mix(hash ^ 0x9e3779b97f4a7c15ULL);
+  }
+
+  bool bitmap_;
+  uint64_t num_blocks_;
+  std::vector<uint64_t> words_;
+};
+
+#endif
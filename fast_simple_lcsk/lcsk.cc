@@ -13,218 +13,636 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
+#include <limits>
 
 #include "lcsk.h"
 #include "match_events_queue.h"
 #include "match_maker.h"
 #include "match_pair.h"
+#include "memory_policy.h"
+#include "row_sweeper.h"
+#include "sweep_timeline.h"
 using namespace std;
 
 namespace {
 
-void FillLcskReconstruction(const int k, std::shared_ptr<MatchPair> best,
-                            vector<pair<int, int>>* lcsk_recon) {
-  assert(lcsk_recon != nullptr);
-  lcsk_recon->clear();
+// Optional early termination of the sweep. A negative threshold disables it.
+struct SweepThreshold {
+  int threshold;
+  bool stop_when_reached;
+  // Set to the number of rows of a that were never swept.
+  int* rows_skipped;
+};
+
+// Decides whether the sweep can stop after processing all match pairs ending
+// in rows before next_row. Every remaining row can extend the best
+// LCSk/LCSk++ by at most one character, and the match pair crossing into
+// next_row can contribute up to k - 1 characters which are not yet accounted
+// for in best_length.
+bool ShouldStopSweep(const SweepThreshold& params, const int k,
+                     const int64_t best_length, const int64_t next_row,
+                     const int64_t num_rows) {
+  if (params.threshold < 0) return false;
+  if (best_length >= params.threshold) return params.stop_when_reached;
+  const int64_t remaining_rows = max<int64_t>(0, num_rows - next_row);
+  return best_length + remaining_rows + k - 1 < params.threshold;
+}
 
-  for (auto ft = best; ft != nullptr; ft = ft->prev) {
-    int r = ft->end_row;
-    int c = ft->end_col;
+// Samples a sweep into a SweepTimeline, or does nothing if it is nullptr.
+template <typename Pos>
+class TimelineRecorder {
+ public:
+  TimelineRecorder(SweepTimeline* timeline,
+                   const BasicSweepScratch<Pos>& scratch)
+      : timeline_(timeline),
+        scratch_(scratch),
+        interval_begin_(0),
+        begin_events_(0),
+        end_events_(0),
+        pending_end_events_(0),
+        match_pairs_alive_before_(
+            ObjectCounter<MatchPair>::objects_alive.load()) {
+    if (timeline_ == nullptr) return;
+    timeline_->Clear();
+    interval_start_ = chrono::steady_clock::now();
+  }
 
-    if (ft->prev == nullptr ||
-        (ft->prev->end_row + k <= ft->end_row &&
-         ft->prev->end_col + k <= ft->end_col)) {
-      for (int j = 0; j < k; ++j, --r, --c) {
-        lcsk_recon->push_back(make_pair(r, c));
+  void BeforeRow() {
+    if (timeline_ == nullptr) return;
+    pending_end_events_ = scratch_.events.end.size();
+  }
+
+  // Accounts for row, whose begin events were the num_matches k-mer matches
+  // of the row. Every end event created in the row is either processed in it
+  // or still pending after it.
+  void AfterRow(const int64_t row, const size_t num_matches) {
+    if (timeline_ == nullptr) return;
+    begin_events_ += num_matches;
+    end_events_ +=
+        pending_end_events_ + num_matches - scratch_.events.end.size();
+    if ((row + 1) % timeline_->sample_every_rows() == 0) Sample(row + 1);
+  }
+
+  // Samples the last, partial interval of a sweep stopped before next_row.
+  void Finish(const int64_t next_row) {
+    if (timeline_ == nullptr || next_row == interval_begin_) return;
+    Sample(next_row);
+  }
+
+ private:
+  void Sample(const int64_t next_row) {
+    const auto now = chrono::steady_clock::now();
+    timeline_->Add(TimelineSample{
+        next_row,
+        (int64_t)(ObjectCounter<MatchPair>::objects_alive.load() -
+                  match_pairs_alive_before_),
+        (int64_t)scratch_.compressed_table.size(), begin_events_, end_events_,
+        chrono::duration_cast<chrono::nanoseconds>(now - interval_start_)
+            .count()});
+    interval_begin_ = next_row;
+    interval_start_ = now;
+    begin_events_ = 0;
+    end_events_ = 0;
+  }
+
+  SweepTimeline* timeline_;
+  const BasicSweepScratch<Pos>& scratch_;
+  int64_t interval_begin_;
+  chrono::steady_clock::time_point interval_start_;
+  int64_t begin_events_;
+  int64_t end_events_;
+  size_t pending_end_events_;
+  // The counter is shared by all threads rather than per sweep, so the match
+  // pairs alive are counted from the start of the sweep. Comparisons running
+  // concurrently in other threads are counted as well.
+  uint64_t match_pairs_alive_before_;
+};
+
+// Sweeps the num_rows rows of a, pulling the k-mer matches of each row from
+// match_maker. scratch and timeline may be nullptr.
+template <typename Pos>
+void SweepRows(BasicMatchMaker<Pos>* match_maker, const Pos num_rows, int k,
+               vector<pair<Pos, Pos>>* lcsk_reconstruction,
+               const bool lcsk_plus,
+               const SweepThreshold& threshold_params,
+               BasicSweepScratch<Pos>* scratch, SweepTimeline* timeline) {
+  BasicSweepScratch<Pos> own_scratch;
+  if (scratch == nullptr) scratch = &own_scratch;
+  BasicRowSweeper<Pos> sweeper(k, lcsk_plus, scratch);
+  TimelineRecorder<Pos> recorder(timeline, *scratch);
+  vector<Pos>& row_matches = scratch->row_matches;
+  // Not a Pos, which would wrap around after the last row when num_rows is
+  // the largest Pos.
+  int64_t row = 0;
+  for (; row <= num_rows; ++row) {
+    match_maker->GetNextMatches(&row_matches);
+    recorder.BeforeRow();
+    sweeper.ProcessRow(static_cast<Pos>(row), row_matches);
+    recorder.AfterRow(row, row_matches.size());
+
+    if (row + 1 < num_rows &&
+        ShouldStopSweep(threshold_params, k, sweeper.BestLength(), row + 1,
+                        num_rows)) {
+      if (threshold_params.rows_skipped != nullptr) {
+        *threshold_params.rows_skipped = num_rows - (row + 1);
       }
-    } else {
-      assert(ft->prev->end_row + 1 == ft->end_row &&
-             ft->prev->end_col + 1 == ft->end_col);
-      lcsk_recon->push_back(make_pair(r, c));
+      ++row;
+      break;
     }
   }
-  reverse(lcsk_recon->begin(), lcsk_recon->end());
+  recorder.Finish(row);
+
+  sweeper.Reconstruct(lcsk_reconstruction);
 }
 
-bool CompareByCol(const std::shared_ptr<MatchPair>& a,
-                  const std::shared_ptr<MatchPair>& b) {
-  return a->end_col < b->end_col;
+// Prepares the outputs and checks whether the threshold is unreachable before
+// any work is done. Returns false if the sweep does not have to be run.
+template <typename OutPos>
+bool StartSweep(const int64_t a_size, const int64_t b_size, const int k,
+                vector<pair<OutPos, OutPos>>* lcsk_reconstruction,
+                const SweepThreshold& threshold_params) {
+  lcsk_reconstruction->clear();
+  if (threshold_params.rows_skipped != nullptr) {
+    *threshold_params.rows_skipped = 0;
+  }
+
+  if (threshold_params.threshold > min(a_size, b_size) ||
+      ShouldStopSweep(threshold_params, k, 0, 0, a_size)) {
+    if (threshold_params.rows_skipped != nullptr) {
+      *threshold_params.rows_skipped = a_size;
+    }
+    return false;
+  }
+  return true;
 }
 
-void RowUpdate(
-    const int k, const int row, MatchEventsQueue* events_ptr,
-    vector<std::shared_ptr<MatchPair>>* compressed_table_ptr,
-    vector<std::shared_ptr<MatchPair>>* prev_row_match_pairs,
-    bool lcsk_plus) {
-  auto& events = *events_ptr;
-  auto& compressed_table = *compressed_table_ptr;
-  auto& prev_row = *prev_row_match_pairs;
+template <typename Pos, typename OutPos>
+void MoveReconstruction(vector<pair<Pos, Pos>>* from,
+                        vector<pair<OutPos, OutPos>>* to) {
+  to->assign(from->begin(), from->end());
+}
 
-  std::tuple<int, int, std::shared_ptr<MatchPair>> event;
+template <typename Pos>
+void MoveReconstruction(vector<pair<Pos, Pos>>* from,
+                        vector<pair<Pos, Pos>>* to) {
+  to->swap(*from);
+}
 
-  vector<std::shared_ptr<MatchPair>> curr_row;
-  int curr_continuation_index = 0;
+// Runs the sequential sweep with positions of type Pos, which has to be able
+// to represent the lengths of a and b. The index and the match pairs are
+// allocated according to memory_policy.
+template <typename Pos, typename OutPos>
+void LcsKSparseFastWithPositions(
+    const char* a, size_t a_size, const char* b, size_t b_size, int k,
+    vector<pair<OutPos, OutPos>>* lcsk_reconstruction, const bool lcsk_plus,
+    const SweepThreshold& threshold_params,
+    const MemoryPolicy& memory_policy, SweepTimeline* timeline) {
+  assert(max(a_size, b_size) <= (size_t)numeric_limits<Pos>::max());
+  if (!StartSweep(a_size, b_size, k, lcsk_reconstruction, threshold_params)) {
+    return;
+  }
 
-  while (events.PopEnd(row, &event)) {
-    int i = get<0>(event);
-    int j = get<1>(event);
-    assert(i == row);
-    auto match_pair_end = get<2>(event);
+  auto match_maker = BasicMatchMaker<Pos>::Create(
+      a, a_size, b, b_size, k,
+      FastestMatchMakerType(a, a_size, b, b_size, k), memory_policy);
+  BasicSweepScratch<Pos> scratch(memory_policy);
+  vector<pair<Pos, Pos>> reconstruction;
+  SweepRows<Pos>(match_maker.get(), a_size, k, &reconstruction, lcsk_plus,
+                 threshold_params, &scratch, timeline);
+  MoveReconstruction(&reconstruction, lcsk_reconstruction);
+}
 
-    if (lcsk_plus) { // LCSk++
-      while (curr_continuation_index < prev_row.size() &&
-             prev_row[curr_continuation_index]->end_col + 1 < match_pair_end->end_col) {
-        curr_continuation_index++;
-      }
+// Runs the sequential sweep with the narrowest position type able to represent
+// the lengths of a and b, so that the memory taken by the index and the match
+// pairs follows the size of the input. timeline may be nullptr.
+template <typename OutPos>
+void LcsKSparseFastNarrowest(const char* a, size_t a_size, const char* b,
+                             size_t b_size, int k,
+                             vector<pair<OutPos, OutPos>>* lcsk_reconstruction,
+                             const bool lcsk_plus,
+                             const SweepThreshold& threshold_params,
+                             const MemoryPolicy& memory_policy,
+                             SweepTimeline* timeline) {
+  const size_t max_size = max(a_size, b_size);
+  assert(max_size <= (size_t)numeric_limits<OutPos>::max());
+  if (max_size <= numeric_limits<int16_t>::max()) {
+    LcsKSparseFastWithPositions<int16_t>(a, a_size, b, b_size, k,
+                                         lcsk_reconstruction, lcsk_plus,
+                                         threshold_params, memory_policy,
+                                         timeline);
+  } else if (max_size <= numeric_limits<int32_t>::max()) {
+    LcsKSparseFastWithPositions<int32_t>(a, a_size, b, b_size, k,
+                                         lcsk_reconstruction, lcsk_plus,
+                                         threshold_params, memory_policy,
+                                         timeline);
+  } else {
+    LcsKSparseFastWithPositions<int64_t>(a, a_size, b, b_size, k,
+                                         lcsk_reconstruction, lcsk_plus,
+                                         threshold_params, memory_policy,
+                                         timeline);
+  }
+}
 
-      if (curr_continuation_index < prev_row.size() &&
-          prev_row[curr_continuation_index]->end_col + 1 == match_pair_end->end_col) {
-        int continuation_dp = prev_row[curr_continuation_index]->dp + 1;
-        if (continuation_dp > match_pair_end->dp) {
-          match_pair_end->dp = continuation_dp;
-          match_pair_end->prev = prev_row[curr_continuation_index];
-        }
-      }
+// Runs the sequential sweep in the cheaper orientation. The matches, and so
+// the work of the sweep proper, are the same whichever string is indexed, but
+// indexing a character (hashing it into the table and appending to a position
+// list) costs several times more than sweeping a row (a filtered lookup), and
+// the index takes most of the memory. The shorter string is therefore indexed
+// and the longer one swept, transposing the reconstruction back if that is a.
+template <typename OutPos>
+void LcsKSparseFastImpl(const char* a, size_t a_size, const char* b,
+                        size_t b_size, int k,
+                        vector<pair<OutPos, OutPos>>* lcsk_reconstruction,
+                        const bool lcsk_plus,
+                        const SweepThreshold& threshold_params,
+                        const MemoryPolicy& memory_policy) {
+  if (a_size >= b_size) {
+    LcsKSparseFastNarrowest(a, a_size, b, b_size, k, lcsk_reconstruction,
+                            lcsk_plus, threshold_params, memory_policy,
+                            nullptr);
+    return;
+  }
+  LcsKSparseFastNarrowest(b, b_size, a, a_size, k, lcsk_reconstruction,
+                          lcsk_plus, threshold_params, memory_policy, nullptr);
+  for (auto& match : *lcsk_reconstruction) {
+    swap(match.first, match.second);
+  }
+}
 
-      curr_row.emplace_back(match_pair_end);
+void LcsKSparseFastMultiKImpl(
+    const string& a, const string& b, const vector<int>& ks,
+    const bool lcsk_plus, vector<vector<pair<int, int>>>* lcsk_reconstructions) {
+  lcsk_reconstructions->assign(ks.size(), vector<pair<int, int>>());
+  if (ks.empty()) return;
+
+  vector<int> distinct_ks(ks);
+  sort(distinct_ks.begin(), distinct_ks.end());
+  distinct_ks.erase(unique(distinct_ks.begin(), distinct_ks.end()),
+                    distinct_ks.end());
+  const int min_k = distinct_ks.front();
+  const int max_lag = distinct_ks.back() - min_k;
+  assert(min_k > 0);
+
+  vector<unique_ptr<RowSweeper>> sweepers;
+  for (int k : distinct_ks) {
+    sweepers.emplace_back(new RowSweeper(k, lcsk_plus));
+  }
 
-      int dp = match_pair_end->dp;
-      while (compressed_table.size() <= dp) {
-        // fill with dummy values which will be overwritten in for loop below anyway.
-        int idx = compressed_table.size();
-        compressed_table.push_back(std::make_shared<MatchPair>(i+1, j+1, idx, nullptr));
-      }
+  // A match of length min_k + lag starting at (i, j) is a run of lag + 1
+  // consecutive matches of length min_k on the diagonal, so it is discovered
+  // in row i + lag. The sweep for that length therefore lags lag rows behind.
+  const int num_rows = a.size();
+  auto match_maker =
+      MatchMaker::Create(a, b, min_k, FastestMatchMakerType(a, b, min_k));
+  // (column, length of the diagonal run of matches ending there), capped at
+  // max_lag + 1.
+  vector<pair<int, int>> prev_runs;
+  vector<pair<int, int>> curr_runs;
+  vector<int> row_matches;
+  vector<int> derived_matches;
+  for (int row = 0; row <= num_rows + max_lag; ++row) {
+    row_matches.clear();
+    if (row <= num_rows) {
+      match_maker->GetNextMatches(&row_matches);
+    }
 
-      for (int idx = dp; idx > dp - k && j < compressed_table[idx]->end_col; --idx) {
-        compressed_table[idx] = match_pair_end;
+    curr_runs.clear();
+    size_t prev_index = 0;
+    for (int col : row_matches) {
+      while (prev_index < prev_runs.size() &&
+             prev_runs[prev_index].first < col - 1) {
+        ++prev_index;
       }
-    } else { // LCSk
-      int idx = match_pair_end->dp / k;
-      if (idx == compressed_table.size()) {
-        compressed_table.emplace_back(match_pair_end);
-      } else if (j < compressed_table[idx]->end_col) {
-        compressed_table[idx] = match_pair_end;
+      int run = 1;
+      if (prev_index < prev_runs.size() &&
+          prev_runs[prev_index].first == col - 1) {
+        run = min(prev_runs[prev_index].second + 1, max_lag + 1);
       }
+      curr_runs.push_back(make_pair(col, run));
     }
+
+    for (size_t t = 0; t < distinct_ks.size(); ++t) {
+      const int lag = distinct_ks[t] - min_k;
+      const int sweep_row = row - lag;
+      if (sweep_row < 0 || sweep_row > num_rows) continue;
+
+      derived_matches.clear();
+      for (const auto& run : curr_runs) {
+        if (run.second > lag) {
+          derived_matches.push_back(run.first - lag);
+        }
+      }
+      sweepers[t]->ProcessRow(sweep_row, derived_matches);
+    }
+    prev_runs.swap(curr_runs);
   }
 
-  prev_row.swap(curr_row);
+  for (size_t i = 0; i < ks.size(); ++i) {
+    const int t = lower_bound(distinct_ks.begin(), distinct_ks.end(), ks[i]) -
+                  distinct_ks.begin();
+    sweepers[t]->Reconstruct(&(*lcsk_reconstructions)[i]);
+  }
 }
 
-void AmortizedRowQuery(
-    const int k, const int row, MatchEventsQueue* events_ptr,
-    vector<std::shared_ptr<MatchPair>>* compressed_table_ptr) {
-  auto& events = *events_ptr;
-  auto& compressed_table = *compressed_table_ptr;
+// Minimum number of rows batched into a single message of a BatchChannel
+// (e.g. between neighbouring stripes of the parallel sweep), and maximum
+// number of batches in flight.
+const int kChannelBatchRows = 256;
+const int kMaxChannelBatches = 64;
+
+// State of the boundary between two neighbouring column stripes after a row
+// has been swept by the stripe on the left.
+struct RowBoundary {
+  // Match pair with the largest dp among those ending left of the boundary
+  // in this row or above, nullptr if there is none.
+  std::shared_ptr<MatchPair> best;
+  // Match pair ending in this row in the last column left of the boundary,
+  // needed for LCSk++ continuations.
+  std::shared_ptr<MatchPair> last_col_pair;
+  // End events created in this row which end right of the boundary.
+  vector<tuple<int, int, std::shared_ptr<MatchPair>>> crossing_ends;
+};
+
+// Single producer, single consumer queue of batches of per-row messages.
+template <typename T>
+class BatchChannel {
+ public:
+  void Push(vector<T>* batch) {
+    unique_lock<mutex> lock(mutex_);
+    not_full_.wait(lock,
+                   [this] { return batches_.size() < kMaxChannelBatches; });
+    batches_.emplace_back();
+    batches_.back().swap(*batch);
+    not_empty_.notify_one();
+  }
 
-  int curr_threshold_index = 0;
-  std::tuple<int, int, std::shared_ptr<MatchPair>> event;
+  void Pop(vector<T>* batch) {
+    unique_lock<mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return !batches_.empty(); });
+    batch->swap(batches_.front());
+    batches_.pop_front();
+    not_full_.notify_one();
+  }
 
-  while (events.PopBegin(row, &event)) {
-    int i = get<0>(event);
-    int j = get<1>(event);
-    assert(i == row);
-    while (curr_threshold_index < compressed_table.size() &&
-           compressed_table[curr_threshold_index]->end_col < j) {
-      ++curr_threshold_index;
-    }
+ private:
+  mutex mutex_;
+  condition_variable not_empty_;
+  condition_variable not_full_;
+  deque<vector<T>> batches_;
+};
 
-    auto prev_best = compressed_table[curr_threshold_index - 1];
-    auto match_pair = std::make_shared<MatchPair>(i + k - 1, j + k - 1, k, nullptr);
-    if (prev_best->dp > 0) {
-      match_pair->dp = prev_best->dp + k;
-      match_pair->prev = prev_best;
-    }
-    events.AddEnd(make_tuple(i + k - 1, j + k - 1, match_pair));
-  }
+typedef BatchChannel<RowBoundary> BoundaryChannel;
+
+const std::shared_ptr<MatchPair>& BetterMatchPair(
+    const std::shared_ptr<MatchPair>& a, const std::shared_ptr<MatchPair>& b) {
+  if (a == nullptr) return b;
+  if (b == nullptr) return a;
+  return b->dp > a->dp ? b : a;
 }
 
-void ElementwiseRowQuery(
-    const int k, const int row, MatchEventsQueue* events_ptr,
-    vector<std::shared_ptr<MatchPair>>* compressed_table_ptr) {
-  auto& events = *events_ptr;
-  auto& compressed_table = *compressed_table_ptr;
+// Sweeps the rows of a against the columns [col_begin, col_end) of b, which
+// are the begin columns of the match pairs queried and the end columns of the
+// match pairs updated by this stripe. Everything left of col_begin is
+// summarized by the boundaries received from the stripe on the left (if any),
+// one per row; the boundaries of this stripe are sent to the right (if any).
+// Requires col_end - col_begin >= k, so that match pairs cross at most one
+// boundary. Sets *best to the best match pair ending left of col_end.
+void SweepStripe(const string& a, const string& b, const int k,
+                 const bool lcsk_plus, const int col_begin, const int col_end,
+                 BoundaryChannel* left, BoundaryChannel* right,
+                 std::shared_ptr<MatchPair>* best) {
+  const int num_rows = a.size();
+  const string b_stripe =
+      b.substr(col_begin, min((int)b.size(), col_end + k - 1) - col_begin);
+  auto match_maker = MatchMaker::Create(
+      a, b_stripe, k, FastestMatchMakerType(a, b_stripe, k));
+
+  // The match pairs travel to the stripes on the right, which may release
+  // them, so they are not pooled.
+  SweepScratch scratch(/*pool_match_pairs=*/false);
+  auto& events = scratch.events;
+  auto& compressed_table = scratch.compressed_table;
+  auto& end_cols = scratch.compressed_table_end_cols;
+  auto& prev_row_match_pairs = scratch.prev_row_match_pairs;
+  compressed_table.emplace_back(std::make_shared<MatchPair>(-1, -1, 0, nullptr));
+  end_cols.push_back(-1);
+  // Entries [0, boundary_index] hold match pairs left of col_begin.
+  int boundary_index = 0;
+
+  // Pending end events of this stripe, both own and received from the left,
+  // in row order.
+  queue<tuple<int, int, std::shared_ptr<MatchPair>>> own_ends;
+  queue<tuple<int, int, std::shared_ptr<MatchPair>>> crossing_ends;
+
+  vector<RowBoundary> left_batch;
+  size_t left_batch_pos = 0;
+  RowBoundary prev_left_boundary;
+  vector<RowBoundary> right_batch;
+
+  vector<int> row_matches;
+  for (int row = 0; row <= num_rows; ++row) {
+    RowBoundary left_boundary;
+    if (left != nullptr) {
+      if (left_batch_pos == left_batch.size()) {
+        left->Pop(&left_batch);
+        left_batch_pos = 0;
+      }
+      left_boundary = std::move(left_batch[left_batch_pos++]);
+      for (auto& event : left_boundary.crossing_ends) {
+        crossing_ends.push(event);
+      }
+    }
 
-  tuple<int, int, std::shared_ptr<MatchPair>> event;
+    // Every match pair ending left of col_begin in the rows above dominates
+    // the entries of the compressed table up to its index.
+    const auto& left_best = prev_left_boundary.best;
+    if (left_best != nullptr) {
+      const int left_index = lcsk_plus ? left_best->dp : left_best->dp / k;
+      while (compressed_table.size() <= left_index) {
+        compressed_table.push_back(left_best);
+        end_cols.push_back(left_best->end_col);
+      }
+      for (; boundary_index < left_index; ++boundary_index) {
+        compressed_table[boundary_index + 1] = left_best;
+        end_cols[boundary_index + 1] = left_best->end_col;
+      }
+    }
 
-  while (events.PopBegin(row, &event)) {
-    int i = get<0>(event);
-    int j = get<1>(event);
-    assert(i == row);
+    match_maker->GetNextMatches(&row_matches);
+    for (int col : row_matches) {
+      events.AddBegin(make_tuple(row, col_begin + col, nullptr));
+    }
+    RowQuery(k, row, row_matches.size(), &scratch);
+
+    RowBoundary right_boundary;
+    for (; !events.end.empty(); events.end.pop()) {
+      if (get<1>(events.end.front()) < col_end) {
+        own_ends.push(events.end.front());
+      } else {
+        right_boundary.crossing_ends.push_back(events.end.front());
+      }
+    }
 
-    auto dummy_match_pair = std::make_shared<MatchPair>(0, j, 0, nullptr);
-    auto prev_best =
-      lower_bound(compressed_table.begin(), compressed_table.end(),
-                  dummy_match_pair, CompareByCol) -
-      1;
-    // We reuse dummy_match_pair in order to keep the object counters precise
-    // (otherwise the objects_created counter would roughly double due to
-    // instantiation of the dummy object).
-    //
-    // The following several lines can be read as:
-    // auto match_pair =
-    //    std::make_shared<MatchPair>(i + k - 1, j + k - 1, k, nullptr);
-    auto match_pair = dummy_match_pair;
-    match_pair->end_row = i + k - 1;
-    match_pair->end_col = j + k - 1;
-    match_pair->dp = k;
+    // End events received from the left precede the own ones in column order.
+    for (; !crossing_ends.empty() && get<0>(crossing_ends.front()) == row;
+         crossing_ends.pop()) {
+      events.AddEnd(crossing_ends.front());
+    }
+    for (; !own_ends.empty() && get<0>(own_ends.front()) == row;
+         own_ends.pop()) {
+      events.AddEnd(own_ends.front());
+    }
+    if (lcsk_plus && prev_left_boundary.last_col_pair != nullptr) {
+      prev_row_match_pairs.insert(prev_row_match_pairs.begin(),
+                                  prev_left_boundary.last_col_pair);
+    }
+    RowUpdate(k, row, &scratch, lcsk_plus);
+
+    std::shared_ptr<MatchPair> local_best =
+        compressed_table.back()->end_row != -1 ? compressed_table.back()
+                                               : nullptr;
+    right_boundary.best = BetterMatchPair(left_boundary.best, local_best);
+    if (!prev_row_match_pairs.empty() &&
+        prev_row_match_pairs.back()->end_col == col_end - 1) {
+      right_boundary.last_col_pair = prev_row_match_pairs.back();
+    }
+    prev_left_boundary = std::move(left_boundary);
 
-    if ((*prev_best)->dp > 0) {
-      match_pair->dp = (*prev_best)->dp + k;
-      match_pair->prev = *prev_best;
+    if (right != nullptr) {
+      right_batch.push_back(std::move(right_boundary));
+      if (right_batch.size() == kChannelBatchRows || row == num_rows) {
+        right->Push(&right_batch);
+        right_batch.clear();
+      }
+    } else if (row == num_rows) {
+      *best = right_boundary.best;
     }
-    events.AddEnd(make_tuple(i + k - 1, j + k - 1, match_pair));
   }
 }
 
-void LcsKSparseFastImpl(const string& a, const string& b, int k,
-                        vector<pair<int, int>>* lcsk_reconstruction,
-                        const bool lcsk_plus) {
-  lcsk_reconstruction->clear();
+void LcsKSparseParallelImpl(const string& a, const string& b, int k,
+                            int num_threads,
+                            vector<pair<int, int>>* lcsk_reconstruction,
+                            const bool lcsk_plus) {
+  // Every stripe has to be at least k columns wide.
+  const int num_begin_cols = (int)b.size() - k + 1;
+  const int num_stripes = min(num_threads, num_begin_cols / k);
+  if (num_stripes <= 1) {
+    LcsKSparseFastImpl(a.data(), a.size(), b.data(), b.size(), k,
+                       lcsk_reconstruction, lcsk_plus,
+                       SweepThreshold{-1, false, nullptr}, MemoryPolicy());
+    return;
+  }
 
-  MatchEventsQueue events;
-  auto match_maker = MatchMaker::Create(a, b, k, PERFECT_HASH);
+  vector<int> col_begin(num_stripes + 1);
+  for (int t = 0; t < num_stripes; ++t) {
+    col_begin[t] = (long long)num_begin_cols * t / num_stripes;
+  }
+  col_begin[num_stripes] = b.size();
 
-  vector<std::shared_ptr<MatchPair>> compressed_table;
-  compressed_table.emplace_back(std::make_shared<MatchPair>(-1, -1, 0, nullptr));
-  // following invariants hold:
-  //    LCSk++: compressed_table[i]->dp == i
-  //    LCSk:   compressed_table[i]->dp == k*i
-  vector<std::shared_ptr<MatchPair>> prev_row_match_pairs;
+  vector<unique_ptr<BoundaryChannel>> channels(num_stripes - 1);
+  for (auto& channel : channels) {
+    channel.reset(new BoundaryChannel());
+  }
 
-  for (int row = 0; row <= a.size(); ++row) {
-    vector<int> row_matches;
-    match_maker->GetNextMatches(&row_matches);
-    for (int col : row_matches) {
-      events.AddBegin(make_tuple(row, col, nullptr));
+  std::shared_ptr<MatchPair> best;
+  vector<thread> threads;
+  for (int t = 0; t < num_stripes; ++t) {
+    threads.emplace_back(SweepStripe, std::cref(a), std::cref(b), k, lcsk_plus,
+                         col_begin[t], col_begin[t + 1],
+                         t > 0 ? channels[t - 1].get() : nullptr,
+                         t + 1 < num_stripes ? channels[t].get() : nullptr,
+                         &best);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  FillLcskReconstruction(k, best, lcsk_reconstruction);
+}
+
+// Sweeps the reverse strand rows received through channel, from row 0 up to
+// and including num_rows.
+void SweepReverseStrand(const int num_rows, BatchChannel<vector<int>>* channel,
+                        RowSweeper* sweeper) {
+  vector<vector<int>> batch;
+  for (int row = 0; row <= num_rows;) {
+    channel->Pop(&batch);
+    for (const auto& row_matches : batch) {
+      sweeper->ProcessRow(row++, row_matches);
     }
+  }
+}
+
+Strand LcsKSparseFastDualStrandImpl(const string& a, const string& b, int k,
+                                    const bool lcsk_plus, int num_threads,
+                                    vector<pair<int, int>>* lcsk_reconstruction) {
+  const int num_rows = a.size();
+  DualStrandMatchMaker match_maker(a, b, k);
+  // The reverse strand is swept as a against rc(b), whose matches come in the
+  // same row order as the forward ones.
+  RowSweeper forward_sweeper(k, lcsk_plus);
+  RowSweeper reverse_sweeper(k, lcsk_plus);
+
+  BatchChannel<vector<int>> channel;
+  unique_ptr<thread> reverse_thread;
+  if (num_threads >= 2) {
+    reverse_thread.reset(new thread(SweepReverseStrand, num_rows, &channel,
+                                    &reverse_sweeper));
+  }
 
-    int table_row_size = compressed_table.size();
-    int num_begin_events = row_matches.size();
-    bool use_amortized_row_update = (table_row_size + num_begin_events <
-                                     6 * num_begin_events * log(table_row_size) / log(2));
+  vector<int> forward_matches;
+  vector<int> reverse_matches;
+  vector<vector<int>> reverse_batch;
+  for (int row = 0; row <= num_rows; ++row) {
+    match_maker.GetNextMatches(&forward_matches, &reverse_matches);
+    forward_sweeper.ProcessRow(row, forward_matches);
+    if (reverse_thread == nullptr) {
+      reverse_sweeper.ProcessRow(row, reverse_matches);
+      continue;
+    }
 
-    if (use_amortized_row_update) {
-      AmortizedRowQuery(k, row, &events, &compressed_table);
-    } else {
-      ElementwiseRowQuery(k, row, &events, &compressed_table);
+    reverse_batch.emplace_back();
+    reverse_batch.back().swap(reverse_matches);
+    if (reverse_batch.size() == kChannelBatchRows || row == num_rows) {
+      channel.Push(&reverse_batch);
+      reverse_batch.clear();
     }
+  }
+  if (reverse_thread != nullptr) {
+    reverse_thread->join();
+  }
 
-    RowUpdate(k, row, &events, &compressed_table, &prev_row_match_pairs, lcsk_plus);
+  if (forward_sweeper.BestLength() >= reverse_sweeper.BestLength()) {
+    forward_sweeper.Reconstruct(lcsk_reconstruction);
+    return FORWARD_STRAND;
   }
 
-  auto best = compressed_table.back()->end_row != -1 ? compressed_table.back() : nullptr;
-  FillLcskReconstruction(k, best, lcsk_reconstruction);
+  // (i, j) in a x rc(b) is (|a| - 1 - i, |b| - 1 - j) in rc(a) x b.
+  reverse_sweeper.Reconstruct(lcsk_reconstruction);
+  reverse(lcsk_reconstruction->begin(), lcsk_reconstruction->end());
+  for (auto& match : *lcsk_reconstruction) {
+    match.first = (int)a.size() - 1 - match.first;
+    match.second = (int)b.size() - 1 - match.second;
+  }
+  return REVERSE_STRAND;
 }
 
 }  // namespace
@@ -234,10 +652,204 @@ void LcsKSparseFastImpl(const string& a, const string& b, int k,
 
 void LcsKSparseFast(const std::string& a, const std::string& b, int k,
                     std::vector<std::pair<int, int>>* lcsk_reconstruction) {
-  LcsKSparseFastImpl(a, b, k, lcsk_reconstruction, /*lcsk_plus=*/false);
+  LcsKSparseFastImpl(a.data(), a.size(), b.data(), b.size(), k,
+                     lcsk_reconstruction, /*lcsk_plus=*/false,
+                     SweepThreshold{-1, false, nullptr}, MemoryPolicy());
 }
 
 void LcsKppSparseFast(const std::string& a, const std::string& b, int k,
                         std::vector<std::pair<int, int>>* lcsk_reconstruction) {
-  LcsKSparseFastImpl(a, b, k, lcsk_reconstruction, /*lcsk_plus=*/true);
+  LcsKSparseFastImpl(a.data(), a.size(), b.data(), b.size(), k,
+                     lcsk_reconstruction, /*lcsk_plus=*/true,
+                     SweepThreshold{-1, false, nullptr}, MemoryPolicy());
+}
+
+void LcsKSparseFast(const std::string& a, const std::string& b, int k,
+                    std::vector<std::pair<int64_t, int64_t>>* lcsk_reconstruction) {
+  LcsKSparseFastImpl(a.data(), a.size(), b.data(), b.size(), k,
+                     lcsk_reconstruction, /*lcsk_plus=*/false,
+                     SweepThreshold{-1, false, nullptr}, MemoryPolicy());
+}
+
+void LcsKppSparseFast(const std::string& a, const std::string& b, int k,
+                      std::vector<std::pair<int64_t, int64_t>>* lcsk_reconstruction) {
+  LcsKSparseFastImpl(a.data(), a.size(), b.data(), b.size(), k,
+                     lcsk_reconstruction, /*lcsk_plus=*/true,
+                     SweepThreshold{-1, false, nullptr}, MemoryPolicy());
+}
+
+void LcsKSparseFast(const char* a, size_t a_size, const char* b,
+                    size_t b_size, int k,
+                    std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  LcsKSparseFastImpl(a, a_size, b, b_size, k, lcsk_reconstruction,
+                     /*lcsk_plus=*/false, SweepThreshold{-1, false, nullptr},
+                     MemoryPolicy());
+}
+
+void LcsKppSparseFast(const char* a, size_t a_size, const char* b,
+                      size_t b_size, int k,
+                      std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  LcsKSparseFastImpl(a, a_size, b, b_size, k, lcsk_reconstruction,
+                     /*lcsk_plus=*/true, SweepThreshold{-1, false, nullptr},
+                     MemoryPolicy());
+}
+
+template <typename Pos>
+void LcsKSparseFastWithPositionType(
+    const std::string& a, const std::string& b, int k, bool lcsk_plus,
+    std::vector<std::pair<Pos, Pos>>* lcsk_reconstruction) {
+  LcsKSparseFastWithPositions<Pos>(a.data(), a.size(), b.data(), b.size(), k,
+                                   lcsk_reconstruction, lcsk_plus,
+                                   SweepThreshold{-1, false, nullptr},
+                                   MemoryPolicy(), nullptr);
+}
+
+template void LcsKSparseFastWithPositionType(
+    const std::string&, const std::string&, int, bool,
+    std::vector<std::pair<int16_t, int16_t>>*);
+template void LcsKSparseFastWithPositionType(
+    const std::string&, const std::string&, int, bool,
+    std::vector<std::pair<int32_t, int32_t>>*);
+template void LcsKSparseFastWithPositionType(
+    const std::string&, const std::string&, int, bool,
+    std::vector<std::pair<int64_t, int64_t>>*);
+
+void LcsKSparseFastWithMemoryPolicy(
+    const std::string& a, const std::string& b, int k, bool lcsk_plus,
+    const MemoryPolicy& memory_policy,
+    std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  LcsKSparseFastImpl(a.data(), a.size(), b.data(), b.size(), k,
+                     lcsk_reconstruction, lcsk_plus,
+                     SweepThreshold{-1, false, nullptr}, memory_policy);
+}
+
+void LcsKSparseFastWithTimeline(
+    const std::string& a, const std::string& b, int k, bool lcsk_plus,
+    SweepTimeline* timeline,
+    std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  LcsKSparseFastNarrowest(a.data(), a.size(), b.data(), b.size(), k,
+                          lcsk_reconstruction, lcsk_plus,
+                          SweepThreshold{-1, false, nullptr}, MemoryPolicy(),
+                          timeline);
+}
+
+bool LcsKSparseFastAtLeast(const std::string& a, const std::string& b, int k,
+                           int threshold, bool stop_when_reached,
+                           std::vector<std::pair<int, int>>* lcsk_reconstruction,
+                           int* rows_skipped) {
+  assert(threshold >= 0);
+  LcsKSparseFastImpl(a.data(), a.size(), b.data(), b.size(), k,
+                     lcsk_reconstruction, /*lcsk_plus=*/false,
+                     SweepThreshold{threshold, stop_when_reached, rows_skipped},
+                     MemoryPolicy());
+  return (int)lcsk_reconstruction->size() >= threshold;
+}
+
+bool LcsKppSparseFastAtLeast(const std::string& a, const std::string& b, int k,
+                             int threshold, bool stop_when_reached,
+                             std::vector<std::pair<int, int>>* lcsk_reconstruction,
+                             int* rows_skipped) {
+  assert(threshold >= 0);
+  LcsKSparseFastImpl(a.data(), a.size(), b.data(), b.size(), k,
+                     lcsk_reconstruction, /*lcsk_plus=*/true,
+                     SweepThreshold{threshold, stop_when_reached, rows_skipped},
+                     MemoryPolicy());
+  return (int)lcsk_reconstruction->size() >= threshold;
+}
+
+void LcsKSparseFastSelf(const std::string& a, int k,
+                        std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  SelfMatchMaker match_maker(a, k);
+  LcsKSparseFastWithMatchMaker(&match_maker, a.size(), a.size(), k,
+                               /*lcsk_plus=*/false, -1, false,
+                               lcsk_reconstruction, nullptr);
+}
+
+void LcsKppSparseFastSelf(const std::string& a, int k,
+                          std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  SelfMatchMaker match_maker(a, k);
+  LcsKSparseFastWithMatchMaker(&match_maker, a.size(), a.size(), k,
+                               /*lcsk_plus=*/true, -1, false,
+                               lcsk_reconstruction, nullptr);
+}
+
+void LcsKSparseFastMultiK(
+    const std::string& a, const std::string& b, const std::vector<int>& ks,
+    bool lcsk_plus,
+    std::vector<std::vector<std::pair<int, int>>>* lcsk_reconstructions) {
+  LcsKSparseFastMultiKImpl(a, b, ks, lcsk_plus, lcsk_reconstructions);
+}
+
+void LcsKppSparseMinimizer(const std::string& a, const std::string& b, int k,
+                           int w,
+                           std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  MinimizerMatchMaker match_maker(a, b, k, w);
+  LcsKSparseFastWithMatchMaker(&match_maker, a.size(), b.size(), k,
+                               /*lcsk_plus=*/true, -1, false,
+                               lcsk_reconstruction, nullptr);
+}
+
+void LcsKSparseFastParallel(const std::string& a, const std::string& b, int k,
+                            int num_threads,
+                            std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  LcsKSparseParallelImpl(a, b, k, num_threads, lcsk_reconstruction,
+                         /*lcsk_plus=*/false);
+}
+
+void LcsKppSparseFastParallel(const std::string& a, const std::string& b, int k,
+                              int num_threads,
+                              std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  LcsKSparseParallelImpl(a, b, k, num_threads, lcsk_reconstruction,
+                         /*lcsk_plus=*/true);
+}
+
+std::string ReverseComplement(const std::string& s) {
+  string rc(s.rbegin(), s.rend());
+  for (char& c : rc) {
+    switch (c) {
+      case 'A': c = 'T'; break;
+      case 'C': c = 'G'; break;
+      case 'G': c = 'C'; break;
+      case 'T': c = 'A'; break;
+    }
+  }
+  return rc;
+}
+
+Strand LcsKSparseFastDualStrand(
+    const std::string& a, const std::string& b, int k, int num_threads,
+    std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  return LcsKSparseFastDualStrandImpl(a, b, k, /*lcsk_plus=*/false,
+                                      num_threads, lcsk_reconstruction);
+}
+
+Strand LcsKppSparseFastDualStrand(
+    const std::string& a, const std::string& b, int k, int num_threads,
+    std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  return LcsKSparseFastDualStrandImpl(a, b, k, /*lcsk_plus=*/true,
+                                      num_threads, lcsk_reconstruction);
+}
+
+bool LcsKSparseFastWithMatchMaker(
+    MatchMaker* match_maker, int a_size, int b_size, int k, bool lcsk_plus,
+    int threshold, bool stop_when_reached,
+    std::vector<std::pair<int, int>>* lcsk_reconstruction, int* rows_skipped) {
+  return LcsKSparseFastWithMatchMaker(match_maker, a_size, b_size, k,
+                                      lcsk_plus, threshold, stop_when_reached,
+                                      lcsk_reconstruction, rows_skipped,
+                                      nullptr);
+}
+
+bool LcsKSparseFastWithMatchMaker(
+    MatchMaker* match_maker, int a_size, int b_size, int k, bool lcsk_plus,
+    int threshold, bool stop_when_reached,
+    std::vector<std::pair<int, int>>* lcsk_reconstruction, int* rows_skipped,
+    SweepScratch* scratch) {
+  const SweepThreshold threshold_params{threshold, stop_when_reached,
+                                        rows_skipped};
+  if (StartSweep(a_size, b_size, k, lcsk_reconstruction, threshold_params)) {
+    SweepRows<int>(match_maker, a_size, k, lcsk_reconstruction, lcsk_plus,
+                   threshold_params, scratch, nullptr);
+  }
+  return (int)lcsk_reconstruction->size() >= threshold;
 }
@@ -15,12 +15,29 @@
 #ifndef LCSK
 #define LCSK
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <utility>
 #include <vector>
 
+template <typename Pos>
+class BasicMatchMaker;
+typedef BasicMatchMaker<int> MatchMaker;
+template <typename Pos>
+struct BasicSweepScratch;
+typedef BasicSweepScratch<int> SweepScratch;
+struct MemoryPolicy;
+class SweepTimeline;
+
 // Given strings a, b and the length k of matching subsequences, this function
 // finds LCSk(a, b).
+//
+// This and the functions below, unless stated otherwise, index the k-mers of
+// the shorter of a and b and sweep the rows of the longer one, which is
+// several times faster and takes less memory than the other way around when
+// the lengths differ, e.g. for a query against a whole reference. The
+// reconstruction is always given as pairs (position in a, position in b).
 void LcsKSparseFast(const std::string &a, const std::string &b, int k,
                     std::vector<std::pair<int, int>> *lcsk_reconstruction);
 
@@ -29,4 +46,206 @@ void LcsKSparseFast(const std::string &a, const std::string &b, int k,
 void LcsKppSparseFast(const std::string &a, const std::string &b, int k,
                       std::vector<std::pair<int, int>> *lcsk_reconstruction);
 
+// Same as above, for inputs whose positions do not fit into an int.
+void LcsKSparseFast(const std::string &a, const std::string &b, int k,
+                    std::vector<std::pair<int64_t, int64_t>> *lcsk_reconstruction);
+void LcsKppSparseFast(const std::string &a, const std::string &b, int k,
+                      std::vector<std::pair<int64_t, int64_t>> *lcsk_reconstruction);
+
+// Same as LcsKSparseFast and LcsKppSparseFast, for strings given as a pointer
+// and a length, e.g. a buffer owned by the caller, which is then copied only
+// once, by the match maker.
+void LcsKSparseFast(const char *a, size_t a_size, const char *b, size_t b_size,
+                    int k, std::vector<std::pair<int, int>> *lcsk_reconstruction);
+void LcsKppSparseFast(const char *a, size_t a_size, const char *b,
+                      size_t b_size, int k,
+                      std::vector<std::pair<int, int>> *lcsk_reconstruction);
+
+// The functions above store positions and dp values in the index and in the
+// match pairs using the narrowest of int16_t, int32_t and int64_t which can
+// represent the lengths of both strings. This function runs the sweep with the
+// given position type Pos (one of those three) instead, computing LCSkpp if
+// lcsk_plus is set and LCSk otherwise.
+template <typename Pos>
+void LcsKSparseFastWithPositionType(
+    const std::string &a, const std::string &b, int k, bool lcsk_plus,
+    std::vector<std::pair<Pos, Pos>> *lcsk_reconstruction);
+
+// Same as LcsKSparseFast (LcsKppSparseFast if lcsk_plus is set), allocating
+// the k-mer index and the match pairs according to memory_policy, e.g. backed
+// by huge pages on the NUMA node of the calling thread (see MemoryPolicy).
+void LcsKSparseFastWithMemoryPolicy(
+    const std::string &a, const std::string &b, int k, bool lcsk_plus,
+    const MemoryPolicy &memory_policy,
+    std::vector<std::pair<int, int>> *lcsk_reconstruction);
+
+// Same as LcsKSparseFast (LcsKppSparseFast if lcsk_plus is set), recording the
+// timeline of the sweep into timeline (see SweepTimeline). The rows of the
+// timeline are positions of a, which is swept even if it is the shorter
+// string.
+void LcsKSparseFastWithTimeline(
+    const std::string &a, const std::string &b, int k, bool lcsk_plus,
+    SweepTimeline *timeline,
+    std::vector<std::pair<int, int>> *lcsk_reconstruction);
+
+// Given strings a, b, the length k of matching subsequences and a target
+// length threshold, these functions decide whether LCSk(a, b) (respectively
+// LCSkpp(a, b)) is at least threshold.
+//
+// Since every remaining row of the swept string can extend the result by at
+// most one character (plus at most k - 1 characters of a match started in an
+// earlier row), the sweep is aborted as soon as the threshold becomes
+// unreachable. If stop_when_reached is set, the sweep also stops as soon as
+// the threshold is met. lcsk_reconstruction is filled with the best solution
+// found before stopping, so it is optimal only if *rows_skipped == 0.
+// rows_skipped (may be nullptr) receives the number of rows of the swept
+// string (the longer of a and b, a on ties) which were never swept.
+bool LcsKSparseFastAtLeast(const std::string &a, const std::string &b, int k,
+                           int threshold, bool stop_when_reached,
+                           std::vector<std::pair<int, int>> *lcsk_reconstruction,
+                           int *rows_skipped);
+bool LcsKppSparseFastAtLeast(const std::string &a, const std::string &b, int k,
+                             int threshold, bool stop_when_reached,
+                             std::vector<std::pair<int, int>> *lcsk_reconstruction,
+                             int *rows_skipped);
+
+// Self-comparison of a, e.g. for finding repeats. Since LCSk(a, a) is
+// trivially given by the main diagonal, these functions find LCSk (LCSkpp)
+// over the matches strictly above it (i.e. the reconstruction only contains
+// pairs (i, j) with i < j). Matches below the diagonal mirror those above and
+// are never generated. A single index is built over one copy of a.
+void LcsKSparseFastSelf(const std::string &a, int k,
+                        std::vector<std::pair<int, int>> *lcsk_reconstruction);
+void LcsKppSparseFastSelf(const std::string &a, int k,
+                          std::vector<std::pair<int, int>> *lcsk_reconstruction);
+
+// Computes LCSk(a, b) (or LCSkpp(a, b) if lcsk_plus is set) for every k in ks
+// in a single pass over a, building only one index, for the smallest k. A match
+// of length k > min_k starting at (i, j) is derived from the run of
+// k - min_k + 1 consecutive matches of length min_k on the diagonal through
+// (i, j). lcsk_reconstructions[t] receives the result for ks[t].
+void LcsKSparseFastMultiK(
+    const std::string &a, const std::string &b, const std::vector<int> &ks,
+    bool lcsk_plus,
+    std::vector<std::vector<std::pair<int, int>>> *lcsk_reconstructions);
+
+// Approximate LCSkpp(a, b) for a b too long to index all of its k-mers, over
+// the matches recovered from the (w,k)-minimizers of a and b (see
+// MinimizerMatchMaker). The index of b takes about 2 / (w + 1) of the entries
+// of the exact one. The result is a valid LCSkpp reconstruction, at most as
+// long as the exact one, and missing only matches outside the common
+// substrings of length at least w + k - 1 (and not connected to one).
+void LcsKppSparseMinimizer(const std::string &a, const std::string &b, int k,
+                           int w,
+                           std::vector<std::pair<int, int>> *lcsk_reconstruction);
+
+// Parallel versions of LcsKSparseFast and LcsKppSparseFast for a single large
+// comparison. The columns of b are split into up to num_threads stripes, each
+// swept by its own thread. A stripe processes a row as soon as its left
+// neighbour is done with it, receiving the best match pair left of the stripe
+// and the match pairs crossing into it, so the rows pass through the stripes
+// in a wavefront. The length of the result is the same as with the
+// sequential versions.
+void LcsKSparseFastParallel(const std::string &a, const std::string &b, int k,
+                            int num_threads,
+                            std::vector<std::pair<int, int>> *lcsk_reconstruction);
+void LcsKppSparseFastParallel(const std::string &a, const std::string &b, int k,
+                              int num_threads,
+                              std::vector<std::pair<int, int>> *lcsk_reconstruction);
+
+// Strand of b aligned by the dual-strand functions below.
+enum Strand { FORWARD_STRAND, REVERSE_STRAND };
+
+// Reverse complement of a DNA string. Characters other than A, C, G and T are
+// kept as they are.
+std::string ReverseComplement(const std::string &s);
+
+// Dual-strand comparison of DNA strings: computes LCSk (LCSkpp) of a and b
+// and of ReverseComplement(a) and b, returning the strand with the longer
+// result (FORWARD_STRAND on ties) and its reconstruction, in the coordinates
+// of ReverseComplement(a) for REVERSE_STRAND.
+//
+// A single index of the canonical k-mers of b is built (see
+// DualStrandMatchMaker) and a is scanned once, feeding the sweeps of both
+// strands; if num_threads >= 2, the reverse strand is swept by a second
+// thread. Only k-mers over A, C, G and T are matched, and k must be at most
+// 32.
+Strand LcsKSparseFastDualStrand(
+    const std::string &a, const std::string &b, int k, int num_threads,
+    std::vector<std::pair<int, int>> *lcsk_reconstruction);
+Strand LcsKppSparseFastDualStrand(
+    const std::string &a, const std::string &b, int k, int num_threads,
+    std::vector<std::pair<int, int>> *lcsk_reconstruction);
+
+// Dense versions of LcsKSparseFast and LcsKppSparseFast, filling the whole
+// |a| x |b| table in O(|a| * |b|) time. For short, highly similar strings,
+// such as reads, almost every cell is a k-mer match, and the dense engine
+// avoids the hashing and match pair bookkeeping of the sparse one. Only
+// k + 1 rows of the table are kept, but the traceback takes half a byte per
+// cell, so |a| * |b| can be at most 2^32.
+void LcsKDense(const std::string &a, const std::string &b, int k,
+               std::vector<std::pair<int, int>> *lcsk_reconstruction);
+void LcsKppDense(const std::string &a, const std::string &b, int k,
+                 std::vector<std::pair<int, int>> *lcsk_reconstruction);
+
+// Computes only the lengths of LCSk (LCSkpp if lcsk_plus is set) of the pairs
+// (as[p], bs[p]). The pairs are swept in groups of 16 in lockstep, keeping the
+// 16-bit values of a cell of all of them next to each other, so that every
+// cell update is vectorized across the group. Strings can be at most 32767
+// characters long.
+void LcsKDenseBatch(const std::vector<std::string> &as,
+                    const std::vector<std::string> &bs, int k, bool lcsk_plus,
+                    std::vector<int> *lengths);
+
+// Costs weighed by LcsKFast and LcsKppFast, in nanoseconds. The defaults were
+// measured on random DNA with 5% of errors.
+struct DenseEngineCosts {
+  // The dense engine is never used above max_cells cells.
+  int64_t max_cells = 1 << 20;
+  // Per cell of the dense engine.
+  double dense_cell_ns = 4;
+  // Per character of a and b (indexed or swept) of the sparse engine.
+  double sparse_char_ns = 150;
+  // Per k-mer match of the sparse engine.
+  double sparse_match_ns = 110;
+};
+
+// Compute LCSk (LCSkpp) with the dense or the sparse engine, whichever is
+// expected to be faster given the lengths of a and b and their number of k-mer
+// matches (see EstimateMatches).
+void LcsKFast(const std::string &a, const std::string &b, int k,
+              std::vector<std::pair<int, int>> *lcsk_reconstruction);
+void LcsKppFast(const std::string &a, const std::string &b, int k,
+                std::vector<std::pair<int, int>> *lcsk_reconstruction);
+
+// Same as above, with the given costs, e.g. measured on the machine and the
+// kind of input at hand.
+void LcsKFast(const std::string &a, const std::string &b, int k,
+              const DenseEngineCosts &costs,
+              std::vector<std::pair<int, int>> *lcsk_reconstruction);
+void LcsKppFast(const std::string &a, const std::string &b, int k,
+                const DenseEngineCosts &costs,
+                std::vector<std::pair<int, int>> *lcsk_reconstruction);
+
+// Lower-level entry point used by the functions above. The k-mer matches of
+// every row of a (of length a_size) are produced by match_maker, so that one
+// index over b can be shared between many comparisons. Computes LCSkpp if
+// lcsk_plus is set and LCSk otherwise. A negative threshold disables early
+// termination, in which case the function always returns true.
+bool LcsKSparseFastWithMatchMaker(
+    MatchMaker *match_maker, int a_size, int b_size, int k, bool lcsk_plus,
+    int threshold, bool stop_when_reached,
+    std::vector<std::pair<int, int>> *lcsk_reconstruction, int *rows_skipped);
+
+// Same as above, sweeping in the given scratch (see BasicSweepScratch). A
+// thread running many comparisons one after another with the same scratch
+// stops allocating memory during the sweep once the scratch has grown to the
+// size of the largest comparison, apart from the output. scratch may be
+// nullptr.
+bool LcsKSparseFastWithMatchMaker(
+    MatchMaker *match_maker, int a_size, int b_size, int k, bool lcsk_plus,
+    int threshold, bool stop_when_reached,
+    std::vector<std::pair<int, int>> *lcsk_reconstruction, int *rows_skipped,
+    SweepScratch *scratch);
+
 #endif
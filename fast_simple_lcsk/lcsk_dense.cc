@@ -0,0 +1,343 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <cassert>
+#include <cstdint>
+
+#include "lcsk.h"
+#include "match_estimator.h"
+
+using namespace std;
+
+namespace {
+
+// Number of pairs swept in lockstep by the batched dense engine. The lanes of
+// a cell are contiguous, so that the loop over them is vectorized.
+const int kDenseLanes = 16;
+
+// LcsKDense and LcsKppDense take at most kDenseMaxCells cells, i.e. 2 GiB of
+// traceback.
+const int64_t kDenseMaxCells = 1LL << 32;
+
+// Traceback of a cell (i, j) of LcsKDenseImpl, in 4 bits: where dp[i][j]
+// comes from (preferring the cell above, then the one on the left), and
+// whether ext[i][j] extends ext[i-1][j-1] rather than starting k characters
+// before.
+const uint8_t kFromUp = 0;
+const uint8_t kFromLeft = 1;
+const uint8_t kFromMatch = 2;
+const uint8_t kDirection = 3;
+const uint8_t kExtended = 4;
+
+// Number of columns computed together by the single-pair dense engine, into
+// local arrays, so that the loops over them are vectorized.
+const int kDenseBlock = 16;
+
+// Dense DP over all cells (i, j), where dp[i][j] is LCSk (LCSkpp) of a[0,i)
+// and b[0,j) and ext[i][j] is the best one whose last match ends with
+// a[i-1] = b[j-1] (0 if there is none). For LCSkpp, a match of length l > k
+// ending in (i, j) is the match of length l - 1 ending in (i - 1, j - 1)
+// extended by one character, so
+//   ext[i][j] = max(dp[i-k][j-k] + k, ext[i-1][j-1] + 1 if run[i][j] > k)
+// where run[i][j] is the length of the common suffix of a[0,i) and b[0,j).
+//
+// Only the last k + 1 rows of dp and the last two of ext and run are kept,
+// and the reconstruction follows the 4-bit traceback of every cell. A row is
+// computed in three passes: ext and max(dp[i-1][j], ext[i][j]), the running
+// maximum from the left giving dp, and the traceback. The first and the last
+// one go over blocks of kDenseBlock columns and are vectorized; the rows are
+// padded to whole blocks, with cells past column m which are never read.
+template <bool lcsk_plus>
+void LcsKDenseImpl(const string& a, const string& b, const int k,
+                   vector<pair<int, int>>* lcsk_reconstruction) {
+  lcsk_reconstruction->clear();
+  const int n = a.size();
+  const int m = b.size();
+  assert((int64_t)n * m <= kDenseMaxCells);
+  const int padded_m = (m + kDenseBlock - 1) / kDenseBlock * kDenseBlock;
+  string padded_b = b;
+  padded_b.resize(padded_m);
+  // Rows are padded with k zero columns on the left, so that column j - k
+  // exists for every j; cell (i, j) is at dp[i % (k + 1) * width + k + j].
+  const int64_t width = padded_m + 1 + k;
+  vector<int> dp((k + 1) * width, 0);
+  vector<int> ext_prev(padded_m + 1, 0);
+  vector<int> ext_cur(padded_m + 1, 0);
+  vector<int> run_prev(padded_m + 1, 0);
+  vector<int> run_cur(padded_m + 1, 0);
+  // max(dp[i-1][j], ext[i][j]), before the running maximum from the left.
+  vector<int> best(padded_m + 1, 0);
+  vector<int> extended(padded_m + 1, 0);
+  // Cell (i, j) is the nibble j - 1 of row i - 1, the even ones in the low
+  // bits of a byte.
+  const int64_t trace_width = padded_m / 2;
+  vector<uint8_t> trace(n * trace_width, 0);
+
+  for (int i = 1; i <= n; ++i) {
+    const char ai = a[i - 1];
+    int* dp_cur = &dp[i % (k + 1) * width + k];
+    const int* dp_up = &dp[(i - 1) % (k + 1) * width + k];
+    // Row i - k, shifted by k columns. Only read when run >= k, i.e. when
+    // i >= k.
+    const int* dp_back = &dp[(i + 1) % (k + 1) * width];
+    for (int j0 = 1; j0 <= m; j0 += kDenseBlock) {
+      const char* bj = &padded_b[j0 - 1];
+      const int* run_diagonal = &run_prev[j0 - 1];
+      const int* ext_diagonal = &ext_prev[j0 - 1];
+      const int* up = &dp_up[j0];
+      const int* back = &dp_back[j0];
+      int run[kDenseBlock];
+      int ext[kDenseBlock];
+      int up_or_ext[kDenseBlock];
+      int extends[kDenseBlock];
+      // Branch-free, as the characters match unpredictably.
+      for (int l = 0; l < kDenseBlock; ++l) {
+        const int diagonal = run_diagonal[l] + 1;
+        run[l] = ai == bj[l] ? diagonal : 0;
+        const int from_back = back[l] + k;
+        const int e = run[l] >= k ? from_back : 0;
+        const int from_diagonal = ext_diagonal[l] + 1;
+        extends[l] = lcsk_plus & (run[l] > k) & (from_diagonal > e);
+        ext[l] = extends[l] ? from_diagonal : e;
+        up_or_ext[l] = up[l] > ext[l] ? up[l] : ext[l];
+      }
+      copy(run, run + kDenseBlock, &run_cur[j0]);
+      copy(ext, ext + kDenseBlock, &ext_cur[j0]);
+      copy(up_or_ext, up_or_ext + kDenseBlock, &best[j0]);
+      copy(extends, extends + kDenseBlock, &extended[j0]);
+    }
+
+    int left = 0;
+    for (int j = 1; j <= m; ++j) {
+      left = max(left, best[j]);
+      dp_cur[j] = left;
+    }
+
+    uint8_t* trace_row = &trace[(i - 1) * trace_width];
+    for (int j0 = 1; j0 <= m; j0 += kDenseBlock) {
+      const int* cur = &dp_cur[j0];
+      const int* up = &dp_up[j0];
+      const int* extends = &extended[j0];
+      int cell[kDenseBlock];
+      for (int l = 0; l < kDenseBlock; ++l) {
+        const int from_left = cur[l] == cur[l - 1] ? kFromLeft : kFromMatch;
+        const int direction = cur[l] == up[l] ? kFromUp : from_left;
+        cell[l] = direction | extends[l] * kExtended;
+      }
+      for (int l = 0; l < kDenseBlock; l += 2) {
+        trace_row[(j0 - 1 + l) / 2] = cell[l] | cell[l + 1] << 4;
+      }
+    }
+    run_prev.swap(run_cur);
+    ext_prev.swap(ext_cur);
+  }
+
+  auto at = [&trace, trace_width](int i, int j) {
+    return trace[(i - 1) * trace_width + (j - 1) / 2] >> ((j - 1) % 2 * 4);
+  };
+  // Walks back from (n, m), emitting the matches in reverse.
+  int i = n;
+  int j = m;
+  while (i > 0 && j > 0) {
+    const int direction = at(i, j) & kDirection;
+    if (direction == kFromUp) {
+      --i;
+    } else if (direction == kFromLeft) {
+      --j;
+    } else {
+      // Follows the extensions back to the first k characters of the match.
+      while (at(i, j) & kExtended) {
+        lcsk_reconstruction->push_back(make_pair(--i, --j));
+      }
+      for (int t = 0; t < k; ++t) {
+        lcsk_reconstruction->push_back(make_pair(--i, --j));
+      }
+    }
+  }
+  reverse(lcsk_reconstruction->begin(), lcsk_reconstruction->end());
+}
+
+// Runs the recurrence of LcsKDenseImpl for up to kDenseLanes pairs at once,
+// computing only the lengths. The strings are padded to the longest ones with
+// characters which never match, which does not change the results.
+template <bool lcsk_plus>
+void LcsKDenseLanes(const vector<string>& as, const vector<string>& bs,
+                    const size_t first, const size_t count, const int k,
+                    vector<int>* lengths) {
+  const int L = kDenseLanes;
+  int n = 0;
+  int m = 0;
+  for (size_t p = first; p < first + count; ++p) {
+    n = max(n, (int)as[p].size());
+    m = max(m, (int)bs[p].size());
+  }
+
+  vector<int16_t> a_lanes((int64_t)n * L, -1);
+  vector<int16_t> b_lanes((int64_t)m * L, -2);
+  for (size_t p = first; p < first + count; ++p) {
+    const int lane = p - first;
+    for (int i = 0; i < as[p].size(); ++i) {
+      a_lanes[(int64_t)i * L + lane] = (unsigned char)as[p][i];
+    }
+    for (int j = 0; j < bs[p].size(); ++j) {
+      b_lanes[(int64_t)j * L + lane] = (unsigned char)bs[p][j];
+    }
+  }
+
+  // Rows are padded with k zero columns on the left, so that column j - k
+  // exists for every j. dp keeps the last k + 1 rows.
+  const int64_t row_size = (int64_t)(m + 1 + k) * L;
+  vector<int16_t> dp((int64_t)(k + 1) * row_size, 0);
+  vector<int16_t> ext_prev(row_size, 0);
+  vector<int16_t> ext_cur(row_size, 0);
+  vector<int16_t> run_prev(row_size, 0);
+  vector<int16_t> run_cur(row_size, 0);
+  const int16_t kk = k;
+  // Runs are capped at k + 1, which is enough for the comparisons below.
+  const int16_t max_run = k + 1;
+
+  for (int i = 1; i <= n; ++i) {
+    const int16_t* ai = &a_lanes[(int64_t)(i - 1) * L];
+    int16_t* dp_cur = &dp[(int64_t)(i % (k + 1)) * row_size + k * L];
+    const int16_t* dp_up =
+        &dp[(int64_t)((i - 1) % (k + 1)) * row_size + k * L];
+    // Row i - k, shifted by k columns. Only read when run >= k, i.e. when
+    // i >= k.
+    const int16_t* dp_back = &dp[(int64_t)((i + 1) % (k + 1)) * row_size];
+    // The lanes of a cell are computed into local arrays, which the compiler
+    // knows not to alias the rows, and copied out afterwards.
+    int16_t left[L] = {0};
+    for (int j = 1; j <= m; ++j) {
+      const int16_t* bj = &b_lanes[(int64_t)(j - 1) * L];
+      const int64_t c = (int64_t)(k + j) * L;
+      const int16_t* run_diagonal = &run_prev[c - L];
+      const int16_t* ext_diagonal = &ext_prev[c - L];
+      const int16_t* up = &dp_up[(int64_t)j * L];
+      const int16_t* back = &dp_back[(int64_t)j * L];
+      int16_t run[L];
+      int16_t ext[L];
+      // Branch-free, so that it is vectorized.
+      for (int l = 0; l < L; ++l) {
+        const int16_t diagonal = run_diagonal[l] + 1;
+        const int16_t capped = diagonal < max_run ? diagonal : max_run;
+        run[l] = ai[l] == bj[l] ? capped : 0;
+        const int16_t from_back = back[l] + kk;
+        const int16_t extended = ext_diagonal[l] + 1;
+        int16_t e = run[l] >= kk ? from_back : 0;
+        e = lcsk_plus && run[l] > kk && extended > e ? extended : e;
+        ext[l] = e;
+        const int16_t best = up[l] > left[l] ? up[l] : left[l];
+        left[l] = best > e ? best : e;
+      }
+      copy(run, run + L, &run_cur[c]);
+      copy(ext, ext + L, &ext_cur[c]);
+      copy(left, left + L, &dp_cur[(int64_t)j * L]);
+    }
+    run_prev.swap(run_cur);
+    ext_prev.swap(ext_cur);
+  }
+
+  const int16_t* dp_last = &dp[(int64_t)(n % (k + 1)) * row_size + k * L];
+  for (size_t p = first; p < first + count; ++p) {
+    (*lengths)[p] = dp_last[(int64_t)m * L + (p - first)];
+  }
+}
+
+// Decides whether the dense engine is expected to be faster than the sparse
+// one. The matches only add to the cost of the sparse engine, so they are
+// counted with EstimateMatches only if the dense engine is slower than
+// indexing and sweeping the characters alone.
+bool UseDenseEngine(const string& a, const string& b, const int k,
+                    const DenseEngineCosts& costs) {
+  const int64_t cells = (int64_t)a.size() * b.size();
+  if (cells > min(costs.max_cells, kDenseMaxCells)) return false;
+
+  const double dense_ns = cells * costs.dense_cell_ns;
+  const double sparse_chars_ns = (a.size() + b.size()) * costs.sparse_char_ns;
+  if (dense_ns <= sparse_chars_ns) return true;
+
+  MatchEstimate estimate;
+  EstimateMatches(a, b, k, /*sampling_rate=*/1.0, &estimate);
+  return dense_ns <
+         sparse_chars_ns + estimate.num_match_pairs * costs.sparse_match_ns;
+}
+
+}  // namespace
+
+
+// exposed functions
+
+void LcsKDense(const std::string& a, const std::string& b, int k,
+               std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  LcsKDenseImpl</*lcsk_plus=*/false>(a, b, k, lcsk_reconstruction);
+}
+
+void LcsKppDense(const std::string& a, const std::string& b, int k,
+                 std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  LcsKDenseImpl</*lcsk_plus=*/true>(a, b, k, lcsk_reconstruction);
+}
+
+void LcsKDenseBatch(const std::vector<std::string>& as,
+                    const std::vector<std::string>& bs, int k, bool lcsk_plus,
+                    std::vector<int>* lengths) {
+  assert(as.size() == bs.size());
+  for (size_t p = 0; p < as.size(); ++p) {
+    assert(max(as[p].size(), bs[p].size()) <=
+           (size_t)numeric_limits<int16_t>::max());
+  }
+  lengths->assign(as.size(), 0);
+  for (size_t first = 0; first < as.size(); first += kDenseLanes) {
+    const size_t count = min<size_t>(kDenseLanes, as.size() - first);
+    if (lcsk_plus) {
+      LcsKDenseLanes<true>(as, bs, first, count, k, lengths);
+    } else {
+      LcsKDenseLanes<false>(as, bs, first, count, k, lengths);
+    }
+  }
+}
+
+void LcsKFast(const std::string& a, const std::string& b, int k,
+              std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  LcsKFast(a, b, k, DenseEngineCosts(), lcsk_reconstruction);
+}
+
+void LcsKFast(const std::string& a, const std::string& b, int k,
+              const DenseEngineCosts& costs,
+              std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  if (UseDenseEngine(a, b, k, costs)) {
+    LcsKDense(a, b, k, lcsk_reconstruction);
+  } else {
+    LcsKSparseFast(a, b, k, lcsk_reconstruction);
+  }
+}
+
+void LcsKppFast(const std::string& a, const std::string& b, int k,
+                std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  LcsKppFast(a, b, k, DenseEngineCosts(), lcsk_reconstruction);
+}
+
+void LcsKppFast(const std::string& a, const std::string& b, int k,
+                const DenseEngineCosts& costs,
+                std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  if (UseDenseEngine(a, b, k, costs)) {
+    LcsKppDense(a, b, k, lcsk_reconstruction);
+  } else {
+    LcsKppSparseFast(a, b, k, lcsk_reconstruction);
+  }
+}
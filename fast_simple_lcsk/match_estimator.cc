@@ -0,0 +1,186 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+
+#include "kmer_filter.h"
+#include "match_estimator.h"
+#include "match_maker.h"
+#include "match_pair.h"
+#include "match_pair_pool.h"
+#include "memory_policy.h"
+#include "rolling_hasher.h"
+
+using namespace std;
+
+namespace {
+
+// Size of a heap allocation of the given size, assuming glibc malloc: 8 bytes
+// of header, rounded up to 16 bytes, at least 32.
+int64_t AllocationBytes(int64_t size) {
+  return max<int64_t>(32, (size + 8 + 15) / 16 * 16);
+}
+
+// Memory of an entry of the index whose k-mer occurs count times: the hash
+// table node and bucket, and the Positions vector grown by push_back.
+template <typename Positions>
+int64_t IndexEntryBytes(int64_t count) {
+  int64_t capacity = 1;
+  while (capacity < count) capacity *= 2;
+  return AllocationBytes(sizeof(unsigned long long) + sizeof(Positions) +
+                         sizeof(void*)) +
+         sizeof(void*) +
+         AllocationBytes(capacity * sizeof(typename Positions::value_type));
+}
+
+// Memory of a MatchPairPool grown to hold num_match_pairs match pairs at once:
+// allocate_shared puts the match pair together with the control block (the
+// virtual table pointer, the two reference counts and the allocator) into a
+// block aligned like max_align_t, and the chunks of blocks double from 256.
+template <typename Pos>
+int64_t MatchPairPoolBytes(int64_t num_match_pairs) {
+  const int64_t alignment = alignof(max_align_t);
+  const int64_t block_bytes =
+      (sizeof(void*) + 2 * sizeof(int) + sizeof(MatchPairAllocator<Pos>) +
+       sizeof(BasicMatchPair<Pos>) + alignment - 1) /
+      alignment * alignment;
+  int64_t bytes = 0;
+  for (int64_t num_blocks = 0; num_blocks < num_match_pairs;) {
+    const int64_t chunk_blocks = max<int64_t>(256, num_blocks);
+    bytes += AllocationBytes(chunk_blocks * block_bytes);
+    num_blocks += chunk_blocks;
+  }
+  return bytes;
+}
+
+// Mixes the bits of a k-mer hash (the finalizer of splitmix64), so that
+// sampling a range of the hash space samples the k-mers uniformly.
+unsigned long long MixHash(unsigned long long hash) {
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+  return hash ^ (hash >> 31);
+}
+
+// Counts the sampled k-mers hashed by bhasher into b_counts, and the match
+// pairs of those hashed by ahasher into num_match_pairs.
+template <typename Hasher, typename Sampled>
+void CountKmers(Hasher* ahasher, Hasher* bhasher, const Sampled& sampled,
+                unordered_map<unsigned long long, int64_t>* b_counts,
+                int64_t* num_match_pairs) {
+  for (unsigned long long hash = 0; bhasher->Next(&hash);) {
+    if (sampled(hash)) ++(*b_counts)[hash];
+  }
+
+  *num_match_pairs = 0;
+  for (unsigned long long hash = 0; ahasher->Next(&hash);) {
+    if (!sampled(hash)) continue;
+    auto it = b_counts->find(hash);
+    if (it != b_counts->end()) *num_match_pairs += it->second;
+  }
+}
+
+// Estimates the cost of sweeping a against the index over b, with the match
+// maker FastestMatchMakerType picks.
+template <typename Pos>
+void EstimateMatchesWithPositions(const string& a, const string& b, int k,
+                                  double sampling_rate,
+                                  MatchEstimate* estimate) {
+  vector<char> char_to_id;
+  int alphabet_size;
+  PerfectHashMatchMaker::PrepareAlphabet(a, b, char_to_id, alphabet_size);
+
+  const bool exact = sampling_rate >= 1;
+  const unsigned long long max_sampled =
+      exact ? numeric_limits<unsigned long long>::max()
+            : (unsigned long long)(sampling_rate *
+                                   numeric_limits<unsigned long long>::max());
+  auto sampled = [exact, max_sampled](unsigned long long hash) {
+    return exact || MixHash(hash) <= max_sampled;
+  };
+
+  unordered_map<unsigned long long, int64_t> b_counts;
+  int64_t num_match_pairs = 0;
+  int64_t index_entries_bytes = 0;
+  // The KmerFilter bound of BasicPerfectHashMatchMaker::InitBMap, 0 for the
+  // Bloom filter.
+  unsigned long long hash_bound = 0;
+  const bool perfect_hash = RollingHasher::Fits(alphabet_size, k);
+  if (perfect_hash) {
+    RollingHasher ahasher(a, k, char_to_id, alphabet_size);
+    RollingHasher bhasher(b, k, char_to_id, alphabet_size);
+    CountKmers(&ahasher, &bhasher, sampled, &b_counts, &num_match_pairs);
+    for (const auto& kmer_count : b_counts) {
+      index_entries_bytes +=
+          IndexEntryBytes<vector<Pos, ArenaAllocator<Pos>>>(kmer_count.second);
+    }
+    hash_bound = 1;
+    for (int i = 0; i < k && hash_bound != 0 && alphabet_size > 0; ++i) {
+      hash_bound = hash_bound > ~0ULL / alphabet_size
+                       ? 0
+                       : hash_bound * alphabet_size;
+    }
+  } else {
+    // Distinct k-mers sharing a polynomial hash are counted together, which
+    // the random base makes unlikely enough not to bias the estimates.
+    const unsigned long long base = PolynomialRollingHasher::RandomBase();
+    PolynomialRollingHasher ahasher(a, k, base);
+    PolynomialRollingHasher bhasher(b, k, base);
+    CountKmers(&ahasher, &bhasher, sampled, &b_counts, &num_match_pairs);
+    for (const auto& kmer_count : b_counts) {
+      index_entries_bytes += IndexEntryBytes<vector<Pos>>(kmer_count.second);
+    }
+  }
+
+  const double scale = exact ? 1.0 : 1.0 / sampling_rate;
+  estimate->num_match_pairs = llround(num_match_pairs * scale);
+  estimate->num_distinct_kmers = llround(b_counts.size() * scale);
+  estimate->index_bytes =
+      llround(index_entries_bytes * scale) +
+      AllocationBytes(
+          KmerFilter::Bytes(hash_bound, estimate->num_distinct_kmers)) +
+      a.size() + b.size();
+  // One more for the dummy entry of the compressed table.
+  estimate->peak_bytes =
+      estimate->index_bytes +
+      MatchPairPoolBytes<Pos>(estimate->num_match_pairs + 1);
+}
+
+}  // namespace
+
+void EstimateMatches(const std::string& a, const std::string& b, int k,
+                     double sampling_rate, MatchEstimate* estimate) {
+  assert(sampling_rate > 0);
+  // The same orientation and choice of the position type as in
+  // LcsKSparseFastImpl: the shorter string is indexed.
+  const string& swept = a.size() >= b.size() ? a : b;
+  const string& indexed = a.size() >= b.size() ? b : a;
+  const size_t max_size = swept.size();
+  if (max_size <= numeric_limits<int16_t>::max()) {
+    EstimateMatchesWithPositions<int16_t>(swept, indexed, k, sampling_rate,
+                                          estimate);
+  } else if (max_size <= numeric_limits<int32_t>::max()) {
+    EstimateMatchesWithPositions<int32_t>(swept, indexed, k, sampling_rate,
+                                          estimate);
+  } else {
+    EstimateMatchesWithPositions<int64_t>(swept, indexed, k, sampling_rate,
+                                          estimate);
+  }
+}
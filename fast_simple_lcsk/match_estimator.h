@@ -0,0 +1,55 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MATCH_ESTIMATOR
+#define MATCH_ESTIMATOR
+
+#include <cstdint>
+#include <string>
+
+// Cost of running LcsKSparseFast/LcsKppSparseFast on (a, b, k), whose running
+// time and memory are driven by the number of k-mer match pairs.
+struct MatchEstimate {
+  // Number of pairs (i, j) such that a[i,i+k) == b[j,j+k), i.e. of match
+  // pairs created by the sweep.
+  int64_t num_match_pairs;
+  // Number of distinct k-mers of the indexed string, i.e. of keys of the
+  // index.
+  int64_t num_distinct_kmers;
+  // Predicted memory taken by the index (the hash table, the position lists
+  // and the KmerFilter) and by the copies of the inputs kept by the match
+  // maker.
+  int64_t index_bytes;
+  // Upper bound of the peak memory of the comparison: the index plus the pool
+  // of match pairs grown to hold every match pair alive at once. In practice,
+  // most match pairs are freed long before the sweep ends, and their blocks
+  // reused.
+  int64_t peak_bytes;
+};
+
+// Estimates the cost of comparing a and b with k-mers of length k the way
+// LcsKSparseFast does: the shorter string (b if they have the same length) is
+// indexed, with the narrowest position type able to represent the lengths and
+// with the match maker FastestMatchMakerType picks.
+//
+// If sampling_rate is 1, the k-mer spectrum of the indexed string is counted
+// exactly and the match pairs are counted in a single pass over the other one.
+// Otherwise, only the k-mers whose mixed hash falls into a sampling_rate
+// fraction of the hash space are counted and the counts are scaled by
+// 1 / sampling_rate, which gives unbiased estimates using a sampling_rate
+// fraction of the memory.
+void EstimateMatches(const std::string &a, const std::string &b, int k,
+                     double sampling_rate, MatchEstimate *estimate);
+
+#endif
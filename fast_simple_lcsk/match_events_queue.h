@@ -15,39 +15,95 @@
 #ifndef MATCH_EVENTS_QUEUE
 #define MATCH_EVENTS_QUEUE
 
-#include <queue>
+#include <cstddef>
 #include <tuple>
 #include <utility>
+#include <vector>
 #include "match_pair.h"
 
-struct MatchEventsQueue {
-  std::queue<std::tuple<int, int, std::shared_ptr<MatchPair>>> begin;
-  std::queue<std::tuple<int, int, std::shared_ptr<MatchPair>>> end;
+// FIFO queue over a circular buffer. Unlike std::queue, which allocates and
+// frees blocks of memory as elements pass through it, it keeps its capacity,
+// so it stops allocating once it has grown to its largest size.
+template <typename T>
+class RingQueue {
+ public:
+  RingQueue() : head_(0), size_(0) {}
 
-  void AddBegin(const std::tuple<int, int, std::shared_ptr<MatchPair>>& event) {
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+  T& front() { return items_[head_]; }
+
+  void push(const T& item) {
+    if (size_ == items_.size()) Grow();
+    items_[(head_ + size_) & (items_.size() - 1)] = item;
+    ++size_;
+  }
+
+  void pop() {
+    // Releases whatever the element holds.
+    items_[head_] = T();
+    head_ = (head_ + 1) & (items_.size() - 1);
+    --size_;
+  }
+
+  void clear() {
+    while (!empty()) pop();
+  }
+
+ private:
+  // Doubles the capacity, which is kept a power of two.
+  void Grow() {
+    std::vector<T> items(items_.empty() ? 16 : 2 * items_.size());
+    for (size_t i = 0; i < size_; ++i) {
+      items[i] = std::move(items_[(head_ + i) & (items_.size() - 1)]);
+    }
+    items_.swap(items);
+    head_ = 0;
+  }
+
+  std::vector<T> items_;
+  size_t head_;
+  size_t size_;
+};
+
+template <typename Pos>
+struct BasicMatchEventsQueue {
+  typedef std::tuple<Pos, Pos, std::shared_ptr<BasicMatchPair<Pos>>> Event;
+
+  RingQueue<Event> begin;
+  RingQueue<Event> end;
+
+  void AddBegin(const Event& event) {
     begin.push(event);
   }
-  void AddEnd(const std::tuple<int, int, std::shared_ptr<MatchPair>>& event) {
+  void AddEnd(const Event& event) {
     end.push(event);
   }
 
-  bool PopBegin(int row, std::tuple<int, int, std::shared_ptr<MatchPair>>* event) {
+  bool PopBegin(Pos row, Event* event) {
     if (!begin.empty() && std::get<0>(begin.front()) == row) {
-      *event = begin.front();
+      *event = std::move(begin.front());
       begin.pop();
       return true;
     }
     return false;
   }
 
-  bool PopEnd(int row, std::tuple<int, int, std::shared_ptr<MatchPair>>* event) {
+  bool PopEnd(Pos row, Event* event) {
     if (!end.empty() && std::get<0>(end.front()) == row) {
-      *event = end.front();
+      *event = std::move(end.front());
       end.pop();
       return true;
     }
     return false;
   }
+
+  void Clear() {
+    begin.clear();
+    end.clear();
+  }
 };
 
+typedef BasicMatchEventsQueue<int> MatchEventsQueue;
+
 #endif
@@ -12,29 +12,101 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <deque>
+#include <iterator>
+#include <limits>
+
+#include <cstdint>
+#include <cstring>
+
 #include "match_maker.h"
 
 using namespace std;
 
+namespace {
+
+// Base of the polynomial hashes ordering the k-mers for minimizer sampling.
+// It is fixed, so that a and b are sampled alike; the hashes of minimizers
+// found in both are compared with the k-mers themselves.
+const unsigned long long kMinimizerBase = 0x1545f4914f6cdd1dULL;
+
+// Fills *minimizers with the (hash, position) of the (w,k)-minimizers of s,
+// by increasing position. If s has fewer than w k-mers, its single window is
+// all of them.
+void FindMinimizers(
+    const string& s, int k, int w,
+    vector<pair<unsigned long long, int>>* minimizers) {
+  minimizers->clear();
+  const int num_kmers = s.size() >= (size_t)k ? s.size() - k + 1 : 0;
+  const int window = min(w, num_kmers);
+  PolynomialRollingHasher hasher(s, k, kMinimizerBase);
+  // The k-mers of the current window which have no smaller hash to their
+  // right, i.e. the candidates for being the minimizer of this or a later
+  // window, by increasing position and non-decreasing hash.
+  deque<pair<unsigned long long, int>> candidates;
+  unsigned long long hash = 0;
+  for (int i = 0; hasher.Next(&hash); ++i) {
+    while (!candidates.empty() && candidates.back().first > hash) {
+      candidates.pop_back();
+    }
+    candidates.emplace_back(hash, i);
+    if (candidates.front().second <= i - window) candidates.pop_front();
+    if (i >= window - 1 && (minimizers->empty() ||
+                            minimizers->back().second !=
+                                candidates.front().second)) {
+      minimizers->push_back(candidates.front());
+    }
+  }
+}
+
+}  // namespace
+
+// static
+template <typename Pos>
+std::unique_ptr<BasicMatchMaker<Pos>> BasicMatchMaker<Pos>::Create(
+    const string& a, const string& b, int k, MatchMakerType type) {
+  return Create(a, b, k, type, MemoryPolicy());
+}
+
 // static
-std::unique_ptr<MatchMaker> MatchMaker::Create(const string& a, const string& b,
-                                               int k, MatchMakerType type) {
-  std::unique_ptr<MatchMaker> match_maker;
+template <typename Pos>
+std::unique_ptr<BasicMatchMaker<Pos>> BasicMatchMaker<Pos>::Create(
+    const string& a, const string& b, int k, MatchMakerType type,
+    const MemoryPolicy& policy) {
+  return Create(a.data(), a.size(), b.data(), b.size(), k, type, policy);
+}
+
+// static
+template <typename Pos>
+std::unique_ptr<BasicMatchMaker<Pos>> BasicMatchMaker<Pos>::Create(
+    const char* a, size_t a_size, const char* b, size_t b_size, int k,
+    MatchMakerType type, const MemoryPolicy& policy) {
+  std::unique_ptr<BasicMatchMaker<Pos>> match_maker;
   switch (type) {
     case MatchMakerType::NAIVE:
-      match_maker.reset(new NaiveMatchMaker(a, b, k));
+      match_maker.reset(
+          new BasicNaiveMatchMaker<Pos>(a, a_size, b, b_size, k));
+      break;
     case MatchMakerType::PERFECT_HASH:
-      match_maker.reset(new PerfectHashMatchMaker(a, b, k));
+      match_maker.reset(new BasicPerfectHashMatchMaker<Pos>(
+          a, a_size, b, b_size, k, policy));
+      break;
+    case MatchMakerType::RANDOMIZED_HASH:
+      match_maker.reset(
+          new BasicRandomizedHashMatchMaker<Pos>(a, a_size, b, b_size, k));
+      break;
   }
   return match_maker;
 }
 
-bool NaiveMatchMaker::GetNextMatches(std::vector<int>* matches) {
+template <typename Pos>
+bool BasicNaiveMatchMaker<Pos>::GetNextMatches(std::vector<Pos>* matches) {
   matches->clear();
   // Are there more matches to generate?
   if (row_ + k_ > a_.size()) return false;
 
-  for (int b_index = 0; b_index <= (int)b_.size() - k_; ++b_index) {
+  for (Pos b_index = 0; b_index <= (Pos)b_.size() - k_; ++b_index) {
     if (a_.substr(row_, k_) == b_.substr(b_index, k_)) {
       matches->push_back(b_index);
     }
@@ -44,19 +116,26 @@ bool NaiveMatchMaker::GetNextMatches(std::vector<int>* matches) {
   return true;
 }
 
-bool PerfectHashMatchMaker::GetNextMatches(std::vector<int>* matches) {
+template <typename Pos>
+bool BasicPerfectHashMatchMaker<Pos>::GetNextMatches(
+    std::vector<Pos>* matches) {
   matches->clear();
   unsigned long long hash = 0;
 
+  // Hashed outside the asserts, which NDEBUG compiles out.
+  const bool has_hash = ahasher_->Next(&hash);
   // Are there more matches to generate?
   if (row_ + k_ > a_.size()) {
-    assert(!ahasher_->Next(&hash));
+    assert(!has_hash);
     return false;
   }
-
-  assert(ahasher_->Next(&hash));
-  for (int x : bmap_[hash]) {
-    matches->push_back(x);
+  assert(has_hash);
+  (void)has_hash;
+  if (bfilter_->MayContain(hash)) {
+    auto it = bmap_.find(hash);
+    if (it != bmap_.end()) {
+      matches->assign(it->second.begin(), it->second.end());
+    }
   }
 
   ++row_;  // Not forgetting to update this!
@@ -64,31 +143,436 @@ bool PerfectHashMatchMaker::GetNextMatches(std::vector<int>* matches) {
 }
 
 // static
-void PerfectHashMatchMaker::PrepareAlphabet(const std::string& a,
-                                            const std::string& b,
-                                            std::vector<char>& aid,
-                                            int& alphabet_size) {
+template <typename Pos>
+void BasicPerfectHashMatchMaker<Pos>::PrepareAlphabet(const std::string& a,
+                                                      const std::string& b,
+                                                      std::vector<char>& aid,
+                                                      int& alphabet_size) {
+  PrepareAlphabet(a.data(), a.size(), b.data(), b.size(), aid, alphabet_size);
+}
+
+// static
+template <typename Pos>
+void BasicPerfectHashMatchMaker<Pos>::PrepareAlphabet(const char* a,
+                                                      size_t a_size,
+                                                      const char* b,
+                                                      size_t b_size,
+                                                      std::vector<char>& aid,
+                                                      int& alphabet_size) {
   aid = std::vector<char>(256, -1);
   alphabet_size = 0;
-  for (size_t i = 0; i < a.size(); ++i) {
-    if (aid[a[i]] == -1) {
-      aid[a[i]] = alphabet_size++;
+  for (size_t i = 0; i < a_size; ++i) {
+    if (aid[(unsigned char)a[i]] == -1) {
+      aid[(unsigned char)a[i]] = alphabet_size++;
     }
   }
-  for (size_t i = 0; i < b.size(); ++i) {
-    if (aid[b[i]] == -1) {
-      aid[b[i]] = alphabet_size++;
+  for (size_t i = 0; i < b_size; ++i) {
+    if (aid[(unsigned char)b[i]] == -1) {
+      aid[(unsigned char)b[i]] = alphabet_size++;
     }
   }
 }
 
-void PerfectHashMatchMaker::InitBMap(const std::string& b) {
+template <typename Pos>
+void BasicPerfectHashMatchMaker<Pos>::InitBMap() {
   bmap_.clear();
   RollingHasher bhasher_(b_, k_, char_to_id_, alphabet_size_);
   unsigned long long hash = 0;
-  for (int i = 0; i + k_ <= b.size(); ++i) {
-    assert(bhasher_.Next(&hash));
+  for (Pos i = 0; i + k_ <= b_.size(); ++i) {
+    const bool has_hash = bhasher_.Next(&hash);
+    assert(has_hash);
+    (void)has_hash;
     bmap_[hash].push_back(i);
   }
   assert(!bhasher_.Next(&hash));
+
+  // The hashes are below alphabet_size^k, unless that overflows.
+  unsigned long long hash_bound = 1;
+  for (int i = 0; i < k_ && hash_bound != 0 && alphabet_size_ > 0; ++i) {
+    hash_bound = hash_bound > ~0ULL / alphabet_size_
+                     ? 0
+                     : hash_bound * alphabet_size_;
+  }
+  bfilter_.reset(new KmerFilter(hash_bound, bmap_.size()));
+  for (const auto& kmer : bmap_) {
+    bfilter_->Insert(kmer.first);
+  }
+}
+
+template <typename Pos>
+BasicRandomizedHashMatchMaker<Pos>::BasicRandomizedHashMatchMaker(
+    const char* a, size_t a_size, const char* b, size_t b_size, int k)
+    : a_(a, a_size), b_(b, b_size), k_(k), row_(0) {
+  const unsigned long long base = PolynomialRollingHasher::RandomBase();
+  ahasher_.reset(new PolynomialRollingHasher(a_, k_, base));
+
+  PolynomialRollingHasher bhasher(b_, k_, base);
+  unsigned long long hash = 0;
+  for (Pos j = 0; bhasher.Next(&hash); ++j) {
+    vector<Pos>& positions = bmap_[hash];
+    if (positions.empty() || SameKmer(b_, positions.front(), b_, j)) {
+      positions.push_back(j);
+      continue;
+    }
+    // A collision: finds or starts the group of b[j,j+k).
+    vector<vector<Pos>>& groups = collisions_[hash];
+    auto group = find_if(groups.begin(), groups.end(),
+                         [this, j](const vector<Pos>& g) {
+                           return SameKmer(b_, g.front(), b_, j);
+                         });
+    if (group == groups.end()) {
+      groups.emplace_back();
+      group = groups.end() - 1;
+    }
+    group->push_back(j);
+  }
+
+  bfilter_.reset(new KmerFilter(0, bmap_.size()));
+  for (const auto& kmer : bmap_) {
+    bfilter_->Insert(kmer.first);
+  }
+}
+
+template <typename Pos>
+bool BasicRandomizedHashMatchMaker<Pos>::GetNextMatches(
+    std::vector<Pos>* matches) {
+  matches->clear();
+  unsigned long long hash = 0;
+  // Are there more matches to generate?
+  if (!ahasher_->Next(&hash)) return false;
+
+  if (bfilter_->MayContain(hash)) {
+    auto it = bmap_.find(hash);
+    if (it != bmap_.end()) {
+      if (SameKmer(a_, row_, b_, it->second.front())) {
+        matches->assign(it->second.begin(), it->second.end());
+      } else if (!collisions_.empty()) {
+        auto groups = collisions_.find(hash);
+        if (groups != collisions_.end()) {
+          for (const vector<Pos>& group : groups->second) {
+            if (SameKmer(a_, row_, b_, group.front())) {
+              matches->assign(group.begin(), group.end());
+              break;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  ++row_;  // Not forgetting to update this!
+  return true;
+}
+
+template <typename Pos>
+bool BasicRandomizedHashMatchMaker<Pos>::SameKmer(const std::string& s,
+                                                  size_t i,
+                                                  const std::string& t,
+                                                  size_t j) const {
+  return memcmp(s.data() + i, t.data() + j, k_) == 0;
+}
+
+MatchMakerType FastestMatchMakerType(const std::string& a,
+                                     const std::string& b, int k) {
+  return FastestMatchMakerType(a.data(), a.size(), b.data(), b.size(), k);
+}
+
+MatchMakerType FastestMatchMakerType(const char* a, size_t a_size,
+                                     const char* b, size_t b_size, int k) {
+  vector<char> char_to_id;
+  int alphabet_size;
+  PerfectHashMatchMaker::PrepareAlphabet(a, a_size, b, b_size, char_to_id,
+                                         alphabet_size);
+  return RollingHasher::Fits(alphabet_size, k) ? PERFECT_HASH
+                                                : RANDOMIZED_HASH;
+}
+
+template class BasicMatchMaker<int16_t>;
+template class BasicMatchMaker<int32_t>;
+template class BasicMatchMaker<int64_t>;
+template class BasicNaiveMatchMaker<int16_t>;
+template class BasicNaiveMatchMaker<int32_t>;
+template class BasicNaiveMatchMaker<int64_t>;
+template class BasicPerfectHashMatchMaker<int16_t>;
+template class BasicPerfectHashMatchMaker<int32_t>;
+template class BasicPerfectHashMatchMaker<int64_t>;
+template class BasicRandomizedHashMatchMaker<int16_t>;
+template class BasicRandomizedHashMatchMaker<int32_t>;
+template class BasicRandomizedHashMatchMaker<int64_t>;
+
+SelfMatchMaker::SelfMatchMaker(const std::string& a, int k) : row_(0) {
+  vector<char> char_to_id;
+  int alphabet_size;
+  PerfectHashMatchMaker::PrepareAlphabet(a, a, char_to_id, alphabet_size);
+
+  unsigned long long hash = 0;
+  if (RollingHasher::Fits(alphabet_size, k)) {
+    RollingHasher hasher(a, k, char_to_id, alphabet_size);
+    // Last occurrence of each k-mer seen so far.
+    unordered_map<unsigned long long, int> last_occurrence;
+    for (int i = 0; hasher.Next(&hash); ++i) {
+      next_occurrence_.push_back(-1);
+      auto it = last_occurrence.find(hash);
+      if (it != last_occurrence.end()) {
+        next_occurrence_[it->second] = i;
+        it->second = i;
+      } else {
+        last_occurrence[hash] = i;
+      }
+    }
+    return;
+  }
+
+  // The polynomial hash is not injective: the (first, last) occurrences of
+  // each distinct k-mer seen so far are kept by hash, and the k-mers sharing
+  // a hash are told apart by comparing them, so that they form separate
+  // chains.
+  PolynomialRollingHasher hasher(a, k, PolynomialRollingHasher::RandomBase());
+  unordered_map<unsigned long long, vector<pair<int, int>>> occurrences;
+  for (int i = 0; hasher.Next(&hash); ++i) {
+    next_occurrence_.push_back(-1);
+    vector<pair<int, int>>& kmers = occurrences[hash];
+    auto kmer = find_if(kmers.begin(), kmers.end(),
+                        [&a, k, i](const pair<int, int>& occurrence) {
+                          return memcmp(a.data() + occurrence.first,
+                                        a.data() + i, k) == 0;
+                        });
+    if (kmer != kmers.end()) {
+      next_occurrence_[kmer->second] = i;
+      kmer->second = i;
+    } else {
+      kmers.emplace_back(i, i);
+    }
+  }
+}
+
+bool SelfMatchMaker::GetNextMatches(std::vector<int>* matches) {
+  matches->clear();
+  // Are there more matches to generate?
+  if (row_ >= next_occurrence_.size()) return false;
+
+  for (int j = next_occurrence_[row_]; j != -1; j = next_occurrence_[j]) {
+    matches->push_back(j);
+  }
+
+  ++row_;  // Not forgetting to update this!
+  return true;
+}
+
+ReferenceIndex::ReferenceIndex(const std::string& b, int k)
+    : k_(k),
+      b_size_(b.size()),
+      char_to_id_(256, -1),
+      alphabet_size_(0),
+      base_(0) {
+  for (unsigned char c : b) {
+    if (char_to_id_[c] == -1) {
+      char_to_id_[c] = alphabet_size_++;
+    }
+  }
+  for (int c = 0; c < 256; ++c) {
+    if (char_to_id_[c] == -1) {
+      char_to_id_[c] = alphabet_size_;
+    }
+  }
+  ++alphabet_size_;
+
+  unsigned long long hash = 0;
+  if (RollingHasher::Fits(alphabet_size_, k_)) {
+    RollingHasher bhasher(b, k_, char_to_id_, alphabet_size_);
+    for (int j = 0; bhasher.Next(&hash); ++j) {
+      bmap_[hash].push_back(j);
+    }
+    return;
+  }
+
+  base_ = PolynomialRollingHasher::RandomBase();
+  b_ = b;
+  PolynomialRollingHasher bhasher(b_, k_, base_);
+  for (int j = 0; bhasher.Next(&hash); ++j) {
+    vector<int>& positions = bmap_[hash];
+    if (positions.empty() ||
+        memcmp(b_.data() + positions.front(), b_.data() + j, k_) == 0) {
+      positions.push_back(j);
+      continue;
+    }
+    // A collision: finds or starts the group of b[j,j+k).
+    vector<vector<int>>& groups = collisions_[hash];
+    auto group = find_if(groups.begin(), groups.end(),
+                         [this, j](const vector<int>& g) {
+                           return memcmp(b_.data() + g.front(),
+                                         b_.data() + j, k_) == 0;
+                         });
+    if (group == groups.end()) {
+      groups.emplace_back();
+      group = groups.end() - 1;
+    }
+    group->push_back(j);
+  }
+}
+
+const std::vector<int>* ReferenceIndex::Find(const std::string& a, int row,
+                                             unsigned long long hash) const {
+  auto it = bmap_.find(hash);
+  if (it == bmap_.end()) return nullptr;
+  // RollingHasher is injective.
+  if (base_ == 0) return &it->second;
+
+  auto same_kmer = [this, &a, row](const vector<int>& positions) {
+    return memcmp(a.data() + row, b_.data() + positions.front(), k_) == 0;
+  };
+  if (same_kmer(it->second)) return &it->second;
+  auto groups = collisions_.find(hash);
+  if (groups == collisions_.end()) return nullptr;
+  for (const vector<int>& group : groups->second) {
+    if (same_kmer(group)) return &group;
+  }
+  return nullptr;
+}
+
+ReferenceMatchMaker::ReferenceMatchMaker(const ReferenceIndex& index,
+                                         const std::string& a)
+    : index_(index), a_(a), row_(0) {
+  if (index.base_ == 0) {
+    ahasher_.reset(new RollingHasher(a, index.k_, index.char_to_id_,
+                                     index.alphabet_size_));
+  } else {
+    polynomial_ahasher_.reset(
+        new PolynomialRollingHasher(a, index.k_, index.base_));
+  }
+}
+
+bool ReferenceMatchMaker::GetNextMatches(std::vector<int>* matches) {
+  matches->clear();
+  unsigned long long hash = 0;
+  // Are there more matches to generate?
+  if (ahasher_ != nullptr ? !ahasher_->Next(&hash)
+                          : !polynomial_ahasher_->Next(&hash)) {
+    return false;
+  }
+
+  const vector<int>* positions = index_.Find(a_, row_, hash);
+  if (positions != nullptr) {
+    matches->assign(positions->begin(), positions->end());
+  }
+  ++row_;  // Not forgetting to update this!
+  return true;
+}
+
+DualStrandMatchMaker::DualStrandMatchMaker(const std::string& a,
+                                           const std::string& b, int k)
+    : k_(k), b_size_(b.size()), ahasher_(a, k) {
+  CanonicalKmerHasher bhasher(b, k);
+  unsigned long long forward = 0;
+  unsigned long long reverse = 0;
+  bool valid = false;
+  for (int j = 0; bhasher.Next(&forward, &reverse, &valid); ++j) {
+    if (!valid) continue;
+    bmap_[min(forward, reverse)].push_back(2 * j + (reverse < forward));
+  }
+}
+
+bool DualStrandMatchMaker::GetNextMatches(std::vector<int>* forward,
+                                          std::vector<int>* reverse) {
+  forward->clear();
+  reverse->clear();
+  unsigned long long forward_hash = 0;
+  unsigned long long reverse_hash = 0;
+  bool valid = false;
+  // Are there more matches to generate?
+  if (!ahasher_.Next(&forward_hash, &reverse_hash, &valid)) return false;
+  if (!valid) return true;
+
+  auto it = bmap_.find(min(forward_hash, reverse_hash));
+  if (it == bmap_.end()) return true;
+
+  // A palindromic k-mer equals its reverse complement, so its occurrences
+  // match on both strands.
+  const bool palindrome = forward_hash == reverse_hash;
+  const int a_orientation = reverse_hash < forward_hash;
+  const vector<int>& occurrences = it->second;
+  for (int x : occurrences) {
+    if (palindrome || (x & 1) == a_orientation) {
+      forward->push_back(x >> 1);
+    }
+  }
+  // b[j,j+k) matches rc(b) at b_size - k - j, which decreases with j.
+  for (auto x = occurrences.rbegin(); x != occurrences.rend(); ++x) {
+    if (palindrome || (*x & 1) != a_orientation) {
+      reverse->push_back(b_size_ - k_ - (*x >> 1));
+    }
+  }
+  return true;
+}
+
+MinimizerMatchMaker::MinimizerMatchMaker(const std::string& a,
+                                         const std::string& b, int k, int w)
+    : a_(a), b_(b), k_(k), w_(max(w, 1)), row_(0), next_aminimizer_(0),
+      run_starts_(w_) {
+  FindMinimizers(b_, k_, w_, &bindex_);
+  sort(bindex_.begin(), bindex_.end());
+  bindex_.shrink_to_fit();
+  FindMinimizers(a_, k_, w_, &aminimizers_);
+}
+
+bool MinimizerMatchMaker::GetNextMatches(std::vector<int>* matches) {
+  matches->clear();
+  // Are there more matches to generate?
+  if ((size_t)row_ + k_ > a_.size()) return false;
+
+  // A run starting at this row can only come from a minimizer up to w - 1
+  // rows ahead.
+  for (; next_aminimizer_ < aminimizers_.size() &&
+         aminimizers_[next_aminimizer_].second < row_ + w_;
+       ++next_aminimizer_) {
+    AddRuns(aminimizers_[next_aminimizer_].first,
+            aminimizers_[next_aminimizer_].second);
+  }
+
+  // The runs through the previous row continue if the last characters of the
+  // k-mers in this row match too.
+  const int last = row_ + k_ - 1;
+  size_t num_continued = 0;
+  for (int d : diagonals_) {
+    if (last + d < (int)b_.size() && a_[last] == b_[last + d]) {
+      diagonals_[num_continued++] = d;
+    }
+  }
+  diagonals_.resize(num_continued);
+
+  vector<int>& starts = run_starts_[row_ % w_];
+  if (!starts.empty()) {
+    // Runs started by several hits on the same diagonal are merged.
+    sort(starts.begin(), starts.end());
+    starts.erase(unique(starts.begin(), starts.end()), starts.end());
+    merged_diagonals_.clear();
+    set_union(diagonals_.begin(), diagonals_.end(), starts.begin(),
+              starts.end(), back_inserter(merged_diagonals_));
+    diagonals_.swap(merged_diagonals_);
+    starts.clear();
+  }
+
+  for (int d : diagonals_) {
+    matches->push_back(row_ + d);
+  }
+
+  ++row_;  // Not forgetting to update this!
+  return true;
+}
+
+void MinimizerMatchMaker::AddRuns(unsigned long long hash, int row) {
+  for (auto it = lower_bound(bindex_.begin(), bindex_.end(),
+                             make_pair(hash, numeric_limits<int>::min()));
+       it != bindex_.end() && it->first == hash; ++it) {
+    const int col = it->second;
+    if (memcmp(a_.data() + row, b_.data() + col, k_) != 0) continue;
+    // Walks back along the diagonal, at most to the current row.
+    const int d = col - row;
+    int start = row;
+    while (start > row_ && start - 1 + d >= 0 &&
+           a_[start - 1] == b_[start - 1 + d]) {
+      --start;
+    }
+    run_starts_[start % w_].push_back(d);
+  }
 }
@@ -16,86 +16,350 @@
 #define MATCH_MAKER
 
 #include <cassert>
+#include <functional>
 #include <memory>
+#include <scoped_allocator>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
+#include "kmer_filter.h"
+#include "memory_policy.h"
 #include "rolling_hasher.h"
 
-enum MatchMakerType { NAIVE, PERFECT_HASH, };
+enum MatchMakerType { NAIVE, PERFECT_HASH, RANDOMIZED_HASH, };
 
 // This interface provides a single GetNextMatches method.
 // On i-th call of the of the method, it returns a vector filled
 // with indices j such that a[i,i+k) == b[j,j+k).
-class MatchMaker {
+//
+// Pos is the integer type of the indices; see BasicMatchPair.
+template <typename Pos>
+class BasicMatchMaker {
  public:
-  MatchMaker() {}
-  virtual ~MatchMaker() {}
+  BasicMatchMaker() {}
+  virtual ~BasicMatchMaker() {}
 
-  virtual bool GetNextMatches(std::vector<int>* matches) = 0;
+  virtual bool GetNextMatches(std::vector<Pos>* matches) = 0;
 
-  static std::unique_ptr<MatchMaker> Create(const std::string& a,
-                                            const std::string& b, int k,
-                                            MatchMakerType type);
+  static std::unique_ptr<BasicMatchMaker> Create(const std::string& a,
+                                                 const std::string& b, int k,
+                                                 MatchMakerType type);
+  // Same as above, allocating the index of a PERFECT_HASH match maker
+  // according to policy. The other types ignore it.
+  static std::unique_ptr<BasicMatchMaker> Create(const std::string& a,
+                                                 const std::string& b, int k,
+                                                 MatchMakerType type,
+                                                 const MemoryPolicy& policy);
+  // Same as above, for strings given as a pointer and a length.
+  static std::unique_ptr<BasicMatchMaker> Create(const char* a, size_t a_size,
+                                                 const char* b, size_t b_size,
+                                                 int k, MatchMakerType type,
+                                                 const MemoryPolicy& policy);
 };
 
 // An implementation of the MatchMaker using brute force string
 // matching for constructing the output vectors.
-class NaiveMatchMaker : public MatchMaker {
+template <typename Pos>
+class BasicNaiveMatchMaker : public BasicMatchMaker<Pos> {
  public:
-  NaiveMatchMaker(const std::string& a, const std::string& b, int k)
+  BasicNaiveMatchMaker(const std::string& a, const std::string& b, int k)
       : a_(a), b_(b), k_(k), row_(0) {}
+  BasicNaiveMatchMaker(const char* a, size_t a_size, const char* b,
+                       size_t b_size, int k)
+      : a_(a, a_size), b_(b, b_size), k_(k), row_(0) {}
 
-  bool GetNextMatches(std::vector<int>* matches) override;
+  bool GetNextMatches(std::vector<Pos>* matches) override;
 
  private:
   std::string a_;
   std::string b_;
   int k_;
-  int row_;
+  Pos row_;
 };
 
 // An implementation of the MatchMaker which assumes that alphabet_size^k fits
 // into a 64-bit integer. A RollingHasher is used to efficiently find the
 // matching points between strings a and b in complexity proportional to sum of
-// the lengths of these strings.
-class PerfectHashMatchMaker : public MatchMaker {
+// the lengths of these strings. The k-mers of a are looked up in a KmerFilter
+// of those of b before the index, which is never modified after construction.
+template <typename Pos>
+class BasicPerfectHashMatchMaker : public BasicMatchMaker<Pos> {
  public:
-  PerfectHashMatchMaker(const std::string& a, const std::string& b, int k) {
+  BasicPerfectHashMatchMaker(const std::string& a, const std::string& b, int k)
+      : BasicPerfectHashMatchMaker(a, b, k, MemoryPolicy()) {}
+  // Same as above, allocating the index (the hash table and the position
+  // lists) from a MemoryArena with the given policy.
+  BasicPerfectHashMatchMaker(const std::string& a, const std::string& b, int k,
+                             const MemoryPolicy& policy)
+      : BasicPerfectHashMatchMaker(a.data(), a.size(), b.data(), b.size(), k,
+                                   policy) {}
+  // Same as above, for strings given as a pointer and a length.
+  BasicPerfectHashMatchMaker(const char* a, size_t a_size, const char* b,
+                             size_t b_size, int k, const MemoryPolicy& policy)
+      : arena_(policy.IsDefault() ? nullptr : new MemoryArena(policy)),
+        bmap_(0, std::hash<unsigned long long>(),
+              std::equal_to<unsigned long long>(),
+              BMapAllocator(ArenaAllocator<char>(arena_.get()))) {
     // TODO(fpavetic): Move the work to the Create method.
-    a_ = a;
-    b_ = b;
+    a_.assign(a, a_size);
+    b_.assign(b, b_size);
     k_ = k;
     row_ = 0;
-    PrepareAlphabet(a, b, char_to_id_, alphabet_size_);
+    PrepareAlphabet(a, a_size, b, b_size, char_to_id_, alphabet_size_);
     ahasher_.reset(new RollingHasher(a_, k_, char_to_id_, alphabet_size_));
-    InitBMap(b);
+    InitBMap();
   }
 
-  bool GetNextMatches(std::vector<int>* matches) override;
+  bool GetNextMatches(std::vector<Pos>* matches) override;
 
- private:
   // This function determines the total number of
   // distinct characters in input strings a and b.
   // Outputs are: aid[character] = unique_character_id
   // alphabet_size = total number of distinct chars
   static void PrepareAlphabet(const std::string& a, const std::string& b,
                               std::vector<char>& aid, int& alphabet_size);
+  static void PrepareAlphabet(const char* a, size_t a_size, const char* b,
+                              size_t b_size, std::vector<char>& aid,
+                              int& alphabet_size);
 
+ private:
   // This method creates a mapping from hashes of length k
-  // substrings of b to indices of those substrings. This
+  // substrings of b_ to indices of those substrings. This
   // information gets stored in bmap_ member.
-  void InitBMap(const std::string& b);
+  void InitBMap();
+
+  std::string a_;
+  std::string b_;
+  int k_;
+  Pos row_;
+
+  std::vector<char> char_to_id_;
+  int alphabet_size_;
+  std::unique_ptr<RollingHasher> ahasher_;
+
+  // The scoped allocator hands the arena down to the position lists.
+  typedef std::vector<Pos, ArenaAllocator<Pos>> Positions;
+  typedef std::scoped_allocator_adaptor<
+      ArenaAllocator<std::pair<const unsigned long long, Positions>>>
+      BMapAllocator;
+  // Declared before bmap_, so that it outlives it.
+  std::unique_ptr<MemoryArena> arena_;
+  std::unordered_map<unsigned long long, Positions,
+                     std::hash<unsigned long long>,
+                     std::equal_to<unsigned long long>, BMapAllocator>
+      bmap_;
+  std::unique_ptr<KmerFilter> bfilter_;
+};
+
+// An implementation of the MatchMaker for any k, e.g. for long reads whose
+// k-mers are too long for a perfect hash. The k-mers are hashed by a
+// PolynomialRollingHasher with a random base, and every hash match is
+// verified against the substrings, so the output is exact: when indexing b,
+// each occurrence of a hash is compared with the first occurrence (distinct
+// k-mers sharing a hash are kept apart), and each row of a whose hash occurs
+// in b is compared with one occurrence. Both take O(k) per comparison, on top
+// of the linear-time hashing.
+template <typename Pos>
+class BasicRandomizedHashMatchMaker : public BasicMatchMaker<Pos> {
+ public:
+  BasicRandomizedHashMatchMaker(const std::string& a, const std::string& b,
+                                int k)
+      : BasicRandomizedHashMatchMaker(a.data(), a.size(), b.data(), b.size(),
+                                      k) {}
+  // Same as above, for strings given as a pointer and a length.
+  BasicRandomizedHashMatchMaker(const char* a, size_t a_size, const char* b,
+                                size_t b_size, int k);
+
+  bool GetNextMatches(std::vector<Pos>* matches) override;
+
+ private:
+  bool SameKmer(const std::string& s, size_t i, const std::string& t,
+                size_t j) const;
 
   std::string a_;
   std::string b_;
   int k_;
+  Pos row_;
+
+  std::unique_ptr<PolynomialRollingHasher> ahasher_;
+  // Hash -> positions of the first k-mer of b with that hash.
+  std::unordered_map<unsigned long long, std::vector<Pos>> bmap_;
+  // Hash -> positions of each other k-mer of b with that hash. Empty unless
+  // the hash collides.
+  std::unordered_map<unsigned long long, std::vector<std::vector<Pos>>>
+      collisions_;
+  std::unique_ptr<KmerFilter> bfilter_;
+};
+
+// The match makers are instantiated for int16_t, int32_t and int64_t indices.
+typedef BasicMatchMaker<int> MatchMaker;
+typedef BasicNaiveMatchMaker<int> NaiveMatchMaker;
+typedef BasicPerfectHashMatchMaker<int> PerfectHashMatchMaker;
+typedef BasicRandomizedHashMatchMaker<int> RandomizedHashMatchMaker;
+
+// PERFECT_HASH if the hashes of the k-mers of a and b fit into 64 bits, i.e.
+// if alphabet_size^(k+1) does (RollingHasher multiplies a hash by
+// alphabet_size before reducing it), and RANDOMIZED_HASH otherwise.
+MatchMakerType FastestMatchMakerType(const std::string& a,
+                                     const std::string& b, int k);
+MatchMakerType FastestMatchMakerType(const char* a, size_t a_size,
+                                     const char* b, size_t b_size, int k);
+
+// An implementation of the MatchMaker for comparing a string with itself,
+// which only generates the matches strictly above the main diagonal, i.e.
+// indices j > i such that a[i,i+k) == a[j,j+k). The matches on the diagonal
+// are trivial and the ones below it mirror those above.
+//
+// The string is hashed once and, instead of position lists, every position
+// links to the next occurrence of its k-mer, so the index takes a single int
+// per position and the string is never copied (it has to outlive the
+// SelfMatchMaker). When the k-mers are too long for a perfect hash of the
+// alphabet, the chains are built from a PolynomialRollingHasher and every
+// hash hit is verified.
+class SelfMatchMaker : public MatchMaker {
+ public:
+  SelfMatchMaker(const std::string& a, int k);
+
+  bool GetNextMatches(std::vector<int>* matches) override;
+
+ private:
   int row_;
+  // next_occurrence_[i] = smallest j > i such that a[i,i+k) == a[j,j+k), or
+  // -1 if there is none.
+  std::vector<int> next_occurrence_;
+};
+
+// Index of the k-mers of a reference string b which is built once and then
+// shared, read-only, by the comparisons of many query strings against b (e.g.
+// from several threads). The alphabet is that of b, extended by a single
+// symbol standing for every other character, so that query k-mers containing
+// such characters hash to values which never occur in b.
+//
+// If the hashes of RollingHasher do not fit into 64 bits for this alphabet
+// and k (see FastestMatchMakerType), the k-mers are hashed by a
+// PolynomialRollingHasher with a random base instead, and every hash match is
+// verified against a copy of b, as in BasicRandomizedHashMatchMaker.
+class ReferenceIndex {
+ public:
+  ReferenceIndex(const std::string& b, int k);
 
+  int k() const { return k_; }
+  int size() const { return b_size_; }
+
+  // Positions j such that b[j,j+k) == a[row,row+k), whose hash is given,
+  // nullptr if there is none.
+  const std::vector<int>* Find(const std::string& a, int row,
+                               unsigned long long hash) const;
+
+ private:
+  friend class ReferenceMatchMaker;
+
+  int k_;
+  int b_size_;
   std::vector<char> char_to_id_;
   int alphabet_size_;
+  // Base of the PolynomialRollingHasher, or 0 if the k-mers are hashed by
+  // RollingHasher.
+  unsigned long long base_;
+  // b, kept only to verify the matches of a PolynomialRollingHasher.
+  std::string b_;
+  // Hash -> positions of the first k-mer of b with that hash.
+  std::unordered_map<unsigned long long, std::vector<int>> bmap_;
+  // Hash -> positions of each other k-mer of b with that hash. Empty unless
+  // the polynomial hash collides.
+  std::unordered_map<unsigned long long, std::vector<std::vector<int>>>
+      collisions_;
+};
+
+// MatchMaker of a query string a against a prebuilt ReferenceIndex. Both have
+// to outlive the ReferenceMatchMaker.
+class ReferenceMatchMaker : public MatchMaker {
+ public:
+  ReferenceMatchMaker(const ReferenceIndex& index, const std::string& a);
+
+  bool GetNextMatches(std::vector<int>* matches) override;
+
+ private:
+  const ReferenceIndex& index_;
+  const std::string& a_;
+  int row_;
+  // One of them, depending on how the index hashes the k-mers.
   std::unique_ptr<RollingHasher> ahasher_;
+  std::unique_ptr<PolynomialRollingHasher> polynomial_ahasher_;
+};
+
+// Match maker for comparing a DNA string a with both strands of b, i.e. with b
+// and with its reverse complement rc(b). The k-mers of b are indexed once by
+// their canonical form (the smaller of the packed k-mer and its reverse
+// complement), so a single lookup per row of a finds the matches on both
+// strands. Only k-mers over A, C, G and T are matched. Requires k <= 32.
+//
+// a has to outlive the DualStrandMatchMaker.
+class DualStrandMatchMaker {
+ public:
+  DualStrandMatchMaker(const std::string& a, const std::string& b, int k);
+
+  // On i-th call of the method, fills forward with the (increasing) indices j
+  // such that a[i,i+k) == b[j,j+k) and reverse with the (increasing) indices j
+  // such that a[i,i+k) == rc(b)[j,j+k).
+  bool GetNextMatches(std::vector<int>* forward, std::vector<int>* reverse);
+
+ private:
+  int k_;
+  int b_size_;
+  CanonicalKmerHasher ahasher_;
+  // Canonical k-mer -> 2 * j + (1 if b[j,j+k) is the reverse complement of
+  // the canonical k-mer, 0 otherwise), increasing in j.
   std::unordered_map<unsigned long long, std::vector<int>> bmap_;
 };
 
+// Approximate MatchMaker indexing only the (w,k)-minimizers of b, e.g. for a
+// reference too long for an index of all its positions. Every window of w
+// consecutive k-mers is represented by the k-mer with the smallest hash (the
+// leftmost one on ties), which samples about 2 / (w + 1) of the positions.
+//
+// The minimizers of a are looked up in the index, and every verified hit
+// (i, j) is extended into the run of consecutive matches (i + d, j + d) around
+// it: up to w - 1 rows back, and forward for as long as the characters match.
+// Two strings sharing a substring of length at least w + k - 1 share the
+// minimizers of the windows inside it, so all the matches of such a common
+// substring are recovered. The output is a subset of the exact matches, with
+// columns increasing within a row, and LCSk++ over it is a valid, possibly
+// shorter, LCSk++ of a and b.
+//
+// The index takes one hash and one position per sampled k-mer, in a sorted
+// array. a and b have to outlive the MinimizerMatchMaker.
+class MinimizerMatchMaker : public MatchMaker {
+ public:
+  MinimizerMatchMaker(const std::string& a, const std::string& b, int k,
+                      int w);
+
+  bool GetNextMatches(std::vector<int>* matches) override;
+
+ private:
+  // Schedules the runs through the matches of a[row, row+k) with the indexed
+  // k-mers of b which have the given hash.
+  void AddRuns(unsigned long long hash, int row);
+
+  const std::string& a_;
+  const std::string& b_;
+  int k_;
+  int w_;
+  int row_;
+
+  // (hash, position) of the minimizers of b, sorted.
+  std::vector<std::pair<unsigned long long, int>> bindex_;
+  // (hash, position) of the minimizers of a, by position, and the first one
+  // not yet looked up.
+  std::vector<std::pair<unsigned long long, int>> aminimizers_;
+  size_t next_aminimizer_;
+  // The diagonals j - i of the runs starting at row r, for the w rows r from
+  // row_ on, at index r % w.
+  std::vector<std::vector<int>> run_starts_;
+  // The diagonals of the runs through the previous row, increasing.
+  std::vector<int> diagonals_;
+  std::vector<int> merged_diagonals_;
+};
+
 #endif
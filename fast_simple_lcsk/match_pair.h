@@ -18,20 +18,33 @@
 #include <memory>
 #include "../util/object_counter.h"
 
-struct MatchPair : ObjectCounter<MatchPair> {
+// Pos is the integer type used for positions in the input strings and for dp
+// values; it has to be signed and able to represent the lengths of both
+// strings. All instantiations share the object counters of MatchPair.
+template <typename Pos>
+struct BasicMatchPair : ObjectCounter<BasicMatchPair<int>> {
   // Needed only for the reconstruction.
-  int end_row;
+  Pos end_row;
   // Needed during computation and reconstruction.
-  int end_col;
+  Pos end_col;
   // Needed only for the computation.
-  int dp;
+  Pos dp;
+  // Zero if the match pair ends k characters after prev. Otherwise (LCSk++
+  // only) it ends a run of run one-character continuations on the diagonal
+  // after prev, which ends at (end_row - run, end_col - run); the match pairs
+  // inside the run are not linked, so that a long diagonal retains one match
+  // pair instead of one per character.
+  Pos run = 0;
   // Pointer to the previous match, used for reconstruction.
-  std::shared_ptr<MatchPair> prev;
+  std::shared_ptr<BasicMatchPair> prev;
 
-  MatchPair() { }
+  BasicMatchPair() { }
 
-  MatchPair(int end_row, int end_col, int dp, std::shared_ptr<MatchPair> prev)
+  BasicMatchPair(Pos end_row, Pos end_col, Pos dp,
+                 std::shared_ptr<BasicMatchPair> prev)
       : end_row(end_row), end_col(end_col), dp(dp), prev(prev) { }
 };
 
+typedef BasicMatchPair<int> MatchPair;
+
 #endif
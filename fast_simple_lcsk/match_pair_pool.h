@@ -0,0 +1,151 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MATCH_PAIR_POOL
+#define MATCH_PAIR_POOL
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "match_pair.h"
+#include "memory_policy.h"
+
+// Free list of equally sized blocks of memory, holding the match pairs of a
+// sweep together with their shared_ptr control blocks. The memory of a freed
+// match pair is reused for the next one, so once the pool has grown to the
+// largest number of match pairs alive at once, creating match pairs does not
+// touch the heap. The blocks are carved out of chunks of doubling size, so
+// growing the pool to n blocks takes O(log n) allocations.
+//
+// The chunks come from operator new, or from a MemoryArena (which has to
+// outlive the pool) to back them with huge pages on the local NUMA node.
+//
+// The pool is not thread-safe: the match pairs allocated from it have to be
+// created and released by one thread at a time, and it has to outlive them.
+class MatchPairPool {
+ public:
+  MatchPairPool() : MatchPairPool(nullptr) {}
+  explicit MatchPairPool(MemoryArena* arena)
+      : arena_(arena), block_size_(0), num_blocks_(0), free_blocks_(nullptr) {}
+  MatchPairPool(const MatchPairPool&) = delete;
+  MatchPairPool& operator=(const MatchPairPool&) = delete;
+
+  ~MatchPairPool() {
+    for (const auto& chunk : chunks_) {
+      ArenaAllocator<char>(arena_).deallocate(chunk.first, chunk.second);
+    }
+  }
+
+  void* Allocate(size_t size) {
+    if (free_blocks_ == nullptr) Grow(size);
+    assert(size <= block_size_);
+    FreeBlock* block = free_blocks_;
+    free_blocks_ = block->next;
+    return block;
+  }
+
+  void Deallocate(void* p) {
+    FreeBlock* block = static_cast<FreeBlock*>(p);
+    block->next = free_blocks_;
+    free_blocks_ = block;
+  }
+
+ private:
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  void Grow(size_t size) {
+    if (block_size_ == 0) {
+      // Every block keeps the alignment of the chunk.
+      const size_t alignment = alignof(std::max_align_t);
+      block_size_ = (std::max(size, sizeof(FreeBlock)) + alignment - 1) /
+                    alignment * alignment;
+    }
+    const size_t kMinChunkBlocks = 256;
+    const size_t num_blocks = std::max(kMinChunkBlocks, num_blocks_);
+    char* chunk =
+        ArenaAllocator<char>(arena_).allocate(num_blocks * block_size_);
+    chunks_.emplace_back(chunk, num_blocks * block_size_);
+    for (size_t i = 0; i < num_blocks; ++i) {
+      Deallocate(chunk + i * block_size_);
+    }
+    num_blocks_ += num_blocks;
+  }
+
+  MemoryArena* arena_;
+  size_t block_size_;
+  size_t num_blocks_;
+  FreeBlock* free_blocks_;
+  // The chunks and their sizes.
+  std::vector<std::pair<char*, size_t>> chunks_;
+};
+
+// Allocator handing out the blocks of a MatchPairPool, for allocate_shared.
+template <typename T>
+class MatchPairAllocator {
+ public:
+  typedef T value_type;
+
+  explicit MatchPairAllocator(MatchPairPool* pool) : pool_(pool) {}
+
+  template <typename U>
+  MatchPairAllocator(const MatchPairAllocator<U>& other)
+      : pool_(other.pool()) {}
+
+  T* allocate(size_t n) {
+    assert(n == 1);
+    return static_cast<T*>(pool_->Allocate(sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t) { pool_->Deallocate(p); }
+
+  MatchPairPool* pool() const { return pool_; }
+
+ private:
+  MatchPairPool* pool_;
+};
+
+template <typename T, typename U>
+bool operator==(const MatchPairAllocator<T>& a,
+                const MatchPairAllocator<U>& b) {
+  return a.pool() == b.pool();
+}
+
+template <typename T, typename U>
+bool operator!=(const MatchPairAllocator<T>& a,
+                const MatchPairAllocator<U>& b) {
+  return a.pool() != b.pool();
+}
+
+// Creates a match pair in pool, or with make_shared if pool is nullptr.
+template <typename Pos>
+std::shared_ptr<BasicMatchPair<Pos>> MakeMatchPair(
+    MatchPairPool* pool, Pos end_row, Pos end_col, Pos dp,
+    std::shared_ptr<BasicMatchPair<Pos>> prev) {
+  if (pool == nullptr) {
+    return std::make_shared<BasicMatchPair<Pos>>(end_row, end_col, dp,
+                                                 std::move(prev));
+  }
+  return std::allocate_shared<BasicMatchPair<Pos>>(
+      MatchPairAllocator<BasicMatchPair<Pos>>(pool), end_row, end_col, dp,
+      std::move(prev));
+}
+
+#endif
@@ -0,0 +1,165 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <limits>
+
+#include <cstring>
+
+#include "match_trace.h"
+
+using namespace std;
+
+namespace {
+
+const char kTraceMagic[] = "LCSKTRC1";
+const size_t kTraceMagicSize = sizeof(kTraceMagic) - 1;
+
+void AppendVarint(uint64_t value, string* out) {
+  while (value >= 0x80) {
+    out->push_back((char)(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back((char)value);
+}
+
+// Decodes the varint at *offset of data, advancing *offset past it. Returns
+// false if data ends before the varint does.
+bool ReadVarint(const string& data, size_t* offset, uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64 && *offset < data.size(); shift += 7) {
+    const unsigned char byte = data[(*offset)++];
+    *value |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+// Like ReadVarint, for values which have to fit into an int.
+bool ReadInt(const string& data, size_t* offset, int* value) {
+  uint64_t wide = 0;
+  if (!ReadVarint(data, offset, &wide) ||
+      wide > (uint64_t)numeric_limits<int>::max()) {
+    return false;
+  }
+  *value = wide;
+  return true;
+}
+
+}  // namespace
+
+MatchTraceRecorder::MatchTraceRecorder(MatchMaker* match_maker, int k,
+                                       int a_size, int b_size,
+                                       const std::string& path)
+    : match_maker_(match_maker), file_(fopen(path.c_str(), "wb")),
+      ok_(file_ != nullptr) {
+  string header(kTraceMagic, kTraceMagicSize);
+  AppendVarint(k, &header);
+  AppendVarint(a_size, &header);
+  AppendVarint(b_size, &header);
+  ok_ = ok_ && fwrite(header.data(), 1, header.size(), file_) == header.size();
+}
+
+MatchTraceRecorder::~MatchTraceRecorder() {
+  Close();
+}
+
+bool MatchTraceRecorder::GetNextMatches(std::vector<int>* matches) {
+  if (!match_maker_->GetNextMatches(matches)) return false;
+  if (!ok_) return true;
+
+  row_buffer_.clear();
+  AppendVarint(matches->size(), &row_buffer_);
+  int prev = 0;
+  for (int col : *matches) {
+    AppendVarint(col - prev, &row_buffer_);
+    prev = col;
+  }
+  ok_ = fwrite(row_buffer_.data(), 1, row_buffer_.size(), file_) ==
+        row_buffer_.size();
+  return true;
+}
+
+bool MatchTraceRecorder::Close() {
+  if (file_ != nullptr) {
+    ok_ = fclose(file_) == 0 && ok_;
+    file_ = nullptr;
+  }
+  return ok_;
+}
+
+MatchTrace::MatchTrace()
+    : k_(0), a_size_(0), b_size_(0), num_rows_(0), num_matches_(0),
+      rows_begin_(0) {}
+
+bool MatchTrace::Load(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) return false;
+  data_.clear();
+  char buffer[1 << 16];
+  for (size_t n; (n = fread(buffer, 1, sizeof(buffer), file)) > 0;) {
+    data_.append(buffer, n);
+  }
+  const bool read_ok = !ferror(file);
+  fclose(file);
+  if (!read_ok || data_.compare(0, kTraceMagicSize, kTraceMagic) != 0) {
+    return false;
+  }
+
+  size_t offset = kTraceMagicSize;
+  if (!ReadInt(data_, &offset, &k_) || !ReadInt(data_, &offset, &a_size_) ||
+      !ReadInt(data_, &offset, &b_size_)) {
+    return false;
+  }
+  rows_begin_ = offset;
+
+  // Checks that every row is complete and its columns fit into b.
+  num_rows_ = 0;
+  num_matches_ = 0;
+  while (offset < data_.size()) {
+    int num_row_matches = 0;
+    if (!ReadInt(data_, &offset, &num_row_matches)) return false;
+    int64_t col = 0;
+    for (int i = 0; i < num_row_matches; ++i) {
+      uint64_t delta = 0;
+      if (!ReadVarint(data_, &offset, &delta)) return false;
+      col += delta;
+      if (col >= b_size_) return false;
+    }
+    ++num_rows_;
+    num_matches_ += num_row_matches;
+  }
+  return num_rows_ <= a_size_;
+}
+
+TraceMatchMaker::TraceMatchMaker(const MatchTrace& trace)
+    : trace_(trace), offset_(trace.rows_begin_) {}
+
+bool TraceMatchMaker::GetNextMatches(std::vector<int>* matches) {
+  matches->clear();
+  const string& data = trace_.data_;
+  // Are there more matches to generate?
+  if (offset_ >= data.size()) return false;
+
+  // The trace was validated by MatchTrace::Load.
+  uint64_t num_row_matches = 0;
+  ReadVarint(data, &offset_, &num_row_matches);
+  int col = 0;
+  for (uint64_t i = 0; i < num_row_matches; ++i) {
+    uint64_t delta = 0;
+    ReadVarint(data, &offset_, &delta);
+    col += delta;
+    matches->push_back(col);
+  }
+  return true;
+}
@@ -0,0 +1,101 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MATCH_TRACE
+#define MATCH_TRACE
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "match_maker.h"
+
+// Traces of the k-mer matches fed into the sweep, for measuring the sweep on
+// its own: a trace recorded once from real inputs is replayed by a
+// TraceMatchMaker without hashing or indexing anything.
+//
+// A trace file starts with the magic "LCSKTRC1" followed by k, |a| and |b|,
+// and then holds the matches of every row of a: their number followed by the
+// first column and the differences between consecutive columns. All numbers
+// are unsigned LEB128 varints, so a row without matches takes a single byte
+// and the columns of a row of clustered matches about one byte each.
+
+// MatchMaker forwarding the matches of another one and appending them to a
+// trace file.
+class MatchTraceRecorder : public MatchMaker {
+ public:
+  // match_maker has to outlive the recorder. The trace file is created
+  // immediately; ok() tells whether that succeeded.
+  MatchTraceRecorder(MatchMaker* match_maker, int k, int a_size, int b_size,
+                     const std::string& path);
+  ~MatchTraceRecorder() override;
+
+  bool GetNextMatches(std::vector<int>* matches) override;
+
+  // Whether every write so far succeeded.
+  bool ok() const { return ok_; }
+
+  // Flushes and closes the trace file. Returns false if any write failed.
+  bool Close();
+
+ private:
+  MatchMaker* match_maker_;
+  FILE* file_;
+  bool ok_;
+  std::string row_buffer_;
+};
+
+// A trace loaded into memory.
+class MatchTrace {
+ public:
+  MatchTrace();
+
+  // Reads and validates the trace file at path. Returns false if it cannot be
+  // read or is not a complete trace.
+  bool Load(const std::string& path);
+
+  int k() const { return k_; }
+  int a_size() const { return a_size_; }
+  int b_size() const { return b_size_; }
+  // Number of rows recorded, i.e. |a| - k + 1 unless |a| < k.
+  int64_t num_rows() const { return num_rows_; }
+  int64_t num_matches() const { return num_matches_; }
+
+ private:
+  friend class TraceMatchMaker;
+
+  int k_;
+  int a_size_;
+  int b_size_;
+  int64_t num_rows_;
+  int64_t num_matches_;
+  std::string data_;
+  // Offset of the first row in data_.
+  size_t rows_begin_;
+};
+
+// MatchMaker replaying the rows of a trace, which has to outlive it.
+class TraceMatchMaker : public MatchMaker {
+ public:
+  explicit TraceMatchMaker(const MatchTrace& trace);
+
+  bool GetNextMatches(std::vector<int>* matches) override;
+
+ private:
+  const MatchTrace& trace_;
+  size_t offset_;
+};
+
+#endif
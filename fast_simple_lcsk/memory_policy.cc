@@ -0,0 +1,154 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstdint>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "memory_policy.h"
+
+using namespace std;
+
+namespace {
+
+const size_t kHugePageBytes = 2 << 20;
+// Small allocations are rounded up to a multiple of kAlignment and carved out
+// of regions of kRegionBytes.
+const size_t kAlignment = 16;
+const size_t kMaxSmallBytes = 64 << 10;
+const size_t kRegionBytes = kHugePageBytes;
+// MPOL_PREFERRED of <numaif.h>, so that libnuma is not needed.
+const int kPreferredNodePolicy = 1;
+
+size_t MappedSize(size_t size, const MemoryPolicy& policy) {
+  const size_t page = policy.huge_pages == NO_HUGE_PAGES
+                          ? (size_t)sysconf(_SC_PAGESIZE)
+                          : kHugePageBytes;
+  return (max<size_t>(size, 1) + page - 1) / page * page;
+}
+
+// Maps size bytes starting at a huge page boundary, which transparent huge
+// pages require, by mapping a huge page more and trimming both ends.
+void* MapAligned(size_t size) {
+  const size_t padded_size = size + kHugePageBytes;
+  void* p = mmap(nullptr, padded_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) return nullptr;
+  const uintptr_t begin = (uintptr_t)p;
+  const uintptr_t aligned =
+      (begin + kHugePageBytes - 1) / kHugePageBytes * kHugePageBytes;
+  if (aligned > begin) munmap(p, aligned - begin);
+  const size_t tail = begin + padded_size - (aligned + size);
+  if (tail > 0) munmap((void*)(aligned + size), tail);
+  return (void*)aligned;
+}
+
+// Makes the node of the CPU running this thread the preferred node of the
+// pages in [p, p + size), before they are touched. Best effort: kernels
+// without NUMA support reject the call, and the pages are placed as usual.
+void PreferLocalNode(void* p, size_t size) {
+  unsigned cpu = 0;
+  unsigned node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) return;
+  const size_t bits = 8 * sizeof(unsigned long);
+  vector<unsigned long> nodes(node / bits + 1, 0);
+  nodes[node / bits] |= 1UL << (node % bits);
+  syscall(SYS_mbind, p, size, kPreferredNodePolicy, nodes.data(),
+          nodes.size() * bits + 1, 0);
+}
+
+}  // namespace
+
+void* MapMemory(size_t size, const MemoryPolicy& policy) {
+  const size_t mapped_size = MappedSize(size, policy);
+  void* p = MAP_FAILED;
+  if (policy.huge_pages == EXPLICIT_HUGE_PAGES) {
+    p = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+  if (p == MAP_FAILED) {
+    if (policy.huge_pages == NO_HUGE_PAGES) {
+      p = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED) return nullptr;
+    } else {
+      p = MapAligned(mapped_size);
+      if (p == nullptr) return nullptr;
+      madvise(p, mapped_size, MADV_HUGEPAGE);
+    }
+  }
+  if (policy.bind_to_local_node) PreferLocalNode(p, mapped_size);
+  return p;
+}
+
+void UnmapMemory(void* p, size_t size, const MemoryPolicy& policy) {
+  munmap(p, MappedSize(size, policy));
+}
+
+MemoryArena::MemoryArena(const MemoryPolicy& policy)
+    : policy_(policy),
+      region_next_(nullptr),
+      region_end_(nullptr),
+      free_lists_(kMaxSmallBytes / kAlignment + 1, nullptr),
+      mapped_bytes_(0) {}
+
+MemoryArena::~MemoryArena() {
+  for (char* region : regions_) {
+    UnmapMemory(region, kRegionBytes, policy_);
+  }
+}
+
+void* MemoryArena::Allocate(size_t size) {
+  if (size > kMaxSmallBytes) {
+    void* p = MapMemory(size, policy_);
+    if (p != nullptr) mapped_bytes_ += MappedSize(size, policy_);
+    return p;
+  }
+
+  const size_t units = max<size_t>(1, (size + kAlignment - 1) / kAlignment);
+  FreeBlock*& free_list = free_lists_[units];
+  if (free_list != nullptr) {
+    FreeBlock* block = free_list;
+    free_list = block->next;
+    return block;
+  }
+
+  const size_t bytes = units * kAlignment;
+  if ((size_t)(region_end_ - region_next_) < bytes) {
+    char* region = static_cast<char*>(MapMemory(kRegionBytes, policy_));
+    if (region == nullptr) return nullptr;
+    regions_.push_back(region);
+    mapped_bytes_ += MappedSize(kRegionBytes, policy_);
+    region_next_ = region;
+    region_end_ = region + kRegionBytes;
+  }
+  void* p = region_next_;
+  region_next_ += bytes;
+  return p;
+}
+
+void MemoryArena::Deallocate(void* p, size_t size) {
+  if (size > kMaxSmallBytes) {
+    UnmapMemory(p, size, policy_);
+    mapped_bytes_ -= MappedSize(size, policy_);
+    return;
+  }
+  const size_t units = max<size_t>(1, (size + kAlignment - 1) / kAlignment);
+  FreeBlock* block = static_cast<FreeBlock*>(p);
+  block->next = free_lists_[units];
+  free_lists_[units] = block;
+}
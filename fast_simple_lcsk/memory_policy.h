@@ -0,0 +1,143 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MEMORY_POLICY
+#define MEMORY_POLICY
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Pages backing the large, randomly accessed structures of a comparison (the
+// k-mer index and the match pairs), which for chromosome-scale inputs take
+// many gigabytes, so that with 4 KiB pages most accesses miss the TLB.
+enum HugePages {
+  // Regular pages.
+  NO_HUGE_PAGES,
+  // Transparent huge pages, requested with madvise(MADV_HUGEPAGE). The kernel
+  // backs the memory with 2 MiB pages when it can.
+  TRANSPARENT_HUGE_PAGES,
+  // Huge pages reserved in advance (vm.nr_hugepages), mapped with
+  // MAP_HUGETLB. Falls back to transparent huge pages if none are available.
+  EXPLICIT_HUGE_PAGES,
+};
+
+// How a comparison allocates its index and match pairs. The default policy
+// leaves them to operator new.
+struct MemoryPolicy {
+  MemoryPolicy() : huge_pages(NO_HUGE_PAGES), bind_to_local_node(false) {}
+  MemoryPolicy(HugePages huge_pages, bool bind_to_local_node)
+      : huge_pages(huge_pages), bind_to_local_node(bind_to_local_node) {}
+
+  bool IsDefault() const {
+    return huge_pages == NO_HUGE_PAGES && !bind_to_local_node;
+  }
+
+  HugePages huge_pages;
+  // Whether to place the memory on the NUMA node of the CPU running the
+  // allocating thread (which, for a comparison, is the one computing it), as
+  // the preferred node of the mapping. Otherwise, pages are placed on the
+  // node of the thread first touching them.
+  bool bind_to_local_node;
+};
+
+// Maps at least size bytes of zeroed memory according to policy. Returns
+// nullptr if the memory cannot be mapped.
+void* MapMemory(size_t size, const MemoryPolicy& policy);
+
+// Unmaps memory returned by MapMemory(size, policy).
+void UnmapMemory(void* p, size_t size, const MemoryPolicy& policy);
+
+// Allocator carving memory out of regions mapped by MapMemory. Allocations of
+// up to 64 KiB share 2 MiB regions, one huge page each, and are recycled
+// through free lists by size; larger ones get a mapping of their own. The
+// regions are unmapped by the destructor, so the arena has to outlive
+// everything allocated from it.
+//
+// The arena is not thread-safe: it is used by the thread building an index or
+// running a sweep.
+class MemoryArena {
+ public:
+  explicit MemoryArena(const MemoryPolicy& policy);
+  MemoryArena(const MemoryArena&) = delete;
+  MemoryArena& operator=(const MemoryArena&) = delete;
+  ~MemoryArena();
+
+  void* Allocate(size_t size);
+  void Deallocate(void* p, size_t size);
+
+  // Bytes currently mapped by the arena.
+  size_t mapped_bytes() const { return mapped_bytes_; }
+
+ private:
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  MemoryPolicy policy_;
+  std::vector<char*> regions_;
+  char* region_next_;
+  char* region_end_;
+  // Free blocks of the small allocations, by size in units of the alignment.
+  std::vector<FreeBlock*> free_lists_;
+  size_t mapped_bytes_;
+};
+
+// Allocator handing out the memory of a MemoryArena, or of operator new if the
+// arena is nullptr.
+template <typename T>
+class ArenaAllocator {
+ public:
+  typedef T value_type;
+
+  ArenaAllocator() : arena_(nullptr) {}
+  explicit ArenaAllocator(MemoryArena* arena) : arena_(arena) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    if (arena_ == nullptr) {
+      return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    T* p = static_cast<T*>(arena_->Allocate(n * sizeof(T)));
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+  }
+
+  void deallocate(T* p, size_t n) {
+    if (arena_ == nullptr) {
+      ::operator delete(p);
+    } else {
+      arena_->Deallocate(p, n * sizeof(T));
+    }
+  }
+
+  MemoryArena* arena() const { return arena_; }
+
+ private:
+  MemoryArena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena() != b.arena();
+}
+
+#endif
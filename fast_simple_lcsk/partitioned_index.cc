@@ -0,0 +1,309 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <limits>
+
+#include <cassert>
+#include <cstring>
+
+#include "lcsk.h"
+#include "partitioned_index.h"
+#include "rolling_hasher.h"
+
+using namespace std;
+
+namespace {
+
+const char kIndexMagic[] = "LCSKPIX1";
+const size_t kIndexMagicSize = sizeof(kIndexMagic) - 1;
+const int kMaxPrefixLength = 4;
+const size_t kEntryBytes = sizeof(uint64_t) + sizeof(int32_t);
+const size_t kDefaultMaxRunMatches = 1 << 22;
+// Matches read from a run at once while merging (64 KiB).
+const size_t kRunBufferMatches = 1 << 13;
+
+string PartitionPath(const string& path, int p) {
+  return path + "." + to_string(p);
+}
+
+int PartitionOf(uint64_t kmer, int k, int prefix_length) {
+  return prefix_length == 0 ? 0 : kmer >> (2 * (k - prefix_length));
+}
+
+bool WriteEntry(uint64_t kmer, int32_t pos, FILE* file) {
+  char entry[kEntryBytes];
+  memcpy(entry, &kmer, sizeof(kmer));
+  memcpy(entry + sizeof(kmer), &pos, sizeof(pos));
+  return fwrite(entry, 1, kEntryBytes, file) == kEntryBytes;
+}
+
+// Reads the whole file at path into *data.
+bool ReadFile(const string& path, string* data) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) return false;
+  data->clear();
+  char buffer[1 << 16];
+  for (size_t n; (n = fread(buffer, 1, sizeof(buffer), file)) > 0;) {
+    data->append(buffer, n);
+  }
+  const bool read_ok = !ferror(file);
+  fclose(file);
+  return read_ok;
+}
+
+bool ReadEntries(const string& path, vector<pair<uint64_t, int>>* entries) {
+  string data;
+  if (!ReadFile(path, &data) || data.size() % kEntryBytes != 0) return false;
+  entries->resize(data.size() / kEntryBytes);
+  for (size_t i = 0; i < entries->size(); ++i) {
+    int32_t pos = 0;
+    memcpy(&(*entries)[i].first, &data[i * kEntryBytes], sizeof(uint64_t));
+    memcpy(&pos, &data[i * kEntryBytes + sizeof(uint64_t)], sizeof(pos));
+    (*entries)[i].second = pos;
+  }
+  return true;
+}
+
+// Reads the entries of the partition file at path, sorted by k-mer and then
+// position.
+bool ReadSortedEntries(const string& path,
+                       vector<pair<uint64_t, int>>* entries) {
+  if (!ReadEntries(path, entries)) return false;
+  // The entries of a k-mer are already sorted by position.
+  stable_sort(entries->begin(), entries->end(),
+              [](const pair<uint64_t, int>& x, const pair<uint64_t, int>& y) {
+                return x.first < y.first;
+              });
+  return true;
+}
+
+// Writes the entries of the k-mers of s over A, C, G and T into the files
+// path.<p> of their partitions, in order of position. s has to fit into an
+// int32_t.
+bool WritePartitions(const string& s, int k, int prefix_length,
+                     const string& path) {
+  const int num_partitions = 1 << (2 * prefix_length);
+  vector<FILE*> files(num_partitions, nullptr);
+  bool ok = true;
+  for (int p = 0; p < num_partitions; ++p) {
+    files[p] = fopen(PartitionPath(path, p).c_str(), "wb");
+    ok = ok && files[p] != nullptr;
+  }
+  if (ok) {
+    CanonicalKmerHasher hasher(s, k);
+    unsigned long long forward = 0;
+    unsigned long long reverse = 0;
+    bool valid = false;
+    for (int32_t j = 0; ok && hasher.Next(&forward, &reverse, &valid); ++j) {
+      if (!valid) continue;
+      ok = WriteEntry(forward, j, files[PartitionOf(forward, k, prefix_length)]);
+    }
+  }
+  for (FILE* file : files) {
+    if (file != nullptr) ok = fclose(file) == 0 && ok;
+  }
+  return ok;
+}
+
+}  // namespace
+
+bool BuildPartitionedIndex(const std::string& b, int k, int prefix_length,
+                           const std::string& path) {
+  assert(0 < k && k <= 32);
+  // The positions are stored in 4 bytes.
+  if (b.size() > (size_t)numeric_limits<int32_t>::max()) return false;
+  prefix_length = max(0, min(prefix_length, min(k, kMaxPrefixLength)));
+  const int num_partitions = 1 << (2 * prefix_length);
+
+  FILE* meta = fopen(path.c_str(), "wb");
+  if (meta == nullptr) return false;
+  const int32_t params[] = {k, prefix_length, (int32_t)b.size()};
+  bool ok = fwrite(kIndexMagic, 1, kIndexMagicSize, meta) == kIndexMagicSize &&
+            fwrite(params, sizeof(params), 1, meta) == 1;
+  ok = fclose(meta) == 0 && ok;
+  ok = ok && WritePartitions(b, k, prefix_length, path);
+
+  // Sorts the partitions one at a time.
+  vector<pair<uint64_t, int>> entries;
+  for (int p = 0; ok && p < num_partitions; ++p) {
+    const string partition_path = PartitionPath(path, p);
+    ok = ReadSortedEntries(partition_path, &entries);
+    if (!ok) break;
+    FILE* file = fopen(partition_path.c_str(), "wb");
+    ok = file != nullptr;
+    for (size_t i = 0; ok && i < entries.size(); ++i) {
+      ok = WriteEntry(entries[i].first, entries[i].second, file);
+    }
+    if (file != nullptr) ok = fclose(file) == 0 && ok;
+  }
+  return ok;
+}
+
+PartitionedIndex::PartitionedIndex() : k_(0), prefix_length_(0), b_size_(0) {}
+
+bool PartitionedIndex::Open(const std::string& path) {
+  string data;
+  int32_t params[3];
+  if (!ReadFile(path, &data) ||
+      data.size() != kIndexMagicSize + sizeof(params) ||
+      data.compare(0, kIndexMagicSize, kIndexMagic) != 0) {
+    return false;
+  }
+  memcpy(params, &data[kIndexMagicSize], sizeof(params));
+  if (params[0] <= 0 || params[0] > 32 || params[1] < 0 ||
+      params[1] > min(params[0], kMaxPrefixLength) || params[2] < 0) {
+    return false;
+  }
+  path_ = path;
+  k_ = params[0];
+  prefix_length_ = params[1];
+  b_size_ = params[2];
+  return true;
+}
+
+int PartitionedIndex::Partition(uint64_t kmer) const {
+  return PartitionOf(kmer, k_, prefix_length_);
+}
+
+bool PartitionedIndex::ReadPartition(
+    int p, std::vector<std::pair<uint64_t, int>>* entries) const {
+  return ReadEntries(PartitionPath(path_, p), entries);
+}
+
+OutOfCoreMatchMaker::OutOfCoreMatchMaker(const PartitionedIndex& index,
+                                         const std::string& a,
+                                         const std::string& scratch_path)
+    : OutOfCoreMatchMaker(index, a, scratch_path, kDefaultMaxRunMatches) {}
+
+OutOfCoreMatchMaker::OutOfCoreMatchMaker(const PartitionedIndex& index,
+                                         const std::string& a,
+                                         const std::string& scratch_path,
+                                         size_t max_run_matches)
+    : a_(a), k_(index.k()), max_run_matches_(max(max_run_matches, (size_t)1)),
+      row_(0), scratch_path_(scratch_path),
+      scratch_(fopen(scratch_path.c_str(), "w+b")), ok_(scratch_ != nullptr),
+      scratch_size_(0) {
+  // The rows are ints.
+  if (a_.size() > (size_t)numeric_limits<int>::max()) ok_ = false;
+  if (!ok_ || k_ <= 0) return;
+
+  // The k-mers of a are partitioned like those of the index, into files next
+  // to the scratch file, and joined with the index one partition at a time.
+  const string kmers_path = scratch_path_ + ".kmers";
+  ok_ = WritePartitions(a_, k_, index.prefix_length(), kmers_path);
+  vector<pair<uint64_t, int>> akmers;
+  vector<pair<uint64_t, int>> entries;
+  for (int p = 0; p < index.num_partitions(); ++p) {
+    const string partition_path = PartitionPath(kmers_path, p);
+    ok_ = ok_ && ReadSortedEntries(partition_path, &akmers) &&
+          (akmers.empty() || index.ReadPartition(p, &entries));
+    remove(partition_path.c_str());
+    if (!ok_ || akmers.empty()) continue;
+
+    size_t e = 0;
+    for (const auto& akmer : akmers) {
+      while (e < entries.size() && entries[e].first < akmer.first) ++e;
+      for (size_t f = e; f < entries.size() && entries[f].first == akmer.first;
+           ++f) {
+        pending_.emplace_back(akmer.second, entries[f].second);
+        if (pending_.size() >= max_run_matches_) FlushRun();
+      }
+    }
+  }
+  FlushRun();
+  vector<pair<int, int>>().swap(pending_);
+
+  for (int run = 0; run < (int)runs_.size(); ++run) {
+    PushNextMatch(run);
+  }
+}
+
+OutOfCoreMatchMaker::~OutOfCoreMatchMaker() {
+  if (scratch_ != nullptr) {
+    fclose(scratch_);
+    remove(scratch_path_.c_str());
+  }
+}
+
+bool OutOfCoreMatchMaker::GetNextMatches(std::vector<int>* matches) {
+  matches->clear();
+  // Are there more matches to generate?
+  if ((size_t)row_ + k_ > a_.size()) return false;
+
+  // The heap yields the matches by row and then by column.
+  while (!heap_.empty() && heap_.top().first.first == row_) {
+    const int run = heap_.top().second;
+    matches->push_back(heap_.top().first.second);
+    heap_.pop();
+    PushNextMatch(run);
+  }
+
+  ++row_;  // Not forgetting to update this!
+  return true;
+}
+
+void OutOfCoreMatchMaker::FlushRun() {
+  if (pending_.empty() || !ok_) return;
+  sort(pending_.begin(), pending_.end());
+  const int64_t run_bytes = pending_.size() * sizeof(pending_[0]);
+  ok_ = fseeko(scratch_, scratch_size_, SEEK_SET) == 0 &&
+        fwrite(pending_.data(), sizeof(pending_[0]), pending_.size(),
+               scratch_) == pending_.size();
+  runs_.push_back(Run{scratch_size_, scratch_size_ + run_bytes, {}, 0});
+  scratch_size_ += run_bytes;
+  pending_.clear();
+}
+
+bool OutOfCoreMatchMaker::FillRun(Run* run) {
+  run->buffer.clear();
+  run->next = 0;
+  if (!ok_ || run->offset >= run->end) {
+    run->buffer.shrink_to_fit();
+    return false;
+  }
+  const size_t num_matches = min<int64_t>(
+      kRunBufferMatches, (run->end - run->offset) / sizeof(run->buffer[0]));
+  run->buffer.resize(num_matches);
+  if (fseeko(scratch_, run->offset, SEEK_SET) != 0 ||
+      fread(run->buffer.data(), sizeof(run->buffer[0]), num_matches,
+            scratch_) != num_matches) {
+    ok_ = false;
+    run->buffer.clear();
+    return false;
+  }
+  run->offset += num_matches * sizeof(run->buffer[0]);
+  return true;
+}
+
+void OutOfCoreMatchMaker::PushNextMatch(int run) {
+  Run& r = runs_[run];
+  if (r.next == r.buffer.size() && !FillRun(&r)) return;
+  heap_.emplace(r.buffer[r.next++], run);
+}
+
+bool LcsKSparseOutOfCore(
+    const std::string& a, const std::string& index_path,
+    const std::string& scratch_path, bool lcsk_plus,
+    std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  lcsk_reconstruction->clear();
+  PartitionedIndex index;
+  if (!index.Open(index_path)) return false;
+  OutOfCoreMatchMaker match_maker(index, a, scratch_path);
+  if (!match_maker.ok()) return false;
+  LcsKSparseFastWithMatchMaker(&match_maker, a.size(), index.b_size(),
+                               index.k(), lcsk_plus, -1, false,
+                               lcsk_reconstruction, nullptr);
+  return match_maker.ok();
+}
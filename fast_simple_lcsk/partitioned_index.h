@@ -0,0 +1,149 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PARTITIONED_INDEX
+#define PARTITIONED_INDEX
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "match_maker.h"
+
+// On-disk index of the k-mers of a reference b whose index does not fit into
+// memory. The k-mers are packed two bits per base, as by CanonicalKmerHasher
+// (only k-mers over A, C, G and T are indexed, and k <= 32), and partitioned
+// by their first prefix_length bases into 4^prefix_length partitions.
+//
+// The index at path consists of the file path, holding the magic "LCSKPIX1"
+// followed by k, prefix_length and |b| as 4-byte integers, and of the files
+// path.<p>, holding the (k-mer, position) entries of partition p sorted by
+// k-mer and then position: the k-mer in 8 and the position in 4 bytes, in
+// host byte order. Building and querying the index keep at most one
+// partition in memory (of b, respectively of both a and b), besides b
+// (respectively a) itself.
+
+// Builds the index of b at path. prefix_length is clamped to [0, min(k, 4)],
+// i.e. to at most 256 partitions. Returns false if a file cannot be written,
+// or if |b| does not fit into the 4-byte positions.
+bool BuildPartitionedIndex(const std::string& b, int k, int prefix_length,
+                           const std::string& path);
+
+// The parameters of an index built by BuildPartitionedIndex.
+class PartitionedIndex {
+ public:
+  PartitionedIndex();
+
+  // Reads the parameters of the index at path. Returns false if they cannot
+  // be read.
+  bool Open(const std::string& path);
+
+  int k() const { return k_; }
+  int prefix_length() const { return prefix_length_; }
+  int num_partitions() const { return 1 << (2 * prefix_length_); }
+  int b_size() const { return b_size_; }
+
+  // Partition of a packed k-mer.
+  int Partition(uint64_t kmer) const;
+
+  // Reads the entries of partition p into *entries. Returns false if the
+  // partition cannot be read.
+  bool ReadPartition(int p, std::vector<std::pair<uint64_t, int>>* entries)
+      const;
+
+ private:
+  std::string path_;
+  int k_;
+  int prefix_length_;
+  int b_size_;
+};
+
+// MatchMaker of a string a against an on-disk index of b, streaming the
+// matches from disk. The construction partitions the k-mers of a like those
+// of b, into the files scratch_path.kmers.<p>, and joins them with the index
+// one partition at a time, writing the matches (i, j) into sorted runs of a
+// scratch file at scratch_path. The rows are then generated by merging the
+// runs, so only a buffer per run is resident while sweeping. The files of
+// the k-mers are removed once joined and the scratch file by the destructor.
+// |a| has to fit into an int, which ok() checks before any row is generated.
+//
+// a and index have to outlive the OutOfCoreMatchMaker.
+class OutOfCoreMatchMaker : public MatchMaker {
+ public:
+  OutOfCoreMatchMaker(const PartitionedIndex& index, const std::string& a,
+                      const std::string& scratch_path);
+  // Same as above, sorting at most max_run_matches matches in memory at once,
+  // instead of 2^22 (32 MiB).
+  OutOfCoreMatchMaker(const PartitionedIndex& index, const std::string& a,
+                      const std::string& scratch_path, size_t max_run_matches);
+  OutOfCoreMatchMaker(const OutOfCoreMatchMaker&) = delete;
+  OutOfCoreMatchMaker& operator=(const OutOfCoreMatchMaker&) = delete;
+  ~OutOfCoreMatchMaker() override;
+
+  bool GetNextMatches(std::vector<int>* matches) override;
+
+  // Whether all the index and scratch file accesses so far succeeded. If not,
+  // the matches generated are incomplete.
+  bool ok() const { return ok_; }
+
+ private:
+  // A sorted run of matches in the scratch file, and the part of it read
+  // into memory.
+  struct Run {
+    int64_t offset;
+    int64_t end;
+    std::vector<std::pair<int, int>> buffer;
+    size_t next;
+  };
+
+  // Sorts the matches in pending_ and appends them to the scratch file as a
+  // new run.
+  void FlushRun();
+  // Refills the buffer of the given run, returning false if it is exhausted.
+  bool FillRun(Run* run);
+  // Pushes the next match of the given run into the heap, if there is one.
+  void PushNextMatch(int run);
+
+  const std::string& a_;
+  int k_;
+  size_t max_run_matches_;
+  int row_;
+  std::string scratch_path_;
+  FILE* scratch_;
+  bool ok_;
+  int64_t scratch_size_;
+
+  std::vector<std::pair<int, int>> pending_;
+  std::vector<Run> runs_;
+  // (i, j, run) of the next match of every run which is not exhausted.
+  std::priority_queue<std::pair<std::pair<int, int>, int>,
+                      std::vector<std::pair<std::pair<int, int>, int>>,
+                      std::greater<std::pair<std::pair<int, int>, int>>>
+      heap_;
+};
+
+// Computes LCSk(a, b) (or LCSkpp(a, b) if lcsk_plus is set) against the index
+// of b at index_path, using a scratch file at scratch_path. Only k-mers over
+// A, C, G and T are matched. Returns false, leaving an incomplete
+// reconstruction, if the index or the scratch file cannot be accessed.
+bool LcsKSparseOutOfCore(
+    const std::string& a, const std::string& index_path,
+    const std::string& scratch_path, bool lcsk_plus,
+    std::vector<std::pair<int, int>>* lcsk_reconstruction);
+
+#endif
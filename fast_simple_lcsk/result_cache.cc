@@ -0,0 +1,285 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <tuple>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lcsk.h"
+#include "result_cache.h"
+
+using namespace std;
+
+namespace {
+
+const char kResultMagic[] = "LCSKRES1";
+const size_t kResultMagicSize = sizeof(kResultMagic) - 1;
+const char kResultSuffix[] = ".lcskres";
+// Bytes a result takes in memory besides its pairs (list node, index entry).
+const int64_t kEntryOverheadBytes = 96;
+
+const uint64_t kLaneMultipliers[] = {0x9e3779b97f4a7c15ULL,
+                                     0xc2b2ae3d27d4eb4fULL};
+
+uint64_t Mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+// Absorbs s into two independent 64-bit lanes, eight bytes at a time.
+void Absorb(const string& s, uint64_t lanes[2]) {
+  const char* data = s.data();
+  const size_t size = s.size();
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    lanes[0] = ((lanes[0] ^ word) * kLaneMultipliers[0]);
+    lanes[0] ^= lanes[0] >> 29;
+    lanes[1] = ((lanes[1] + word) * kLaneMultipliers[1]);
+    lanes[1] = (lanes[1] << 31) | (lanes[1] >> 33);
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, data + i, size - i);
+  // The size separates the strings and disambiguates the zero padded tail.
+  lanes[0] = Mix(lanes[0] ^ tail ^ size);
+  lanes[1] = Mix(lanes[1] + tail + size);
+}
+
+// Name of the result file of a key: the key in hexadecimal and the suffix.
+string FileName(uint64_t high, uint64_t low) {
+  char name[33];
+  snprintf(name, sizeof(name), "%016llx%016llx", (unsigned long long)high,
+           (unsigned long long)low);
+  return string(name) + kResultSuffix;
+}
+
+bool ParseFileName(const string& name, uint64_t* high, uint64_t* low) {
+  const size_t suffix_size = sizeof(kResultSuffix) - 1;
+  if (name.size() != 32 + suffix_size ||
+      name.compare(32, suffix_size, kResultSuffix) != 0 ||
+      name.find_first_not_of("0123456789abcdef") < 32) {
+    return false;
+  }
+  *high = strtoull(name.substr(0, 16).c_str(), nullptr, 16);
+  *low = strtoull(name.substr(16, 16).c_str(), nullptr, 16);
+  return true;
+}
+
+int64_t FileBytes(size_t num_pairs) {
+  return kResultMagicSize + sizeof(int64_t) + num_pairs * 2 * sizeof(int32_t);
+}
+
+// Writes the result into a temporary file renamed to path, so that other
+// processes sharing the directory never read a partial file.
+bool WriteResult(const string& path,
+                 const vector<pair<int, int>>& reconstruction) {
+  const string temporary_path =
+      path + ".tmp" + to_string(getpid()) + "." +
+      to_string(hash<thread::id>()(this_thread::get_id()));
+  FILE* file = fopen(temporary_path.c_str(), "wb");
+  if (file == nullptr) return false;
+  vector<int32_t> data;
+  data.reserve(2 * reconstruction.size());
+  for (const auto& p : reconstruction) {
+    data.push_back(p.first);
+    data.push_back(p.second);
+  }
+  const int64_t num_pairs = reconstruction.size();
+  bool ok = fwrite(kResultMagic, 1, kResultMagicSize, file) ==
+                kResultMagicSize &&
+            fwrite(&num_pairs, sizeof(num_pairs), 1, file) == 1 &&
+            fwrite(data.data(), sizeof(int32_t), data.size(), file) ==
+                data.size();
+  ok = fclose(file) == 0 && ok;
+  ok = ok && rename(temporary_path.c_str(), path.c_str()) == 0;
+  if (!ok) remove(temporary_path.c_str());
+  return ok;
+}
+
+// Reads a result written by WriteResult. A file which is corrupt or truncated
+// (e.g. by another process sharing the directory) is removed, so that the
+// result is computed and stored again.
+bool ReadResult(const string& path, vector<pair<int, int>>* reconstruction) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) return false;
+  char magic[kResultMagicSize];
+  int64_t num_pairs = -1;
+  struct stat info;
+  // The number of pairs is checked against the size of the file before
+  // allocating anything for them.
+  bool ok = fread(magic, 1, kResultMagicSize, file) == kResultMagicSize &&
+            memcmp(magic, kResultMagic, kResultMagicSize) == 0 &&
+            fread(&num_pairs, sizeof(num_pairs), 1, file) == 1 &&
+            fstat(fileno(file), &info) == 0 && num_pairs >= 0 &&
+            num_pairs <= info.st_size / (2 * (int64_t)sizeof(int32_t)) &&
+            FileBytes(num_pairs) == info.st_size;
+  vector<int32_t> data;
+  if (ok) {
+    data.resize(2 * num_pairs);
+    ok = fread(data.data(), sizeof(int32_t), data.size(), file) ==
+             data.size() &&
+         fgetc(file) == EOF;
+  }
+  fclose(file);
+  if (!ok) {
+    remove(path.c_str());
+    return false;
+  }
+  reconstruction->resize(num_pairs);
+  for (int64_t i = 0; i < num_pairs; ++i) {
+    (*reconstruction)[i] = make_pair(data[2 * i], data[2 * i + 1]);
+  }
+  return true;
+}
+
+}  // namespace
+
+ResultCache::ResultCache(const ResultCacheOptions& options)
+    : options_(options) {
+  if (options_.disk_directory.empty()) return;
+  // Picks up the results stored by earlier caches, the most recently
+  // modified first.
+  DIR* dir = opendir(options_.disk_directory.c_str());
+  if (dir == nullptr) return;
+  vector<tuple<int64_t, Key, int64_t>> files;
+  for (dirent* entry; (entry = readdir(dir)) != nullptr;) {
+    Key key;
+    struct stat info;
+    if (ParseFileName(entry->d_name, &key.first, &key.second) &&
+        stat(DiskPath(key).c_str(), &info) == 0) {
+      files.emplace_back(info.st_mtime, key, info.st_size);
+    }
+  }
+  closedir(dir);
+  sort(files.begin(), files.end());
+  for (const auto& file : files) {
+    TouchOnDisk(get<1>(file), get<2>(file));
+  }
+}
+
+void ResultCache::LcsKSparseFast(
+    const std::string& a, const std::string& b, int k,
+    std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  Compare(a, b, k, false, lcsk_reconstruction);
+}
+
+void ResultCache::LcsKppSparseFast(
+    const std::string& a, const std::string& b, int k,
+    std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  Compare(a, b, k, true, lcsk_reconstruction);
+}
+
+ResultCacheStats ResultCache::stats() const {
+  lock_guard<mutex> lock(mutex_);
+  return stats_;
+}
+
+void ResultCache::Compare(
+    const std::string& a, const std::string& b, int k, bool lcsk_plus,
+    std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  uint64_t lanes[2] = {Mix(k), Mix(lcsk_plus ? 2 : 1)};
+  Absorb(a, lanes);
+  Absorb(b, lanes);
+  const Key key(Mix(lanes[0] ^ lanes[1]), Mix(lanes[1] + k));
+
+  {
+    lock_guard<mutex> lock(mutex_);
+    if (FindInMemory(key, lcsk_reconstruction)) {
+      ++stats_.memory_hits;
+      return;
+    }
+  }
+
+  const bool on_disk = !options_.disk_directory.empty();
+  if (on_disk && ReadResult(DiskPath(key), lcsk_reconstruction)) {
+    lock_guard<mutex> lock(mutex_);
+    ++stats_.disk_hits;
+    TouchOnDisk(key, FileBytes(lcsk_reconstruction->size()));
+    InsertIntoMemory(key, *lcsk_reconstruction);
+    return;
+  }
+
+  if (lcsk_plus) {
+    ::LcsKppSparseFast(a, b, k, lcsk_reconstruction);
+  } else {
+    ::LcsKSparseFast(a, b, k, lcsk_reconstruction);
+  }
+  const bool stored =
+      on_disk && WriteResult(DiskPath(key), *lcsk_reconstruction);
+  lock_guard<mutex> lock(mutex_);
+  ++stats_.misses;
+  if (stored) TouchOnDisk(key, FileBytes(lcsk_reconstruction->size()));
+  InsertIntoMemory(key, *lcsk_reconstruction);
+}
+
+bool ResultCache::FindInMemory(
+    const Key& key, std::vector<std::pair<int, int>>* lcsk_reconstruction) {
+  auto it = memory_index_.find(key);
+  if (it == memory_index_.end()) return false;
+  memory_.splice(memory_.begin(), memory_, it->second);
+  *lcsk_reconstruction = it->second->reconstruction;
+  return true;
+}
+
+void ResultCache::InsertIntoMemory(
+    const Key& key, const std::vector<std::pair<int, int>>& reconstruction) {
+  const int64_t bytes =
+      kEntryOverheadBytes + reconstruction.size() * sizeof(reconstruction[0]);
+  if (bytes > options_.memory_budget || memory_index_.count(key) > 0) return;
+  memory_.push_front(Entry{key, reconstruction});
+  memory_index_[key] = memory_.begin();
+  stats_.memory_bytes += bytes;
+  while (stats_.memory_bytes > options_.memory_budget) {
+    const Entry& lru = memory_.back();
+    stats_.memory_bytes -=
+        kEntryOverheadBytes +
+        lru.reconstruction.size() * sizeof(lru.reconstruction[0]);
+    memory_index_.erase(lru.key);
+    memory_.pop_back();
+  }
+}
+
+void ResultCache::TouchOnDisk(const Key& key, int64_t bytes) {
+  auto it = disk_index_.find(key);
+  if (it != disk_index_.end()) {
+    disk_.splice(disk_.begin(), disk_, it->second);
+    return;
+  }
+  disk_.emplace_front(key, bytes);
+  disk_index_[key] = disk_.begin();
+  stats_.disk_bytes += bytes;
+  // Keeps the result just stored even if it alone exceeds the budget.
+  while (stats_.disk_bytes > options_.disk_budget && disk_.size() > 1) {
+    const pair<Key, int64_t>& lru = disk_.back();
+    remove(DiskPath(lru.first).c_str());
+    stats_.disk_bytes -= lru.second;
+    disk_index_.erase(lru.first);
+    disk_.pop_back();
+  }
+}
+
+std::string ResultCache::DiskPath(const Key& key) const {
+  return options_.disk_directory + "/" + FileName(key.first, key.second);
+}
@@ -0,0 +1,104 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RESULT_CACHE
+#define RESULT_CACHE
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct ResultCacheOptions {
+  // Bytes of results kept in memory. The least recently used results are
+  // evicted beyond it.
+  int64_t memory_budget = 64 << 20;
+  // Existing directory where results are also stored, so that they outlive
+  // the cache and are shared with other caches using the directory. No
+  // results are stored on disk if empty.
+  std::string disk_directory;
+  // Bytes of result files kept in disk_directory. The least recently used
+  // files are deleted beyond it.
+  int64_t disk_budget = 1LL << 30;
+};
+
+struct ResultCacheStats {
+  int64_t memory_hits = 0;
+  int64_t disk_hits = 0;
+  int64_t misses = 0;
+  int64_t memory_bytes = 0;
+  int64_t disk_bytes = 0;
+};
+
+// Cache of LCSk/LCSk++ results in front of LcsKSparseFast and
+// LcsKppSparseFast, for workloads comparing the same pairs repeatedly.
+//
+// Results are addressed by a 128-bit hash of the contents of a and b, k and
+// the mode, computed at several bytes per cycle, so that a lookup costs a
+// pass over the inputs rather than a comparison. A result is looked up in
+// memory, then on disk (loading it into memory), and computed otherwise.
+//
+// The cache may be used by several threads at once. The comparisons run
+// outside its lock, so concurrent misses of the same key are computed twice.
+class ResultCache {
+ public:
+  explicit ResultCache(const ResultCacheOptions& options);
+
+  // Same as the functions of lcsk.h, answered from the cache if possible.
+  void LcsKSparseFast(const std::string& a, const std::string& b, int k,
+                      std::vector<std::pair<int, int>>* lcsk_reconstruction);
+  void LcsKppSparseFast(const std::string& a, const std::string& b, int k,
+                        std::vector<std::pair<int, int>>* lcsk_reconstruction);
+
+  ResultCacheStats stats() const;
+
+ private:
+  typedef std::pair<uint64_t, uint64_t> Key;
+  struct KeyHash {
+    size_t operator()(const Key& key) const { return key.first; }
+  };
+  struct Entry {
+    Key key;
+    std::vector<std::pair<int, int>> reconstruction;
+  };
+
+  void Compare(const std::string& a, const std::string& b, int k,
+               bool lcsk_plus,
+               std::vector<std::pair<int, int>>* lcsk_reconstruction);
+  // Moves the result of key to the front of memory_, if it is there.
+  bool FindInMemory(const Key& key,
+                    std::vector<std::pair<int, int>>* lcsk_reconstruction);
+  void InsertIntoMemory(const Key& key,
+                        const std::vector<std::pair<int, int>>& reconstruction);
+  // Records the use of a result file of the given size.
+  void TouchOnDisk(const Key& key, int64_t bytes);
+  std::string DiskPath(const Key& key) const;
+
+  const ResultCacheOptions options_;
+  mutable std::mutex mutex_;
+  ResultCacheStats stats_;
+  // Results in memory, most recently used first.
+  std::list<Entry> memory_;
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> memory_index_;
+  // Result files (key and size), most recently used first.
+  std::list<std::pair<Key, int64_t>> disk_;
+  std::unordered_map<Key, std::list<std::pair<Key, int64_t>>::iterator,
+                     KeyHash>
+      disk_index_;
+};
+
+#endif
@@ -12,8 +12,21 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cassert>
+#include <random>
+
 #include "rolling_hasher.h"
 
+// static
+bool RollingHasher::Fits(int alphabet_size, int k) {
+  unsigned long long power = 1;
+  for (int i = 0; i <= k && alphabet_size > 1; ++i) {
+    if (power > ~0ULL / alphabet_size) return false;
+    power *= alphabet_size;
+  }
+  return true;
+}
+
 bool RollingHasher::Next(unsigned long long* hash) {
   if (col_ + k_ > s_.size()) {
     return false;
@@ -22,13 +35,100 @@ bool RollingHasher::Next(unsigned long long* hash) {
   if (col_ == 0) {
     hash_ = 0;
     for (int i = 0; i < k_ - 1; ++i) {
-      hash_ = hash_ * alphabet_size_ + char_to_id_[s_[i]];
+      hash_ = hash_ * alphabet_size_ + char_to_id_[(unsigned char)s_[i]];
     }
   }
 
-  hash_ = hash_ * alphabet_size_ + char_to_id_[s_[col_ + k_ - 1]];
+  hash_ = hash_ * alphabet_size_ +
+          char_to_id_[(unsigned char)s_[col_ + k_ - 1]];
   hash_ %= hash_mod_;
   *hash = hash_;
   ++col_;  // Not forgetting to update this!
   return true;
 }
+
+CanonicalKmerHasher::CanonicalKmerHasher(const std::string& s, int k)
+    : s_(s),
+      k_(k),
+      code_(256, -1),
+      forward_(0),
+      reverse_(0),
+      valid_run_(0),
+      col_(0) {
+  assert(0 < k && k <= 32);
+  mask_ = k == 32 ? ~0ULL : (1ULL << (2 * k)) - 1;
+  code_['A'] = 0;
+  code_['C'] = 1;
+  code_['G'] = 2;
+  code_['T'] = 3;
+}
+
+bool CanonicalKmerHasher::Next(unsigned long long* forward,
+                               unsigned long long* reverse, bool* valid) {
+  if (col_ + k_ > s_.size()) {
+    return false;
+  }
+
+  // Extends the window up to (and including) position col_ + k_ - 1.
+  for (size_t i = col_ == 0 ? 0 : col_ + k_ - 1; i < col_ + k_; ++i) {
+    const int code = code_[(unsigned char)s_[i]];
+    if (code == -1) {
+      valid_run_ = 0;
+      continue;
+    }
+    ++valid_run_;
+    forward_ = ((forward_ << 2) | code) & mask_;
+    reverse_ = (reverse_ >> 2) |
+               ((unsigned long long)(3 - code) << (2 * (k_ - 1)));
+  }
+
+  *valid = valid_run_ >= k_;
+  *forward = forward_;
+  *reverse = reverse_;
+  ++col_;  // Not forgetting to update this!
+  return true;
+}
+
+// static
+unsigned long long PolynomialRollingHasher::RandomBase() {
+  std::random_device seed;
+  std::mt19937_64 generator(((unsigned long long)seed() << 32) | seed());
+  return std::uniform_int_distribution<unsigned long long>(
+      256, kModulus - 1)(generator);
+}
+
+PolynomialRollingHasher::PolynomialRollingHasher(const std::string& s, int k,
+                                                 unsigned long long base)
+    : s_(s), k_(k), base_(base), top_weight_(1), hash_(0), col_(0) {
+  assert(0 < base && base < kModulus);
+  for (int i = 0; i + 1 < k; ++i) {
+    top_weight_ = MultiplyMod(top_weight_, base);
+  }
+}
+
+bool PolynomialRollingHasher::Next(unsigned long long* hash) {
+  if (col_ + k_ > s_.size()) {
+    return false;
+  }
+
+  // Characters are mapped to [1, 256], so that runs of '\0' do not all hash
+  // to 0.
+  auto value = [this](size_t i) {
+    return (unsigned long long)(unsigned char)s_[i] + 1;
+  };
+  if (col_ == 0) {
+    hash_ = 0;
+    for (int i = 0; i < k_ - 1; ++i) {
+      hash_ = AddMod(MultiplyMod(hash_, base_), value(i));
+    }
+  } else {
+    // Removes the character leaving the window.
+    hash_ = AddMod(hash_,
+                   kModulus - MultiplyMod(value(col_ - 1), top_weight_));
+  }
+
+  hash_ = AddMod(MultiplyMod(hash_, base_), value(col_ + k_ - 1));
+  *hash = hash_;
+  ++col_;  // Not forgetting to update this!
+  return true;
+}
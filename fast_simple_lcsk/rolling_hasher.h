@@ -36,6 +36,12 @@ class RollingHasher {
   // TODO(fpavetic): Docs.
   bool Next(unsigned long long* hash);
 
+  // Whether the hashes fit into 64 bits for this alphabet_size and k, i.e.
+  // whether alphabet_size^(k+1) does (a hash is multiplied by alphabet_size
+  // before it is reduced). Otherwise they wrap around and collide, and a
+  // PolynomialRollingHasher with verified matches has to be used instead.
+  static bool Fits(int alphabet_size, int k);
+
  private:
   const std::string& s_;
   int k_;
@@ -44,7 +50,80 @@ class RollingHasher {
 
   unsigned long long hash_mod_;
   unsigned long long hash_;
-  int col_;
+  size_t col_;
+};
+
+// Rolling hash of the length k substrings of a DNA string, computing both the
+// k-mer and its reverse complement packed two bits per base (A, C, G, T map to
+// 0, 1, 2, 3, so complementing a base is 3 - code). Requires k <= 32.
+class CanonicalKmerHasher {
+ public:
+  CanonicalKmerHasher(const std::string& s, int k);
+
+  // Moves to the next length k substring, returning false if there is none.
+  // Sets *valid to whether the substring consists of A, C, G and T only, in
+  // which case *forward and *reverse receive the packed substring and its
+  // reverse complement.
+  bool Next(unsigned long long* forward, unsigned long long* reverse,
+            bool* valid);
+
+ private:
+  const std::string& s_;
+  int k_;
+  std::vector<char> code_;
+
+  unsigned long long mask_;
+  unsigned long long forward_;
+  unsigned long long reverse_;
+  // Number of consecutive valid bases at the end of the bases read so far.
+  int valid_run_;
+  size_t col_;
+};
+
+// Polynomial rolling hash of the length k substrings of a string modulo the
+// Mersenne prime 2^61 - 1, for any k. Unlike RollingHasher, it is not
+// injective: two distinct substrings collide with probability about k / 2^61
+// for a base drawn at random, so equal hashes have to be verified.
+class PolynomialRollingHasher {
+ public:
+  static const unsigned long long kModulus = (1ULL << 61) - 1;
+
+  // base has to be in [1, kModulus).
+  PolynomialRollingHasher(const std::string& s, int k,
+                          unsigned long long base);
+
+  // Moves to the next length k substring, returning false if there is none.
+  bool Next(unsigned long long* hash);
+
+  // A base drawn at random, which makes collisions unlikely for any input.
+  static unsigned long long RandomBase();
+
+  static unsigned long long MultiplyMod(unsigned long long a,
+                                        unsigned long long b) {
+    const unsigned __int128 product = (unsigned __int128)a * b;
+    // 2^61 = 1 (mod 2^61 - 1), so the high bits are added to the low ones.
+    const unsigned long long sum =
+        (unsigned long long)(product & kModulus) +
+        (unsigned long long)(product >> 61);
+    return sum >= kModulus ? sum - kModulus : sum;
+  }
+
+  // a and b have to be in [0, kModulus].
+  static unsigned long long AddMod(unsigned long long a,
+                                   unsigned long long b) {
+    const unsigned long long sum = a + b;
+    return sum >= kModulus ? sum - kModulus : sum;
+  }
+
+ private:
+  const std::string& s_;
+  int k_;
+  unsigned long long base_;
+  // base^(k-1), the weight of the character leaving the window.
+  unsigned long long top_weight_;
+
+  unsigned long long hash_;
+  size_t col_;
 };
 
 #endif  // ROLLING_HASHER
@@ -0,0 +1,301 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+#include "row_sweeper.h"
+using namespace std;
+
+namespace {
+
+// Returns the match pair of entry index of the compressed table. If the entry
+// is covered by a run, it holds the match pair preceding the run, and the run
+// is cut at the end column of the entry.
+template <typename Pos>
+std::shared_ptr<BasicMatchPair<Pos>> TableEntry(
+    const size_t index, BasicSweepScratch<Pos>* scratch) {
+  const auto& match_pair = scratch->compressed_table[index];
+  const Pos run =
+      scratch->compressed_table_end_cols[index] - match_pair->end_col;
+  if (run == 0) {
+    return match_pair;
+  }
+  assert(run > 0);
+  auto entry = MakeMatchPair<Pos>(scratch->pool(), match_pair->end_row + run,
+                                  match_pair->end_col + run,
+                                  match_pair->dp + run, match_pair);
+  entry->run = run;
+  return entry;
+}
+
+template <typename Pos>
+void AmortizedRowQuery(const int k, const Pos row,
+                       BasicSweepScratch<Pos>* scratch) {
+  auto& events = scratch->events;
+  const auto& end_cols = scratch->compressed_table_end_cols;
+
+  size_t curr_threshold_index = 0;
+  typename BasicMatchEventsQueue<Pos>::Event event;
+
+  while (events.PopBegin(row, &event)) {
+    Pos i = get<0>(event);
+    Pos j = get<1>(event);
+    assert(i == row);
+    while (curr_threshold_index < end_cols.size() &&
+           end_cols[curr_threshold_index] < j) {
+      ++curr_threshold_index;
+    }
+
+    const size_t prev_best_index = curr_threshold_index - 1;
+    auto match_pair =
+        MakeMatchPair<Pos>(scratch->pool(), i + k - 1, j + k - 1, k, nullptr);
+    if (scratch->compressed_table[prev_best_index]->dp > 0) {
+      auto prev_best = TableEntry(prev_best_index, scratch);
+      match_pair->dp = prev_best->dp + k;
+      match_pair->prev = std::move(prev_best);
+    }
+    events.AddEnd(make_tuple(i + k - 1, j + k - 1, std::move(match_pair)));
+  }
+}
+
+template <typename Pos>
+void ElementwiseRowQuery(const int k, const Pos row,
+                         BasicSweepScratch<Pos>* scratch) {
+  auto& events = scratch->events;
+  const auto& end_cols = scratch->compressed_table_end_cols;
+
+  typename BasicMatchEventsQueue<Pos>::Event event;
+
+  while (events.PopBegin(row, &event)) {
+    Pos i = get<0>(event);
+    Pos j = get<1>(event);
+    assert(i == row);
+
+    const size_t prev_best_index =
+        lower_bound(end_cols.begin(), end_cols.end(), j) - end_cols.begin() -
+        1;
+    auto match_pair =
+        MakeMatchPair<Pos>(scratch->pool(), i + k - 1, j + k - 1, k, nullptr);
+    if (scratch->compressed_table[prev_best_index]->dp > 0) {
+      auto prev_best = TableEntry(prev_best_index, scratch);
+      match_pair->dp = prev_best->dp + k;
+      match_pair->prev = std::move(prev_best);
+    }
+    events.AddEnd(make_tuple(i + k - 1, j + k - 1, std::move(match_pair)));
+  }
+}
+
+}  // namespace
+
+template <typename Pos>
+void FillLcskReconstruction(const int k,
+                            std::shared_ptr<BasicMatchPair<Pos>> best,
+                            vector<pair<Pos, Pos>>* lcsk_recon) {
+  assert(lcsk_recon != nullptr);
+  lcsk_recon->clear();
+
+  for (auto ft = best; ft != nullptr; ft = ft->prev) {
+    Pos r = ft->end_row;
+    Pos c = ft->end_col;
+
+    if (ft->run == 0) {
+      assert(ft->prev == nullptr ||
+             (ft->prev->end_row + k <= ft->end_row &&
+              ft->prev->end_col + k <= ft->end_col));
+      for (int j = 0; j < k; ++j, --r, --c) {
+        lcsk_recon->push_back(make_pair(r, c));
+      }
+    } else {
+      assert(ft->prev->end_row + ft->run == ft->end_row &&
+             ft->prev->end_col + ft->run == ft->end_col);
+      for (Pos j = 0; j < ft->run; ++j, --r, --c) {
+        lcsk_recon->push_back(make_pair(r, c));
+      }
+    }
+  }
+  reverse(lcsk_recon->begin(), lcsk_recon->end());
+}
+
+template <typename Pos>
+void RowUpdate(const int k, const Pos row, BasicSweepScratch<Pos>* scratch,
+               bool lcsk_plus) {
+  auto& events = scratch->events;
+  auto& compressed_table = scratch->compressed_table;
+  auto& end_cols = scratch->compressed_table_end_cols;
+  auto& prev_row = scratch->prev_row_match_pairs;
+  auto& curr_row = scratch->curr_row_match_pairs;
+
+  typename BasicMatchEventsQueue<Pos>::Event event;
+
+  curr_row.clear();
+  size_t curr_continuation_index = 0;
+
+  while (events.PopEnd(row, &event)) {
+    Pos i = get<0>(event);
+    Pos j = get<1>(event);
+    assert(i == row);
+    auto& match_pair_end = get<2>(event);
+
+    if (lcsk_plus) { // LCSk++
+      while (curr_continuation_index < prev_row.size() &&
+             prev_row[curr_continuation_index]->end_col + 1 < match_pair_end->end_col) {
+        curr_continuation_index++;
+      }
+
+      const BasicMatchPair<Pos>* continued = nullptr;
+      if (curr_continuation_index < prev_row.size() &&
+          prev_row[curr_continuation_index]->end_col + 1 == match_pair_end->end_col) {
+        const auto& prev_pair = prev_row[curr_continuation_index];
+        Pos continuation_dp = prev_pair->dp + 1;
+        if (continuation_dp >= match_pair_end->dp) {
+          match_pair_end->dp = continuation_dp;
+          // Extends the run of the continued match pair, if any, instead of
+          // linking to it, so that it is released once it leaves prev_row.
+          if (prev_pair->run > 0) {
+            match_pair_end->run = prev_pair->run + 1;
+            match_pair_end->prev = prev_pair->prev;
+          } else {
+            match_pair_end->run = 1;
+            match_pair_end->prev = prev_pair;
+          }
+          continued = prev_pair.get();
+        }
+      }
+
+      curr_row.push_back(match_pair_end);
+
+      Pos dp = match_pair_end->dp;
+      while (compressed_table.size() <= dp) {
+        // fill with dummy values which will be overwritten in for loop below anyway.
+        Pos idx = compressed_table.size();
+        compressed_table.push_back(
+            MakeMatchPair<Pos>(scratch->pool(), i + 1, j + 1, idx, nullptr));
+        end_cols.push_back(j + 1);
+      }
+
+      for (Pos idx = dp; idx > dp - k && j < end_cols[idx]; --idx) {
+        compressed_table[idx] = match_pair_end;
+        end_cols[idx] = j;
+      }
+
+      // The entry of the continued match pair is covered by the run from now
+      // on, so that the continued match pair is released once it leaves
+      // prev_row.
+      if (continued != nullptr && compressed_table[dp - 1].get() == continued &&
+          end_cols[dp - 1] == j - 1) {
+        compressed_table[dp - 1] = match_pair_end->prev;
+      }
+    } else { // LCSk
+      Pos idx = match_pair_end->dp / k;
+      if (idx == compressed_table.size()) {
+        compressed_table.emplace_back(match_pair_end);
+        end_cols.push_back(j);
+      } else if (j < end_cols[idx]) {
+        compressed_table[idx] = match_pair_end;
+        end_cols[idx] = j;
+      }
+    }
+  }
+
+  prev_row.swap(curr_row);
+}
+
+// Answers the num_begin_events begin events of the row, picking whichever of
+// the two query strategies is expected to be faster.
+template <typename Pos>
+void RowQuery(const int k, const Pos row, const size_t num_begin_events,
+              BasicSweepScratch<Pos>* scratch) {
+  size_t table_row_size = scratch->compressed_table.size();
+  bool use_amortized_row_update = (table_row_size + num_begin_events <
+                                   6 * num_begin_events * log(table_row_size) / log(2));
+
+  if (use_amortized_row_update) {
+    AmortizedRowQuery(k, row, scratch);
+  } else {
+    ElementwiseRowQuery(k, row, scratch);
+  }
+}
+
+template <typename Pos>
+BasicRowSweeper<Pos>::BasicRowSweeper(int k, bool lcsk_plus)
+    : BasicRowSweeper(k, lcsk_plus, nullptr) {}
+
+template <typename Pos>
+BasicRowSweeper<Pos>::BasicRowSweeper(int k, bool lcsk_plus,
+                                      BasicSweepScratch<Pos>* scratch)
+    : k_(k), lcsk_plus_(lcsk_plus), next_row_(0), scratch_(scratch) {
+  if (scratch_ == nullptr) {
+    own_scratch_.reset(new BasicSweepScratch<Pos>());
+    scratch_ = own_scratch_.get();
+  }
+  scratch_->Reset();
+  scratch_->compressed_table.push_back(
+      MakeMatchPair<Pos>(scratch_->pool(), -1, -1, 0, nullptr));
+  scratch_->compressed_table_end_cols.push_back(-1);
+}
+
+template <typename Pos>
+BasicRowSweeper<Pos>::~BasicRowSweeper() {
+  // Returns the match pairs to the pool right away.
+  scratch_->Reset();
+}
+
+template <typename Pos>
+void BasicRowSweeper<Pos>::ProcessRow(Pos row,
+                                      const std::vector<Pos>& row_matches) {
+  assert(row == next_row_);
+  for (Pos col : row_matches) {
+    scratch_->events.AddBegin(make_tuple(row, col, nullptr));
+  }
+
+  RowQuery(k_, row, row_matches.size(), scratch_);
+  RowUpdate(k_, row, scratch_, lcsk_plus_);
+  ++next_row_;
+}
+
+template <typename Pos>
+Pos BasicRowSweeper<Pos>::BestLength() const {
+  const Pos last_index = scratch_->compressed_table.size() - 1;
+  return lcsk_plus_ ? last_index : k_ * last_index;
+}
+
+template <typename Pos>
+void BasicRowSweeper<Pos>::Reconstruct(
+    std::vector<std::pair<Pos, Pos>>* lcsk_reconstruction) const {
+  const auto& table = scratch_->compressed_table;
+  auto best = table.back()->end_row != -1 ? table.back() : nullptr;
+  FillLcskReconstruction(k_, best, lcsk_reconstruction);
+}
+
+#define INSTANTIATE_ROW_SWEEPER(Pos)                                         \
+  template void FillLcskReconstruction(                                      \
+      const int, std::shared_ptr<BasicMatchPair<Pos>>,                       \
+      std::vector<std::pair<Pos, Pos>>*);                                    \
+  template void RowQuery(const int, const Pos, const size_t,                 \
+                         BasicSweepScratch<Pos>*);                           \
+  template void RowUpdate(const int, const Pos, BasicSweepScratch<Pos>*,     \
+                          bool);                                             \
+  template class BasicRowSweeper<Pos>;
+
+INSTANTIATE_ROW_SWEEPER(int16_t)
+INSTANTIATE_ROW_SWEEPER(int32_t)
+INSTANTIATE_ROW_SWEEPER(int64_t)
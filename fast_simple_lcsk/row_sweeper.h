@@ -0,0 +1,153 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ROW_SWEEPER
+#define ROW_SWEEPER
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "match_events_queue.h"
+#include "match_pair.h"
+#include "match_pair_pool.h"
+#include "memory_policy.h"
+
+// The steps of the row-by-row sweep shared by all LCSk/LCSk++ engines.
+//
+// The compressed table holds, for every achievable dp value, the match pair
+// with the smallest end column among those reaching it, so that
+// compressed_table[i]->dp == i for LCSk++ and compressed_table[i]->dp == k*i
+// for LCSk. Entry 0 is a dummy match pair ending at (-1, -1). The end columns
+// of the entries are kept apart in compressed_table_end_cols: for LCSk++, the
+// entries inside a run of continuations (see BasicMatchPair::run) are held by
+// the match pair preceding the run and end further right, so that the match
+// pairs inside the run can be released; they are cut out of the run again
+// when a query needs them.
+
+// Working memory of a sweep: the buffers keep their capacity from row to row
+// and, if the scratch is reused by the next sweep, from one sweep to the next,
+// so that once they have grown to the size of the problem the sweep does not
+// allocate at all. A scratch can only be used by one sweep at a time.
+template <typename Pos>
+struct BasicSweepScratch {
+  typedef std::shared_ptr<BasicMatchPair<Pos>> MatchPairPtr;
+
+  // Match pairs are allocated from the pool of the scratch; see
+  // MatchPairPool.
+  BasicSweepScratch() : pool_match_pairs(true) {}
+  // If pool_match_pairs is false, match pairs are allocated with make_shared
+  // instead, e.g. because they are handed over to other threads.
+  explicit BasicSweepScratch(bool pool_match_pairs)
+      : pool_match_pairs(pool_match_pairs) {}
+  // Pools the match pairs in memory allocated according to policy.
+  explicit BasicSweepScratch(const MemoryPolicy& policy)
+      : arena(policy.IsDefault() ? nullptr : new MemoryArena(policy)),
+        match_pair_pool(arena.get()),
+        pool_match_pairs(true) {}
+
+  MatchPairPool* pool() {
+    return pool_match_pairs ? &match_pair_pool : nullptr;
+  }
+
+  // Releases the state of the previous sweep, keeping the capacity.
+  void Reset() {
+    events.Clear();
+    compressed_table.clear();
+    compressed_table_end_cols.clear();
+    prev_row_match_pairs.clear();
+    curr_row_match_pairs.clear();
+    row_matches.clear();
+  }
+
+  // Declared first, so that they outlive the match pairs held below. arena is
+  // nullptr for the default memory policy.
+  std::unique_ptr<MemoryArena> arena;
+  MatchPairPool match_pair_pool;
+  const bool pool_match_pairs;
+
+  BasicMatchEventsQueue<Pos> events;
+  std::vector<MatchPairPtr> compressed_table;
+  std::vector<Pos> compressed_table_end_cols;
+  // For LCSk++, the match pairs which ended in the previous row, sorted by
+  // column, and those ending in the current row.
+  std::vector<MatchPairPtr> prev_row_match_pairs;
+  std::vector<MatchPairPtr> curr_row_match_pairs;
+  // Buffer for the k-mer matches of a row, for the callers of the sweep.
+  std::vector<Pos> row_matches;
+};
+
+typedef BasicSweepScratch<int> SweepScratch;
+
+// Fills lcsk_recon with the characters of the chain of match pairs ending with
+// best (nullptr for an empty chain).
+template <typename Pos>
+void FillLcskReconstruction(const int k,
+                            std::shared_ptr<BasicMatchPair<Pos>> best,
+                            std::vector<std::pair<Pos, Pos>>* lcsk_recon);
+
+// Answers the begin events of the row in scratch->events, creating an end
+// event for each of them whose match pair continues the best chain of
+// scratch->compressed_table ending strictly left of and above it.
+template <typename Pos>
+void RowQuery(const int k, const Pos row, const size_t num_begin_events,
+              BasicSweepScratch<Pos>* scratch);
+
+// Processes the end events of the row, updating the compressed table. For
+// LCSk++, scratch->prev_row_match_pairs holds the match pairs which ended in
+// the previous row and is replaced with those ending in this row.
+template <typename Pos>
+void RowUpdate(const int k, const Pos row, BasicSweepScratch<Pos>* scratch,
+               bool lcsk_plus);
+
+// Incremental form of the sweep: the k-mer matches of the rows of a are pushed
+// one row at a time, starting from row 0 and without skipping any row.
+//
+// The sweep is instantiated for int16_t, int32_t and int64_t positions; see
+// BasicMatchPair.
+template <typename Pos>
+class BasicRowSweeper {
+ public:
+  BasicRowSweeper(int k, bool lcsk_plus);
+  // Sweeps in the given scratch, which has to outlive the sweeper. Reusing a
+  // scratch across sweeps avoids growing the buffers again for every sweep.
+  BasicRowSweeper(int k, bool lcsk_plus, BasicSweepScratch<Pos>* scratch);
+  BasicRowSweeper(const BasicRowSweeper&) = delete;
+  BasicRowSweeper& operator=(const BasicRowSweeper&) = delete;
+  ~BasicRowSweeper();
+
+  // Sweeps the next row, in which match pairs begin at the given (increasing)
+  // columns.
+  void ProcessRow(Pos row, const std::vector<Pos>& row_matches);
+
+  // Length (in characters) of the best LCSk/LCSk++ among the match pairs which
+  // ended in the rows processed so far.
+  Pos BestLength() const;
+
+  // Fills lcsk_reconstruction with the best LCSk/LCSk++ found so far.
+  void Reconstruct(std::vector<std::pair<Pos, Pos>>* lcsk_reconstruction) const;
+
+ private:
+  int k_;
+  bool lcsk_plus_;
+  Pos next_row_;
+
+  std::unique_ptr<BasicSweepScratch<Pos>> own_scratch_;
+  BasicSweepScratch<Pos>* scratch_;
+};
+
+typedef BasicRowSweeper<int> RowSweeper;
+
+#endif
@@ -0,0 +1,165 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <cassert>
+
+#include "lcsk.h"
+#include "row_sweeper.h"
+#include "similarity_profile.h"
+
+using namespace std;
+
+namespace {
+
+const int kMaxWindowsPerGroup = 16;
+
+// The k-mer matches of the rows of a[begin, end), looked up in order of row.
+// Only the last capacity rows looked up are kept, which is enough for windows
+// of up to capacity rows requested in order of position.
+class RowMatchCache {
+ public:
+  RowMatchCache(const ReferenceIndex& index, const string& a, int begin,
+                int end, int capacity)
+      : substring_(a, begin, end - begin),
+        match_maker_(index, substring_),
+        begin_(begin),
+        num_rows_looked_up_(0),
+        rows_(capacity) {}
+
+  // The matches of row of a, which must not be more than capacity rows before
+  // the last row requested.
+  const vector<int>& Row(int row) {
+    const int offset = row - begin_;
+    assert(offset > num_rows_looked_up_ - (int)rows_.size() - 1);
+    for (; num_rows_looked_up_ <= offset; ++num_rows_looked_up_) {
+      match_maker_.GetNextMatches(&rows_[num_rows_looked_up_ % rows_.size()]);
+    }
+    return rows_[offset % rows_.size()];
+  }
+
+ private:
+  // Declared before match_maker_, which refers to it.
+  string substring_;
+  ReferenceMatchMaker match_maker_;
+  int begin_;
+  int num_rows_looked_up_;
+  vector<vector<int>> rows_;
+};
+
+// MatchMaker of a window of a, replaying the rows of a RowMatchCache.
+class WindowMatchMaker : public MatchMaker {
+ public:
+  WindowMatchMaker(RowMatchCache* cache, int begin, int num_rows)
+      : cache_(cache), begin_(begin), num_rows_(num_rows), row_(0) {}
+
+  bool GetNextMatches(std::vector<int>* matches) override {
+    matches->clear();
+    // Are there more matches to generate?
+    if (row_ >= num_rows_) return false;
+    const vector<int>& row_matches = cache_->Row(begin_ + row_);
+    matches->assign(row_matches.begin(), row_matches.end());
+    ++row_;  // Not forgetting to update this!
+    return true;
+  }
+
+ private:
+  RowMatchCache* cache_;
+  int begin_;
+  int num_rows_;
+  int row_;
+};
+
+}  // namespace
+
+void SimilarityProfile(const ReferenceIndex& index, const std::string& a,
+                       const ProfileOptions& options,
+                       const std::function<void(const ProfileWindow&)>& emit) {
+  assert(options.window_size > 0 && options.stride > 0);
+  const int k = index.k();
+  vector<ProfileWindow> windows;
+  for (int begin = 0;; begin += options.stride) {
+    const int end = min<int64_t>((int64_t)begin + options.window_size,
+                                 a.size());
+    windows.push_back(ProfileWindow{begin, end, 0});
+    if (end == (int)a.size() || begin + options.stride >= (int64_t)a.size()) {
+      break;
+    }
+  }
+
+  const int num_threads = max(1, options.num_threads);
+  const int num_windows = windows.size();
+  const int group_size = max(
+      1, min(kMaxWindowsPerGroup,
+             (num_windows + num_threads - 1) / num_threads));
+  const int num_groups = (num_windows + group_size - 1) / group_size;
+  const int max_window_rows = max(1, options.window_size - k + 1);
+
+  atomic<int> next_group(0);
+  mutex emit_mutex;
+  vector<bool> done(num_windows, false);
+  int next_to_emit = 0;
+
+  auto worker = [&]() {
+    // Reused by all the windows of the thread.
+    SweepScratch scratch;
+    vector<pair<int, int>> recon;
+    for (int group; (group = next_group++) < num_groups;) {
+      const int first = group * group_size;
+      const int last = min(num_windows, first + group_size);
+      RowMatchCache cache(index, a, windows[first].begin,
+                          windows[last - 1].end, max_window_rows);
+      for (int w = first; w < last; ++w) {
+        ProfileWindow& window = windows[w];
+        const int size = window.end - window.begin;
+        WindowMatchMaker match_maker(&cache, window.begin,
+                                     max(0, size - k + 1));
+        LcsKSparseFastWithMatchMaker(&match_maker, size, index.size(), k,
+                                     options.lcsk_plus, -1, false, &recon,
+                                     nullptr, &scratch);
+        window.score = recon.size();
+
+        // Emits the windows done so far without a gap before them.
+        lock_guard<mutex> lock(emit_mutex);
+        done[w] = true;
+        for (; next_to_emit < num_windows && done[next_to_emit];
+             ++next_to_emit) {
+          emit(windows[next_to_emit]);
+        }
+      }
+    }
+  };
+
+  vector<thread> threads;
+  for (int t = 1; t < num_threads; ++t) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+void WriteSimilarityProfile(const ReferenceIndex& index, const std::string& a,
+                            const ProfileOptions& options, std::ostream& out) {
+  SimilarityProfile(index, a, options, [&out](const ProfileWindow& window) {
+    out << window.begin << " " << window.end << " " << window.score << "\n";
+  });
+  out.flush();
+}
@@ -0,0 +1,60 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SIMILARITY_PROFILE
+#define SIMILARITY_PROFILE
+
+#include <functional>
+#include <ostream>
+#include <string>
+
+#include "match_maker.h"
+
+// A window a[begin, end) of the profiled string and its LCSk/LCSkpp with b.
+struct ProfileWindow {
+  int begin;
+  int end;
+  int score;
+};
+
+struct ProfileOptions {
+  // The windows start every stride characters of a, up to the first one
+  // reaching the end of a, and are window_size characters long, except that
+  // the last one is cut at the end of a.
+  int window_size = 100000;
+  int stride = 10000;
+  // Computes LCSkpp if set and LCSk otherwise.
+  bool lcsk_plus = true;
+  int num_threads = 1;
+};
+
+// Computes the similarity profile of a along b, i.e. LCSk/LCSkpp of every
+// window of a with the reference b of index, calling emit for the windows in
+// order of position as soon as they and all windows before them are done.
+// emit is called by one thread at a time, from any of the threads.
+//
+// All windows share the index of b. The windows are split into groups of
+// consecutive windows, which the threads take in turn; the thread looking up
+// the rows of a group keeps the k-mer matches of the rows shared by
+// overlapping windows, so every row of a is looked up once per group rather
+// than once per window covering it.
+void SimilarityProfile(const ReferenceIndex& index, const std::string& a,
+                       const ProfileOptions& options,
+                       const std::function<void(const ProfileWindow&)>& emit);
+
+// Same as above, writing one "begin end score" line per window into out.
+void WriteSimilarityProfile(const ReferenceIndex& index, const std::string& a,
+                            const ProfileOptions& options, std::ostream& out);
+
+#endif
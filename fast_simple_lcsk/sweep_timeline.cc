@@ -0,0 +1,102 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/stat.h>
+
+#include "sweep_timeline.h"
+
+using namespace std;
+
+namespace {
+
+const char kTimelineMagic[] = "LCSKTML1";
+const size_t kTimelineMagicSize = sizeof(kTimelineMagic) - 1;
+const int kFieldsPerSample = 6;
+
+static_assert(sizeof(TimelineSample) == kFieldsPerSample * sizeof(int64_t),
+              "samples are written as they are laid out in memory");
+
+const int64_t kTimelineHeaderBytes =
+    kTimelineMagicSize + sizeof(int32_t) + sizeof(int64_t);
+
+}  // namespace
+
+SweepTimeline::SweepTimeline(int sample_every_rows)
+    : sample_every_rows_(sample_every_rows) {
+  assert(sample_every_rows > 0);
+}
+
+void SweepTimeline::WriteCsv(std::ostream& out) const {
+  out << "row,match_pairs_alive,compressed_table_size,begin_events,"
+         "end_events,elapsed_ns\n";
+  for (const auto& sample : samples_) {
+    out << sample.row << "," << sample.match_pairs_alive << ","
+        << sample.compressed_table_size << "," << sample.begin_events << ","
+        << sample.end_events << "," << sample.elapsed_ns << "\n";
+  }
+}
+
+bool SweepTimeline::WriteBinary(const std::string& path) const {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr) return false;
+  const int32_t sample_every_rows = sample_every_rows_;
+  const int64_t num_samples = samples_.size();
+  bool ok =
+      fwrite(kTimelineMagic, 1, kTimelineMagicSize, file) ==
+          kTimelineMagicSize &&
+      fwrite(&sample_every_rows, sizeof(sample_every_rows), 1, file) == 1 &&
+      fwrite(&num_samples, sizeof(num_samples), 1, file) == 1 &&
+      fwrite(samples_.data(), sizeof(TimelineSample), samples_.size(),
+             file) == samples_.size();
+  ok = fclose(file) == 0 && ok;
+  return ok;
+}
+
+bool SweepTimeline::ReadBinary(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) return false;
+  char magic[kTimelineMagicSize];
+  int32_t sample_every_rows = 0;
+  int64_t num_samples = -1;
+  // The number of samples is checked against the size of the file before
+  // allocating them, so that a corrupt header cannot request any amount of
+  // memory.
+  struct stat info;
+  bool ok = fread(magic, 1, kTimelineMagicSize, file) == kTimelineMagicSize &&
+            memcmp(magic, kTimelineMagic, kTimelineMagicSize) == 0 &&
+            fread(&sample_every_rows, sizeof(sample_every_rows), 1, file) ==
+                1 &&
+            fread(&num_samples, sizeof(num_samples), 1, file) == 1 &&
+            fstat(fileno(file), &info) == 0 && sample_every_rows > 0 &&
+            num_samples >= 0 &&
+            num_samples <= info.st_size / (int64_t)sizeof(TimelineSample) &&
+            kTimelineHeaderBytes + num_samples * sizeof(TimelineSample) ==
+                (uint64_t)info.st_size;
+  vector<TimelineSample> samples;
+  if (ok) {
+    samples.resize(num_samples);
+    ok = fread(samples.data(), sizeof(TimelineSample), samples.size(),
+               file) == samples.size() &&
+         fgetc(file) == EOF;
+  }
+  fclose(file);
+  if (!ok) return false;
+  sample_every_rows_ = sample_every_rows;
+  samples_.swap(samples);
+  return true;
+}
@@ -0,0 +1,74 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SWEEP_TIMELINE
+#define SWEEP_TIMELINE
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// The state of a sweep after an interval of rows, and the work done in it.
+struct TimelineSample {
+  // The interval ends before this row.
+  int64_t row;
+  // Match pairs created by the sweep and alive at the end of the interval (in
+  // the compressed table, the event queues and the chains they hold), as
+  // counted by ObjectCounter<MatchPair>, which also counts those of
+  // comparisons running concurrently in other threads.
+  int64_t match_pairs_alive;
+  // Entries of the compressed table, i.e. the best length so far (divided by
+  // k for LCSk) plus one.
+  int64_t compressed_table_size;
+  // Begin events (k-mer matches) and end events processed in the interval.
+  int64_t begin_events;
+  int64_t end_events;
+  // Time spent in the interval, including getting the matches of its rows.
+  int64_t elapsed_ns;
+};
+
+// Timeline of a sweep, sampled every sample_every_rows rows and after the last
+// row, for locating the regions of the swept string where the matches and the
+// memory of a comparison explode. Sampling costs a clock read every
+// sample_every_rows rows and a few additions per row.
+//
+// A binary timeline file starts with the magic "LCSKTML1" followed by
+// sample_every_rows as an int32 and the number of samples as an int64, and
+// then holds the fields of every sample as int64, all in native byte order.
+class SweepTimeline {
+ public:
+  explicit SweepTimeline(int sample_every_rows);
+
+  int sample_every_rows() const { return sample_every_rows_; }
+  const std::vector<TimelineSample>& samples() const { return samples_; }
+
+  void Clear() { samples_.clear(); }
+  void Add(const TimelineSample& sample) { samples_.push_back(sample); }
+
+  // Writes a header line and one line per sample, with the fields in order.
+  void WriteCsv(std::ostream& out) const;
+
+  // Writes and reads a binary timeline file. Return false on failure, e.g.
+  // if the number of samples in the header does not match the size of the
+  // file, leaving the timeline as it was.
+  bool WriteBinary(const std::string& path) const;
+  bool ReadBinary(const std::string& path);
+
+ private:
+  int sample_every_rows_;
+  std::vector<TimelineSample> samples_;
+};
+
+#endif
@@ -0,0 +1,90 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "fast_simple_lcsk/partitioned_index.h"
+#include "util/sequence_reader.h"
+
+using namespace std;
+
+int Build(int k, int prefix_length, const char* reference, const char* path) {
+  string B;
+  if (!ReadSequenceFile(reference, /*acgt_only=*/false, &B)) {
+    fprintf(stderr, "Cannot read %s\n", reference);
+    return 1;
+  }
+  if (B.size() > (size_t)numeric_limits<int32_t>::max()) {
+    fprintf(stderr, "%s is longer than 2^31 - 1 characters\n", reference);
+    return 1;
+  }
+  if (!BuildPartitionedIndex(B, k, prefix_length, path)) {
+    fprintf(stderr, "Cannot write the index at %s\n", path);
+    return 1;
+  }
+  printf("Indexed %lld characters\n", (long long)B.size());
+  return 0;
+}
+
+int Compare(bool lcsk_plus, const char* path, const char* query,
+            const char* scratch_path) {
+  string A;
+  if (!ReadSequenceFile(query, /*acgt_only=*/false, &A)) {
+    fprintf(stderr, "Cannot read %s\n", query);
+    return 1;
+  }
+  if (A.size() > (size_t)numeric_limits<int>::max()) {
+    fprintf(stderr, "%s is longer than 2^31 - 1 characters\n", query);
+    return 1;
+  }
+  vector<pair<int, int>> recon;
+  if (!LcsKSparseOutOfCore(A, path, scratch_path, lcsk_plus, &recon)) {
+    fprintf(stderr, "Cannot read the index at %s or write %s\n", path,
+            scratch_path);
+    return 1;
+  }
+  printf("%s length: %lld\n", lcsk_plus ? "LCSk++" : "LCSk",
+         (long long)recon.size());
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  const string mode = argc > 1 ? argv[1] : "";
+  if (!(mode == "build" && argc == 6) && !(mode == "compare" && argc == 6)) {
+    printf(
+      "Build an on-disk k-mer index of a reference too large for an index in\n"
+      "memory, and compare queries against it. Only k-mers over A, C, G and\n"
+      "T are matched, and k must be at most 32.\n\n"
+      "Usage: ./lcsk_index build k prefix_length reference index\n"
+      "       ./lcsk_index compare lcsk|lcskpp index query scratch\n\n"
+      "Example: ./lcsk_index build 20 4 chr1.fa.gz chr1.idx\n"
+      "writes the 20-mers of `chr1.fa.gz` into `chr1.idx` and 256 partition\n"
+      "files `chr1.idx.<p>`, by their first 4 bases;\n"
+      "./lcsk_index compare lcskpp chr1.idx query.fa /tmp/query.matches\n"
+      "computes LCS20++ of `query.fa` and the reference, sorting the matches\n"
+      "in the scratch file `/tmp/query.matches` (the 20-mers of the query\n"
+      "are partitioned into `/tmp/query.matches.kmers.<p>` meanwhile)\n"
+    );
+    return 0;
+  };
+
+  if (mode == "build") {
+    return Build(stoi(argv[2]), stoi(argv[3]), argv[4], argv[5]);
+  }
+  return Compare(string(argv[2]) == "lcskpp", argv[3], argv[4], argv[5]);
+}
@@ -0,0 +1,65 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "fast_simple_lcsk/match_maker.h"
+#include "fast_simple_lcsk/similarity_profile.h"
+#include "util/sequence_reader.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+  if (argc != 8) {
+    printf(
+      "Compute the LCSk++ similarity profile of a sequence along a\n"
+      "reference: LCSk++ of every window of the sequence with the\n"
+      "reference, written as one \"begin end score\" line per window.\n\n"
+      "Usage: ./lcsk_profile k window stride threads sequence reference "
+      "output\n\n"
+      "Example: ./lcsk_profile 20 100000 10000 8 a.fa.gz b.fa.gz a_b.profile\n"
+      "computes LCS20++ of the 100 kbp windows of `a.fa.gz` starting every\n"
+      "10 kbp with `b.fa.gz` on 8 threads and writes them to `a_b.profile`\n"
+    );
+    return 0;
+  };
+
+  const int k = stoi(argv[1]);
+  ProfileOptions options;
+  options.window_size = stoi(argv[2]);
+  options.stride = stoi(argv[3]);
+  options.num_threads = stoi(argv[4]);
+  if (options.window_size <= 0 || options.stride <= 0) {
+    fprintf(stderr, "The window and the stride have to be positive\n");
+    return 1;
+  }
+  string A;
+  string B;
+  if (!ReadSequenceFile(argv[5], /*acgt_only=*/false, &A) ||
+      !ReadSequenceFile(argv[6], /*acgt_only=*/false, &B)) {
+    fprintf(stderr, "Cannot read the inputs\n");
+    return 1;
+  }
+
+  ofstream out(argv[7]);
+  if (!out) {
+    fprintf(stderr, "Cannot write %s\n", argv[7]);
+    return 1;
+  }
+  ReferenceIndex index(B, k);
+  WriteSimilarityProfile(index, A, options, out);
+  return out ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <csignal>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "fast_simple_lcsk/comparison_server.h"
+#include "util/sequence_reader.h"
+
+using namespace std;
+
+ComparisonServer* server = nullptr;
+
+void HandleSignal(int) {
+  if (server != nullptr) server->Stop();
+}
+
+void PrintLatencyStats(const LatencyStats& stats) {
+  printf("Requests: %lld\n", (long long)stats.num_requests);
+  printf("Latency (us): p50=%lld p90=%lld p99=%lld max=%lld\n",
+         (long long)stats.p50_us, (long long)stats.p90_us,
+         (long long)stats.p99_us, (long long)stats.max_us);
+}
+
+int main(int argc, char** argv) {
+  const string mode = argc > 1 ? argv[1] : "";
+  if (!(mode == "serve" && argc >= 6) && !(mode == "query" && argc == 5) &&
+      !(mode == "stats" && argc == 3)) {
+    printf(
+      "Answer LCSk++ queries against references indexed once.\n\n"
+      "Usage: ./lcsk_server serve k num_threads socket reference...\n"
+      "       ./lcsk_server query socket reference_id input\n"
+      "       ./lcsk_server stats socket\n\n"
+      "Example: ./lcsk_server serve 10 8 /tmp/lcsk.sock ref.fa.gz\n"
+      "indexes the 10-mers of `ref.fa.gz` and serves queries on\n"
+      "`/tmp/lcsk.sock` with 8 threads until interrupted, then prints the\n"
+      "request latency percentiles;\n"
+      "./lcsk_server query /tmp/lcsk.sock 0 read.fa prints LCS10++ of\n"
+      "`read.fa` and `ref.fa.gz`\n"
+    );
+    return 0;
+  };
+
+  if (mode == "serve") {
+    const int k = stoi(argv[2]);
+    const int num_threads = stoi(argv[3]);
+    vector<string> references(argc - 5);
+    for (int i = 5; i < argc; ++i) {
+      if (!ReadSequenceFile(argv[i], /*acgt_only=*/false,
+                            &references[i - 5])) {
+        fprintf(stderr, "Cannot read %s\n", argv[i]);
+        return 1;
+      }
+    }
+
+    ComparisonServer comparison_server(references, k, num_threads);
+    references.clear();
+    if (!comparison_server.Start(argv[4])) {
+      fprintf(stderr, "Cannot listen on %s\n", argv[4]);
+      return 1;
+    }
+    server = &comparison_server;
+    signal(SIGINT, HandleSignal);
+    signal(SIGTERM, HandleSignal);
+    printf("Serving %d references on %s\n", argc - 5, argv[4]);
+    fflush(stdout);
+    comparison_server.Run();
+    PrintLatencyStats(comparison_server.GetLatencyStats());
+    return 0;
+  }
+
+  ComparisonClient client;
+  if (!client.Connect(argv[2])) {
+    fprintf(stderr, "Cannot connect to %s\n", argv[2]);
+    return 1;
+  }
+  if (mode == "stats") {
+    LatencyStats stats;
+    if (!client.GetLatencyStats(&stats)) return 1;
+    PrintLatencyStats(stats);
+    return 0;
+  }
+
+  string query;
+  if (!ReadSequenceFile(argv[4], /*acgt_only=*/false, &query)) {
+    fprintf(stderr, "Cannot read %s\n", argv[4]);
+    return 1;
+  }
+  int64_t length = 0;
+  if (!client.Compare(stoi(argv[3]), query, /*lcsk_plus=*/true, &length,
+                      nullptr)) {
+    fprintf(stderr, "Query failed\n");
+    return 1;
+  }
+  printf("LCSk++ length: %lld\n", (long long)length);
+  return 0;
+}
@@ -0,0 +1,111 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "fast_simple_lcsk/lcsk.h"
+#include "fast_simple_lcsk/match_maker.h"
+#include "fast_simple_lcsk/match_trace.h"
+#include "fast_simple_lcsk/row_sweeper.h"
+#include "util/sequence_reader.h"
+
+using namespace std;
+
+int Record(int k, const char* input1, const char* input2, const char* path) {
+  string A;
+  string B;
+  if (!ReadSequenceFile(input1, /*acgt_only=*/false, &A) ||
+      !ReadSequenceFile(input2, /*acgt_only=*/false, &B)) {
+    fprintf(stderr, "Cannot read the inputs\n");
+    return 1;
+  }
+
+  auto match_maker =
+      MatchMaker::Create(A, B, k, FastestMatchMakerType(A, B, k));
+  MatchTraceRecorder recorder(match_maker.get(), k, A.size(), B.size(), path);
+  vector<pair<int, int>> recon;
+  LcsKSparseFastWithMatchMaker(&recorder, A.size(), B.size(), k,
+                               /*lcsk_plus=*/true, -1, false, &recon, nullptr);
+  if (!recorder.Close()) {
+    fprintf(stderr, "Cannot write %s\n", path);
+    return 1;
+  }
+  printf("LCSk++ length: %lld\n", (long long)recon.size());
+  return 0;
+}
+
+int Replay(const char* path, bool lcsk_plus, int repetitions) {
+  MatchTrace trace;
+  if (!trace.Load(path)) {
+    fprintf(stderr, "Cannot load %s\n", path);
+    return 1;
+  }
+  printf("k=%d |a|=%d |b|=%d rows=%lld matches=%lld\n", trace.k(),
+         trace.a_size(), trace.b_size(), (long long)trace.num_rows(),
+         (long long)trace.num_matches());
+
+  // The scratch is reused, so that only the first repetition pays for growing
+  // the buffers.
+  SweepScratch scratch;
+  vector<pair<int, int>> recon;
+  vector<double> seconds;
+  for (int r = 0; r < repetitions; ++r) {
+    TraceMatchMaker match_maker(trace);
+    const auto start = chrono::steady_clock::now();
+    LcsKSparseFastWithMatchMaker(&match_maker, trace.a_size(), trace.b_size(),
+                                 trace.k(), lcsk_plus, -1, false, &recon,
+                                 nullptr, &scratch);
+    seconds.push_back(chrono::duration<double>(chrono::steady_clock::now() -
+                                               start).count());
+  }
+
+  sort(seconds.begin(), seconds.end());
+  const double median = seconds[seconds.size() / 2];
+  printf("%s length: %lld\n", lcsk_plus ? "LCSk++" : "LCSk",
+         (long long)recon.size());
+  printf("Sweep time (ms): min=%.3f median=%.3f max=%.3f\n",
+         seconds.front() * 1e3, median * 1e3, seconds.back() * 1e3);
+  printf("Throughput (median): %.1f Mrows/s, %.1f Mmatches/s\n",
+         trace.num_rows() / median / 1e6, trace.num_matches() / median / 1e6);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  const string mode = argc > 1 ? argv[1] : "";
+  if (!(mode == "record" && argc == 6) &&
+      !(mode == "replay" && (argc == 4 || argc == 5))) {
+    printf(
+      "Record the k-mer matches of a comparison into a trace file, and\n"
+      "benchmark the LCSk/LCSk++ sweep on its own by replaying a trace.\n\n"
+      "Usage: ./lcsk_trace record k input1 input2 trace\n"
+      "       ./lcsk_trace replay lcsk|lcskpp trace [repetitions]\n\n"
+      "Example: ./lcsk_trace record 10 a.fa.gz b.fa.gz ab.trace\n"
+      "records the 10-mer matches of `a.fa.gz` and `b.fa.gz` while computing\n"
+      "their LCS10++;\n"
+      "./lcsk_trace replay lcskpp ab.trace 20 sweeps them 20 times and\n"
+      "prints the sweep time, without hashing the inputs\n"
+    );
+    return 0;
+  };
+
+  if (mode == "record") {
+    return Record(stoi(argv[2]), argv[3], argv[4], argv[5]);
+  }
+  return Replay(argv[3], string(argv[2]) == "lcskpp",
+                argc == 5 ? max(1, stoi(argv[4])) : 10);
+}
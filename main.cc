@@ -17,13 +17,16 @@
 
 #include "fast_simple_lcsk/lcsk.h"
 #include "fast_simple_lcsk/match_pair.h"
+#include "util/sequence_reader.h"
 
 using namespace std;
 
 int main(int argc, char** argv) {
   if (argc != 5) {
     printf(
-      "Compute LCSk++ of two plain texts.\n\n"
+      "Compute LCSk++ of two sequences. Inputs are plain texts (of which\n"
+      "the first line is used) or FASTA/FASTQ files (all records are\n"
+      "concatenated), optionally gzip-compressed.\n\n"
       "Usage: ./main k input1 input2 output\n\n"
       "Example: ./main 4 test/tests/test.1.A test/tests/test.1.B out\n"
       "finds LCS4++ of files `test/tests/test.1.A` and `test/tests/test.1.B`\n"
@@ -34,25 +37,26 @@ int main(int argc, char** argv) {
 
 
   int k = stoi(argv[1]);
-  ifstream infile1(argv[2]);
   string A;
-  getline(infile1, A);
-
-  ifstream infile2(argv[3]);
   string B;
-  getline(infile2, B);
+  for (int i = 2; i <= 3; ++i) {
+    if (!ReadSequenceFile(argv[i], /*acgt_only=*/false, i == 2 ? &A : &B)) {
+      fprintf(stderr, "Cannot read %s\n", argv[i]);
+      return 1;
+    }
+  }
 
-  printf("Sequence 1 length: %d\n", (int)A.size());
-  printf("Sequence 2 length: %d\n", (int)B.size());
+  printf("Sequence 1 length: %lld\n", (long long)A.size());
+  printf("Sequence 2 length: %lld\n", (long long)B.size());
   printf("Computing LCSk++..\n");
 
-  vector<pair<int, int>> recon;
+  vector<pair<int64_t, int64_t>> recon;
   LcsKppSparseFast(A, B, k, &recon);
-  int length = recon.size();
+  long long length = recon.size();
   
-  printf("LCSk++ length: %d\n", length);
-  cout << "MatchPairs created: " << ObjectCounter<MatchPair>::objects_created << endl;
-  cout << "Max Alive MatchPairs: " << ObjectCounter<MatchPair>::max_objects_alive << endl;
+  printf("LCSk++ length: %lld\n", length);
+  cout << "MatchPairs created: " << ObjectCounter<MatchPair>::objects_created.load() << endl;
+  cout << "Max Alive MatchPairs: " << ObjectCounter<MatchPair>::max_objects_alive.load() << endl;
 
   auto r = freopen(argv[4], "w", stdout);
   for (auto& p: recon) {
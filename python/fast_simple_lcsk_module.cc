@@ -0,0 +1,362 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Python extension module exposing the sparse LCSk/LCSk++ algorithms.
+//
+// The strings are taken from any object supporting the buffer protocol
+// (bytes, bytearray, memoryview, mmap, NumPy uint8 arrays...) and the
+// comparisons run with the GIL released, so Python threads calling into the
+// module compare in parallel. A reconstruction is returned as a
+// Reconstruction, which exports its pairs through the buffer protocol as an
+// (n, 2) int32 array: numpy.asarray(reconstruction) and
+// memoryview(reconstruction) wrap the pairs without copying them.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "fast_simple_lcsk/lcsk.h"
+
+using namespace std;
+
+namespace {
+
+struct Reconstruction {
+  PyObject_HEAD
+  vector<pair<int, int>>* pairs;
+  // Shape and strides of the exported buffer.
+  Py_ssize_t shape[2];
+  Py_ssize_t strides[2];
+};
+
+static_assert(sizeof(pair<int, int>) == 2 * sizeof(int),
+              "the pairs are exported as a contiguous (n, 2) array");
+
+void ReconstructionDealloc(PyObject* self) {
+  delete reinterpret_cast<Reconstruction*>(self)->pairs;
+  Py_TYPE(self)->tp_free(self);
+}
+
+Py_ssize_t ReconstructionLength(PyObject* self) {
+  return reinterpret_cast<Reconstruction*>(self)->pairs->size();
+}
+
+int ReconstructionGetBuffer(PyObject* self, Py_buffer* view, int flags) {
+  Reconstruction* r = reinterpret_cast<Reconstruction*>(self);
+  if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+    PyErr_SetString(PyExc_BufferError, "Reconstruction is read-only");
+    return -1;
+  }
+  r->shape[0] = r->pairs->size();
+  r->shape[1] = 2;
+  r->strides[0] = sizeof(pair<int, int>);
+  r->strides[1] = sizeof(int);
+  view->obj = self;
+  Py_INCREF(self);
+  view->buf = r->pairs->data();
+  view->len = r->pairs->size() * sizeof(pair<int, int>);
+  view->readonly = 1;
+  view->itemsize = sizeof(int);
+  view->format = (flags & PyBUF_FORMAT) ? const_cast<char*>("i") : nullptr;
+  // Without PyBUF_ND the consumer cannot be given the shape, and sees the
+  // pairs as a flat run of bytes.
+  view->ndim = (flags & PyBUF_ND) ? 2 : 1;
+  view->shape = (flags & PyBUF_ND) ? r->shape : nullptr;
+  view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? r->strides
+                                                            : nullptr;
+  view->suboffsets = nullptr;
+  view->internal = nullptr;
+  return 0;
+}
+
+PyObject* ReconstructionToList(PyObject* self, PyObject*) {
+  const vector<pair<int, int>>& pairs =
+      *reinterpret_cast<Reconstruction*>(self)->pairs;
+  PyObject* list = PyList_New(pairs.size());
+  if (list == nullptr) return nullptr;
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    PyObject* item = Py_BuildValue("(ii)", pairs[i].first, pairs[i].second);
+    if (item == nullptr) {
+      Py_DECREF(list);
+      return nullptr;
+    }
+    PyList_SET_ITEM(list, i, item);
+  }
+  return list;
+}
+
+PySequenceMethods reconstruction_as_sequence = {
+    ReconstructionLength,
+};
+
+PyBufferProcs reconstruction_as_buffer = {
+    ReconstructionGetBuffer,
+    nullptr,
+};
+
+PyMethodDef reconstruction_methods[] = {
+    {"tolist", ReconstructionToList, METH_NOARGS,
+     "Returns the pairs as a list of (i, j) tuples."},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+PyTypeObject reconstruction_type = {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+};
+
+// Wraps pairs, taking their ownership.
+PyObject* NewReconstruction(vector<pair<int, int>>* pairs) {
+  Reconstruction* r = PyObject_New(Reconstruction, &reconstruction_type);
+  if (r == nullptr) {
+    delete pairs;
+    return nullptr;
+  }
+  r->pairs = pairs;
+  return reinterpret_cast<PyObject*>(r);
+}
+
+// Outcome of a comparison, which runs without the GIL and so cannot raise the
+// Python exception itself.
+enum CompareStatus {
+  COMPARE_OK,
+  COMPARE_NO_MEMORY,
+  COMPARE_FAILED,
+};
+
+// Catches every exception of the engine, which would otherwise terminate the
+// interpreter when thrown without the GIL or in a worker thread.
+CompareStatus Compare(const Py_buffer& a, const Py_buffer& b, int k,
+                      bool lcsk_plus, vector<pair<int, int>>* recon) {
+  try {
+    const char* a_data = static_cast<const char*>(a.buf);
+    const char* b_data = static_cast<const char*>(b.buf);
+    if (lcsk_plus) {
+      LcsKppSparseFast(a_data, a.len, b_data, b.len, k, recon);
+    } else {
+      LcsKSparseFast(a_data, a.len, b_data, b.len, k, recon);
+    }
+  } catch (const bad_alloc&) {
+    return COMPARE_NO_MEMORY;
+  } catch (...) {
+    return COMPARE_FAILED;
+  }
+  return COMPARE_OK;
+}
+
+// Raises the exception for status, with the GIL held. Returns false if it did.
+bool CheckStatus(CompareStatus status) {
+  switch (status) {
+    case COMPARE_OK:
+      return true;
+    case COMPARE_NO_MEMORY:
+      PyErr_NoMemory();
+      return false;
+    case COMPARE_FAILED:
+      PyErr_SetString(PyExc_RuntimeError, "comparison failed");
+      return false;
+  }
+  return false;
+}
+
+bool CheckK(int k) {
+  if (k <= 0) {
+    PyErr_SetString(PyExc_ValueError, "k must be positive");
+    return false;
+  }
+  return true;
+}
+
+PyObject* CompareOne(PyObject* args, bool lcsk_plus) {
+  Py_buffer a;
+  Py_buffer b;
+  int k = 0;
+  if (!PyArg_ParseTuple(args, "y*y*i", &a, &b, &k)) return nullptr;
+  if (!CheckK(k)) {
+    PyBuffer_Release(&a);
+    PyBuffer_Release(&b);
+    return nullptr;
+  }
+  vector<pair<int, int>>* recon = new vector<pair<int, int>>();
+  CompareStatus status;
+  Py_BEGIN_ALLOW_THREADS
+  status = Compare(a, b, k, lcsk_plus, recon);
+  Py_END_ALLOW_THREADS
+  PyBuffer_Release(&a);
+  PyBuffer_Release(&b);
+  if (!CheckStatus(status)) {
+    delete recon;
+    return nullptr;
+  }
+  return NewReconstruction(recon);
+}
+
+PyObject* LcsKSparseFastPy(PyObject*, PyObject* args) {
+  return CompareOne(args, false);
+}
+
+PyObject* LcsKppSparseFastPy(PyObject*, PyObject* args) {
+  return CompareOne(args, true);
+}
+
+PyObject* BatchPy(PyObject*, PyObject* args, PyObject* kwargs) {
+  static const char* keywords[] = {"pairs", "k", "lcsk_plus", "num_threads",
+                                   nullptr};
+  PyObject* pairs_object = nullptr;
+  int k = 0;
+  int lcsk_plus = 1;
+  int num_threads = 1;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Oi|pi",
+                                   const_cast<char**>(keywords),
+                                   &pairs_object, &k, &lcsk_plus,
+                                   &num_threads) ||
+      !CheckK(k)) {
+    return nullptr;
+  }
+  PyObject* pairs_sequence =
+      PySequence_Fast(pairs_object, "pairs must be a sequence of (a, b)");
+  if (pairs_sequence == nullptr) return nullptr;
+
+  // Holds the buffers of all the strings while the GIL is released.
+  const Py_ssize_t num_pairs = PySequence_Fast_GET_SIZE(pairs_sequence);
+  vector<Py_buffer> buffers(2 * num_pairs);
+  Py_ssize_t num_buffers = 0;
+  bool ok = true;
+  for (Py_ssize_t i = 0; ok && i < num_pairs; ++i) {
+    PyObject* pair_object = PySequence_Fast_GET_ITEM(pairs_sequence, i);
+    ok = PyArg_ParseTuple(pair_object, "y*y*", &buffers[2 * i],
+                          &buffers[2 * i + 1]);
+    if (ok) num_buffers += 2;
+  }
+  Py_DECREF(pairs_sequence);
+
+  vector<vector<pair<int, int>>*> recons;
+  // The first failure of the comparisons, if any.
+  atomic<int> status(COMPARE_OK);
+  if (ok) {
+    for (Py_ssize_t i = 0; i < num_pairs; ++i) {
+      recons.push_back(new vector<pair<int, int>>());
+    }
+    Py_BEGIN_ALLOW_THREADS
+    atomic<Py_ssize_t> next_pair(0);
+    auto worker = [&]() {
+      for (Py_ssize_t i; (i = next_pair++) < num_pairs;) {
+        const CompareStatus pair_status =
+            Compare(buffers[2 * i], buffers[2 * i + 1], k, lcsk_plus,
+                    recons[i]);
+        int expected = COMPARE_OK;
+        if (pair_status != COMPARE_OK) {
+          status.compare_exchange_strong(expected, pair_status);
+          // The remaining pairs are not compared.
+          next_pair = num_pairs;
+        }
+      }
+    };
+    vector<thread> threads;
+    try {
+      for (int t = 1; t < min<Py_ssize_t>(num_threads, num_pairs); ++t) {
+        threads.emplace_back(worker);
+      }
+    } catch (const system_error&) {
+      // Short of threads, the pairs are compared by those already started.
+    } catch (const bad_alloc&) {
+    }
+    worker();
+    for (auto& t : threads) {
+      t.join();
+    }
+    Py_END_ALLOW_THREADS
+  }
+  for (Py_ssize_t i = 0; i < num_buffers; ++i) {
+    PyBuffer_Release(&buffers[i]);
+  }
+  if (!ok) return nullptr;
+  if (!CheckStatus(static_cast<CompareStatus>(status.load()))) {
+    for (auto* recon : recons) delete recon;
+    return nullptr;
+  }
+
+  PyObject* list = PyList_New(num_pairs);
+  if (list == nullptr) {
+    for (auto* recon : recons) delete recon;
+    return nullptr;
+  }
+  for (Py_ssize_t i = 0; i < num_pairs; ++i) {
+    PyObject* recon = NewReconstruction(recons[i]);
+    if (recon == nullptr) {
+      for (Py_ssize_t j = i + 1; j < num_pairs; ++j) delete recons[j];
+      Py_DECREF(list);
+      return nullptr;
+    }
+    PyList_SET_ITEM(list, i, recon);
+  }
+  return list;
+}
+
+PyMethodDef module_methods[] = {
+    {"lcsk_sparse_fast", LcsKSparseFastPy, METH_VARARGS,
+     "lcsk_sparse_fast(a, b, k) -> Reconstruction\n\n"
+     "LCSk of a and b, given as bytes-like objects."},
+    {"lcskpp_sparse_fast", LcsKppSparseFastPy, METH_VARARGS,
+     "lcskpp_sparse_fast(a, b, k) -> Reconstruction\n\n"
+     "LCSk++ of a and b, given as bytes-like objects."},
+    {"batch", reinterpret_cast<PyCFunction>(BatchPy),
+     METH_VARARGS | METH_KEYWORDS,
+     "batch(pairs, k, lcsk_plus=True, num_threads=1) -> list\n\n"
+     "LCSk++ (LCSk unless lcsk_plus) of every (a, b) of pairs, computed by\n"
+     "num_threads threads, as a list of Reconstruction in order of pairs."},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+PyModuleDef module_def = {
+    PyModuleDef_HEAD_INIT,
+    "fast_simple_lcsk",
+    "Fast and simple algorithms for computing both LCSk and LCSk++.",
+    -1,
+    module_methods,
+};
+
+}  // namespace
+
+PyMODINIT_FUNC PyInit_fast_simple_lcsk() {
+  reconstruction_type.tp_name = "fast_simple_lcsk.Reconstruction";
+  reconstruction_type.tp_basicsize = sizeof(Reconstruction);
+  reconstruction_type.tp_dealloc = ReconstructionDealloc;
+  reconstruction_type.tp_as_sequence = &reconstruction_as_sequence;
+  reconstruction_type.tp_as_buffer = &reconstruction_as_buffer;
+  reconstruction_type.tp_methods = reconstruction_methods;
+  reconstruction_type.tp_flags = Py_TPFLAGS_DEFAULT;
+  reconstruction_type.tp_doc =
+      "Pairs (i, j) of matching positions of a and b, exported as an (n, 2)\n"
+      "int32 array through the buffer protocol.";
+  if (PyType_Ready(&reconstruction_type) < 0) return nullptr;
+
+  PyObject* module = PyModule_Create(&module_def);
+  if (module == nullptr) return nullptr;
+  Py_INCREF(&reconstruction_type);
+  if (PyModule_AddObject(module, "Reconstruction",
+                         reinterpret_cast<PyObject*>(&reconstruction_type)) <
+      0) {
+    Py_DECREF(&reconstruction_type);
+    Py_DECREF(module);
+    return nullptr;
+  }
+  return module;
+}
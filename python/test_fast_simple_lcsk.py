@@ -0,0 +1,189 @@
+# Copyright 2018 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     https://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Tests of the Python bindings, run from the root with `make python_test`."""
+
+import ctypes
+import random
+import subprocess
+import sys
+import threading
+import unittest
+
+import fast_simple_lcsk
+
+
+def generate_string(length, rng):
+    return bytes(rng.choice(b"ACGT") for _ in range(length))
+
+
+def generate_similar(s, rng, perr=0.1):
+    return bytes(rng.choice(b"ACGT") if rng.random() < perr else c for c in s)
+
+
+def is_valid(recon, a, b, k, lcsk_plus):
+    """Whether recon is a valid LCSk (LCSk++ if lcsk_plus) of a and b."""
+    pairs = recon.tolist()
+    i = 0
+    while i < len(pairs):
+        run = 1
+        while (i + run < len(pairs) and
+               pairs[i + run][0] == pairs[i][0] + run and
+               pairs[i + run][1] == pairs[i][1] + run):
+            run += 1
+        if run < k or (not lcsk_plus and run % k != 0):
+            return False
+        if i > 0 and (pairs[i][0] <= pairs[i - 1][0] or
+                      pairs[i][1] <= pairs[i - 1][1]):
+            return False
+        i += run
+    return all(a[x] == b[y] for x, y in pairs)
+
+
+class FastSimpleLcsKTest(unittest.TestCase):
+
+    def setUp(self):
+        rng = random.Random(1)
+        self.b = generate_string(3000, rng)
+        self.a = generate_similar(self.b[500:2500], rng)
+
+    def test_identical(self):
+        s = b"ACGTTGCAAC" * 3
+        recon = fast_simple_lcsk.lcskpp_sparse_fast(s, s, 3)
+        self.assertEqual(recon.tolist(), [(i, i) for i in range(len(s))])
+        self.assertEqual(len(fast_simple_lcsk.lcsk_sparse_fast(s, s, 4)), 28)
+
+    def test_buffer(self):
+        recon = fast_simple_lcsk.lcskpp_sparse_fast(self.a, self.b, 4)
+        self.assertTrue(is_valid(recon, self.a, self.b, 4, True))
+        self.assertGreater(len(recon), len(self.a) // 2)
+        view = memoryview(recon)
+        self.assertEqual(view.shape, (len(recon), 2))
+        self.assertEqual(view.format, "i")
+        self.assertTrue(view.readonly and view.c_contiguous)
+        self.assertEqual(view.tolist(), [list(p) for p in recon.tolist()])
+        # Any bytes-like object is accepted.
+        for a in (bytearray(self.a), memoryview(self.a)):
+            self.assertEqual(
+                fast_simple_lcsk.lcskpp_sparse_fast(a, self.b, 4).tolist(),
+                recon.tolist())
+        self.assertEqual(len(fast_simple_lcsk.lcsk_sparse_fast(b"", b"", 4)),
+                         0)
+        with self.assertRaises(TypeError):
+            fast_simple_lcsk.lcskpp_sparse_fast("ACGT", self.b, 4)
+        with self.assertRaises(ValueError):
+            fast_simple_lcsk.lcskpp_sparse_fast(self.a, self.b, 0)
+
+    def test_simple_buffer(self):
+        # A consumer not requesting PyBUF_ND gets the pairs as flat bytes.
+        class Py_buffer(ctypes.Structure):
+            _fields_ = [("buf", ctypes.c_void_p), ("obj", ctypes.py_object),
+                        ("len", ctypes.c_ssize_t),
+                        ("itemsize", ctypes.c_ssize_t),
+                        ("readonly", ctypes.c_int), ("ndim", ctypes.c_int),
+                        ("format", ctypes.c_char_p),
+                        ("shape", ctypes.POINTER(ctypes.c_ssize_t)),
+                        ("strides", ctypes.POINTER(ctypes.c_ssize_t)),
+                        ("suboffsets", ctypes.POINTER(ctypes.c_ssize_t)),
+                        ("internal", ctypes.c_void_p)]
+
+        recon = fast_simple_lcsk.lcskpp_sparse_fast(self.a, self.b, 4)
+        view = Py_buffer()
+        PyBUF_SIMPLE = 0
+        ctypes.pythonapi.PyObject_GetBuffer(
+            ctypes.py_object(recon), ctypes.byref(view), PyBUF_SIMPLE)
+        try:
+            self.assertEqual(view.ndim, 1)
+            self.assertFalse(view.shape)
+            self.assertFalse(view.strides)
+            self.assertEqual(view.len, 8 * len(recon))
+            self.assertEqual(ctypes.string_at(view.buf, view.len),
+                             memoryview(recon).tobytes())
+        finally:
+            ctypes.pythonapi.PyBuffer_Release(ctypes.byref(view))
+
+    def test_any_byte(self):
+        rng = random.Random(3)
+        b = bytes(rng.randrange(256) for _ in range(2000))
+        a = generate_similar(b[200:1800], rng, perr=0.05)
+        recon = fast_simple_lcsk.lcskpp_sparse_fast(a, b, 4)
+        self.assertTrue(is_valid(recon, a, b, 4, True))
+        self.assertGreater(len(recon), len(a) // 2)
+
+    def test_batch(self):
+        rng = random.Random(2)
+        pairs = [(generate_similar(self.a, rng), self.b) for _ in range(5)]
+        for lcsk_plus in (False, True):
+            compare = (fast_simple_lcsk.lcskpp_sparse_fast if lcsk_plus else
+                       fast_simple_lcsk.lcsk_sparse_fast)
+            expected = [compare(a, b, 5).tolist() for a, b in pairs]
+            for num_threads in (1, 3):
+                recons = fast_simple_lcsk.batch(
+                    pairs, 5, lcsk_plus=lcsk_plus, num_threads=num_threads)
+                self.assertEqual([r.tolist() for r in recons], expected)
+                for (a, b), recon in zip(pairs, recons):
+                    self.assertTrue(is_valid(recon, a, b, 5, lcsk_plus))
+        with self.assertRaises(TypeError):
+            fast_simple_lcsk.batch([(self.a, "ACGT")], 5)
+
+    def test_threads(self):
+        rng = random.Random(3)
+        pairs = [(generate_similar(self.a, rng), self.b) for _ in range(8)]
+        results = [None] * len(pairs)
+
+        def compare(i):
+            results[i] = fast_simple_lcsk.lcskpp_sparse_fast(
+                pairs[i][0], pairs[i][1], 4).tolist()
+
+        threads = [threading.Thread(target=compare, args=(i,))
+                   for i in range(len(pairs))]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(results, [
+            fast_simple_lcsk.lcskpp_sparse_fast(a, b, 4).tolist()
+            for a, b in pairs
+        ])
+
+    def test_out_of_memory(self):
+        # Runs in a child process whose address space is too small for the
+        # index of a long string, which has to raise MemoryError rather than
+        # terminate the interpreter.
+        script = """
+import resource
+import fast_simple_lcsk
+s = b"A" * 50000000
+with open("/proc/self/status") as status:
+    vm_size = next(int(line.split()[1]) for line in status
+                   if line.startswith("VmSize:"))
+limit = (vm_size << 10) + (150 << 20)
+resource.setrlimit(resource.RLIMIT_AS, (limit, limit))
+for compare in (lambda: fast_simple_lcsk.lcskpp_sparse_fast(s, s, 1),
+                lambda: fast_simple_lcsk.batch([(s, s)] * 2, 1,
+                                               num_threads=2)):
+    try:
+        compare()
+        print("no error")
+    except MemoryError:
+        print("MemoryError")
+"""
+        result = subprocess.run([sys.executable, "-c", script],
+                                capture_output=True, text=True)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout.split(), ["MemoryError"] * 2)
+
+
+if __name__ == "__main__":
+    unittest.main()
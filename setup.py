@@ -0,0 +1,37 @@
+# Copyright 2018 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     https://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Builds the fast_simple_lcsk Python extension module.
+
+    python3 setup.py build_ext --inplace
+"""
+
+import glob
+
+from setuptools import Extension, setup
+
+setup(
+    name="fast_simple_lcsk",
+    ext_modules=[
+        Extension(
+            "fast_simple_lcsk",
+            sources=["python/fast_simple_lcsk_module.cc"] +
+            sorted(glob.glob("fast_simple_lcsk/*.cc")),
+            include_dirs=["."],
+            extra_compile_args=["-O2", "-std=c++11", "-pthread"],
+            extra_link_args=["-pthread"],
+            language="c++",
+        )
+    ],
+)
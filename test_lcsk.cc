@@ -13,21 +13,45 @@
 // limitations under the License.
 
 #include <cassert>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <cmath>
 #include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <new>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include <malloc.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "fast_simple_lcsk/all_vs_all.h"
+#include "fast_simple_lcsk/comparison_server.h"
+#include "fast_simple_lcsk/kmer_filter.h"
 #include "fast_simple_lcsk/lcsk.h"
+#include "fast_simple_lcsk/match_estimator.h"
+#include "fast_simple_lcsk/match_maker.h"
+#include "fast_simple_lcsk/match_pair.h"
+#include "fast_simple_lcsk/match_trace.h"
+#include "fast_simple_lcsk/memory_policy.h"
+#include "fast_simple_lcsk/partitioned_index.h"
+#include "fast_simple_lcsk/result_cache.h"
+#include "fast_simple_lcsk/similarity_profile.h"
+#include "fast_simple_lcsk/row_sweeper.h"
+#include "fast_simple_lcsk/sweep_timeline.h"
 #include "util/lcsk_testing.h"
 #include "util/random_strings.h"
+#include "util/sequence_reader.h"
 using namespace std;
 
 const int only_run_fast_version = 0;
@@ -46,6 +70,173 @@ const int kK = 3;
 // const double kPerr = -1.0;
 const double kPerr = 0.1;
 
+// Number of heap allocations made by the current thread, and the bytes they
+// take (with the 8 bytes of the malloc header) and took at most, counted by
+// the replacements of operator new and delete below.
+thread_local uint64_t num_allocations = 0;
+thread_local int64_t heap_bytes = 0;
+thread_local int64_t max_heap_bytes = 0;
+
+void* operator new(size_t size) {
+  ++num_allocations;
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) throw bad_alloc();
+  heap_bytes += malloc_usable_size(p) + 8;
+  max_heap_bytes = max(max_heap_bytes, heap_bytes);
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  if (p != nullptr) heap_bytes -= malloc_usable_size(p) + 8;
+  free(p);
+}
+
+// Checks the thresholded entry points against the lengths computed by the
+// full sweep.
+void test_lcsk_at_least(const string &a, const string &b, const int K,
+                        const int lcsk_len, const int lcskpp_len) {
+  vector<pair<int, int> > recon;
+  int rows_skipped = -1;
+
+  assert(LcsKSparseFastAtLeast(a, b, K, lcsk_len, false, &recon,
+                               &rows_skipped));
+  assert(recon.size() == lcsk_len);
+  assert(!LcsKSparseFastAtLeast(a, b, K, lcsk_len + 1, false, &recon,
+                                &rows_skipped));
+  assert(0 <= rows_skipped && rows_skipped <= max(a.size(), b.size()));
+  assert(ValidLcsk(a, b, K, recon));
+
+  assert(LcsKppSparseFastAtLeast(a, b, K, lcskpp_len, false, &recon,
+                                 &rows_skipped));
+  assert(recon.size() == lcskpp_len && rows_skipped == 0);
+  assert(!LcsKppSparseFastAtLeast(a, b, K, lcskpp_len + 1, false, &recon,
+                                  &rows_skipped));
+  assert(ValidLcskpp(a, b, K, recon));
+
+  const int target = lcskpp_len / 2;
+  assert(LcsKppSparseFastAtLeast(a, b, K, target, true, &recon,
+                                 &rows_skipped));
+  assert(recon.size() >= target);
+  assert(ValidLcskpp(a, b, K, recon));
+}
+
+// Checks that the thresholded entry points actually skip rows, both when the
+// threshold becomes unreachable and when it is reached.
+void test_lcsk_at_least_early_exit() {
+  const int n = 2000;
+  vector<pair<int, int> > recon;
+  int rows_skipped = -1;
+
+  // Unrelated strings are far from reaching their length.
+  const string a = generate_string(n);
+  const string b = generate_string(n + 100);
+  for (bool lcsk_plus : {false, true}) {
+    if (lcsk_plus) {
+      assert(!LcsKppSparseFastAtLeast(a, b, kK, n, false, &recon,
+                                      &rows_skipped));
+    } else {
+      assert(!LcsKSparseFastAtLeast(a, b, kK, n, false, &recon,
+                                    &rows_skipped));
+    }
+    assert(rows_skipped > n / 2);
+  }
+
+  // Near-identical strings reach half of their length halfway.
+  const string c = generate_similar(a, 0.01);
+  for (bool lcsk_plus : {false, true}) {
+    if (lcsk_plus) {
+      assert(LcsKppSparseFastAtLeast(a, c, kK, n / 2, true, &recon,
+                                     &rows_skipped));
+      assert(ValidLcskpp(a, c, kK, recon));
+    } else {
+      assert(LcsKSparseFastAtLeast(a, c, kK, n / 2, true, &recon,
+                                   &rows_skipped));
+      assert(ValidLcsk(a, c, kK, recon));
+    }
+    assert(recon.size() >= n / 2);
+    // The sweep stopped after about half of the rows.
+    assert(rows_skipped > n / 4);
+  }
+}
+
+// Keeps only the matches of the wrapped MatchMaker above the main diagonal.
+class UpperTriangleMatchMaker : public MatchMaker {
+ public:
+  UpperTriangleMatchMaker(const string &a, const int K)
+      : match_maker_(
+            MatchMaker::Create(a, a, K, FastestMatchMakerType(a, a, K))),
+        row_(0) {}
+
+  bool GetNextMatches(vector<int> *matches) override {
+    bool more = match_maker_->GetNextMatches(matches);
+    matches->erase(remove_if(matches->begin(), matches->end(),
+                             [this](int col) { return col <= row_; }),
+                   matches->end());
+    ++row_;
+    return more;
+  }
+
+ private:
+  unique_ptr<MatchMaker> match_maker_;
+  int row_;
+};
+
+// Checks the self-comparison mode against the full sweep restricted to the
+// matches above the main diagonal.
+void test_lcsk_self(const string &a, const int K) {
+  for (int lcsk_plus = 0; lcsk_plus < 2; ++lcsk_plus) {
+    vector<pair<int, int> > self_recon;
+    if (lcsk_plus) {
+      LcsKppSparseFastSelf(a, K, &self_recon);
+      assert(ValidLcskpp(a, a, K, self_recon));
+    } else {
+      LcsKSparseFastSelf(a, K, &self_recon);
+      assert(ValidLcsk(a, a, K, self_recon));
+    }
+    for (auto &p : self_recon) {
+      assert(p.first < p.second);
+    }
+
+    UpperTriangleMatchMaker match_maker(a, K);
+    vector<pair<int, int> > expected_recon;
+    LcsKSparseFastWithMatchMaker(&match_maker, a.size(), a.size(), K,
+                                 lcsk_plus, -1, false, &expected_recon,
+                                 nullptr);
+    assert(self_recon.size() == expected_recon.size());
+  }
+}
+
+// Checks the dual-strand entry points against separate comparisons of both
+// strands.
+void test_dual_strand(const string &a, const string &b, const int K) {
+  const string rc_a = ReverseComplement(a);
+  assert(ReverseComplement(rc_a) == a);
+  for (int lcsk_plus = 0; lcsk_plus < 2; ++lcsk_plus) {
+    vector<pair<int, int> > forward_recon;
+    vector<pair<int, int> > reverse_recon;
+    if (lcsk_plus) {
+      LcsKppSparseFast(a, b, K, &forward_recon);
+      LcsKppSparseFast(rc_a, b, K, &reverse_recon);
+    } else {
+      LcsKSparseFast(a, b, K, &forward_recon);
+      LcsKSparseFast(rc_a, b, K, &reverse_recon);
+    }
+
+    for (int num_threads = 1; num_threads <= 2; ++num_threads) {
+      vector<pair<int, int> > recon;
+      const Strand strand =
+          lcsk_plus ? LcsKppSparseFastDualStrand(a, b, K, num_threads, &recon)
+                    : LcsKSparseFastDualStrand(a, b, K, num_threads, &recon);
+      assert(recon.size() == max(forward_recon.size(), reverse_recon.size()));
+      assert((strand == REVERSE_STRAND) ==
+             (reverse_recon.size() > forward_recon.size()));
+      const string &strand_a = strand == FORWARD_STRAND ? a : rc_a;
+      assert(lcsk_plus ? ValidLcskpp(strand_a, b, K, recon)
+                       : ValidLcsk(strand_a, b, K, recon));
+    }
+  }
+}
+
 int test_lcsk(const string &a, const string &b, const int K) {
   vector<pair<int, int> > lcsk_sparse_slow_recon;
   vector<pair<int, int> > lcskpp_sparse_slow_recon;
@@ -75,6 +266,47 @@ int test_lcsk(const string &a, const string &b, const int K) {
   }
   assert(ValidLcsk(a, b, K, lcsk_sparse_fast_recon));
   assert(ValidLcskpp(a, b, K, lcskpp_sparse_fast_recon));
+  test_lcsk_at_least(a, b, K, lcsk_sparse_fast_recon.size(),
+                     lcskpp_sparse_fast_recon.size());
+
+  vector<pair<int, int> > lcsk_parallel_recon;
+  vector<pair<int, int> > lcskpp_parallel_recon;
+  LcsKSparseFastParallel(a, b, K, 3, &lcsk_parallel_recon);
+  LcsKppSparseFastParallel(a, b, K, 3, &lcskpp_parallel_recon);
+  assert(lcsk_parallel_recon.size() == lcsk_sparse_fast_recon.size());
+  assert(lcskpp_parallel_recon.size() == lcskpp_sparse_fast_recon.size());
+  assert(ValidLcsk(a, b, K, lcsk_parallel_recon));
+  assert(ValidLcskpp(a, b, K, lcskpp_parallel_recon));
+
+  test_lcsk_self(a, K);
+
+  vector<pair<int, int> > lcsk_dense_recon;
+  vector<pair<int, int> > lcskpp_dense_recon;
+  LcsKDense(a, b, K, &lcsk_dense_recon);
+  LcsKppDense(a, b, K, &lcskpp_dense_recon);
+  assert(lcsk_dense_recon.size() == lcsk_sparse_fast_recon.size());
+  assert(lcskpp_dense_recon.size() == lcskpp_sparse_fast_recon.size());
+  assert(ValidLcsk(a, b, K, lcsk_dense_recon));
+  assert(ValidLcskpp(a, b, K, lcskpp_dense_recon));
+  vector<pair<int, int> > lcskpp_auto_recon;
+  LcsKppFast(a, b, K, &lcskpp_auto_recon);
+  assert(lcskpp_auto_recon.size() == lcskpp_sparse_fast_recon.size());
+  test_dual_strand(a, b, K);
+  test_dual_strand(a, ReverseComplement(b), K);
+
+  vector<pair<int64_t, int64_t> > lcskpp_64_recon;
+  LcsKSparseFastWithPositionType<int64_t>(a, b, K, true, &lcskpp_64_recon);
+  assert(lcskpp_64_recon.size() == lcskpp_sparse_fast_recon.size());
+
+  const vector<int> ks = {K + 2, K, K + 5, K};
+  vector<vector<pair<int, int> > > lcskpp_multi_k_recons;
+  LcsKSparseFastMultiK(a, b, ks, true, &lcskpp_multi_k_recons);
+  for (int i = 0; i < ks.size(); ++i) {
+    vector<pair<int, int> > recon;
+    LcsKppSparseFast(a, b, ks[i], &recon);
+    assert(lcskpp_multi_k_recons[i].size() == recon.size());
+    assert(ValidLcskpp(a, b, ks[i], lcskpp_multi_k_recons[i]));
+  }
 
   return lcsk_sparse_fast_recon.size();
 }
@@ -96,6 +328,1096 @@ void calculate_distribution(map<int, double> &distr) {
   }
 }
 
+// Checks that all position types yield the same result on a and b.
+void test_position_types(const string &a, const string &b) {
+  for (int lcsk_plus = 0; lcsk_plus < 2; ++lcsk_plus) {
+    vector<pair<int, int> > recon;
+    if (lcsk_plus) {
+      LcsKppSparseFast(a, b, kK, &recon);
+    } else {
+      LcsKSparseFast(a, b, kK, &recon);
+    }
+
+    vector<pair<int32_t, int32_t> > recon32;
+    LcsKSparseFastWithPositionType<int32_t>(a, b, kK, lcsk_plus, &recon32);
+    assert(recon32.size() == recon.size());
+
+    vector<pair<int64_t, int64_t> > recon64;
+    LcsKSparseFastWithPositionType<int64_t>(a, b, kK, lcsk_plus, &recon64);
+    assert(recon64.size() == recon.size());
+    for (int i = 0; i < recon.size(); ++i) {
+      assert(recon64[i].first == recon32[i].first);
+      assert(recon64[i].second == recon32[i].second);
+    }
+  }
+}
+
+// Checks the position types on strings around the largest length of 16-bit
+// positions and on strings too long for them.
+void test_position_types() {
+  for (int n : {32766, 32767, 32768, 40000}) {
+    const string a = generate_string(n);
+    string b = generate_similar(a, kPerr);
+    // Keeps the longer string at exactly n characters.
+    b.resize(min<size_t>(b.size(), n));
+    test_position_types(a, b);
+  }
+}
+
+// Writes contents to a temporary file and reads it back with
+// ReadSequenceFile. If gzip_members > 0, the contents are compressed, split
+// into that many gzip members.
+string read_back(const string &contents, bool acgt_only, int gzip_members) {
+  const string path = "/tmp/test_lcsk_sequence_reader";
+  remove(path.c_str());
+  if (gzip_members == 0) {
+    ofstream(path.c_str(), ios::binary) << contents;
+  }
+  for (int i = 0; i < gzip_members; ++i) {
+    const size_t begin = contents.size() * i / gzip_members;
+    const size_t end = contents.size() * (i + 1) / gzip_members;
+    gzFile file = gzopen(path.c_str(), "ab");
+    gzwrite(file, contents.data() + begin, end - begin);
+    gzclose(file);
+  }
+
+  string sequence;
+  assert(ReadSequenceFile(path, acgt_only, &sequence));
+  remove(path.c_str());
+  return sequence;
+}
+
+// Checks ReadSequenceFile on the supported formats.
+void test_sequence_reader() {
+  const string fasta =
+      ">first record\r\nACGTN\r\nacgt\r\n\n, comment\n>second\nTTGCA";
+  assert(read_back(fasta, false, 0) == "ACGTNacgtTTGCA");
+  assert(read_back(fasta, true, 0) == "ACGTTTGCA");
+
+  // The second quality string starts with '@' and spans two lines.
+  const string fastq = "@r1\nACGT\n+\nIIII\n@r2\nGG\nTT\n+r2\n@I\nII\n";
+  assert(read_back(fastq, false, 0) == "ACGTGGTT");
+
+  assert(read_back("ACGT\nTTTT\n", false, 0) == "ACGT");
+  assert(read_back("", false, 0) == "");
+
+  // Spans several inflated chunks.
+  string long_fasta = ">long\n";
+  string expected;
+  for (int i = 0; i < 40000; ++i) {
+    const string line = generate_string(60);
+    long_fasta += line + "\n";
+    expected += line;
+  }
+  assert(read_back(long_fasta, true, 0) == expected);
+  assert(read_back(long_fasta, true, 1) == expected);
+  assert(read_back(long_fasta, true, 3) == expected);
+  assert(read_back(fastq, false, 2) == "ACGTGGTT");
+
+  string sequence;
+  assert(!ReadSequenceFile("/nonexistent/file", false, &sequence));
+}
+
+// Queries a ComparisonServer from concurrent clients and compares the answers
+// against direct calls.
+void test_comparison_server() {
+  const int k = 5;
+  vector<string> references;
+  references.push_back(generate_string(kStringLen));
+  references.push_back(generate_string(2 * kStringLen) + "xyz");
+
+  const string socket_path = "/tmp/test_lcsk_server.sock";
+  ComparisonServer server(references, k, 2);
+  assert(server.Start(socket_path));
+  thread server_thread(&ComparisonServer::Run, &server);
+
+  const int kNumClients = 3;
+  const int kQueriesPerClient = 20;
+  vector<thread> clients;
+  for (int c = 0; c < kNumClients; ++c) {
+    vector<string> queries;
+    for (int i = 0; i < kQueriesPerClient; ++i) {
+      queries.push_back(generate_similar(references[i % 2], kPerr) + "#");
+    }
+    clients.emplace_back([&references, &socket_path, queries, k]() {
+      ComparisonClient client;
+      assert(client.Connect(socket_path));
+      for (int i = 0; i < queries.size(); ++i) {
+        const bool lcsk_plus = i % 3 != 0;
+        vector<pair<int, int> > expected;
+        if (lcsk_plus) {
+          LcsKppSparseFast(queries[i], references[i % 2], k, &expected);
+        } else {
+          LcsKSparseFast(queries[i], references[i % 2], k, &expected);
+        }
+
+        int64_t length = 0;
+        vector<pair<int, int> > recon;
+        assert(client.Compare(i % 2, queries[i], lcsk_plus, &length,
+                              i % 4 == 0 ? nullptr : &recon));
+        assert(length == expected.size());
+        const string &reference = references[i % 2];
+        if (i % 4 != 0) {
+          assert(lcsk_plus ? ValidLcskpp(queries[i], reference, k, recon)
+                           : ValidLcsk(queries[i], reference, k, recon));
+        }
+      }
+      int64_t length = 0;
+      assert(!client.Compare(2, queries[0], true, &length, nullptr));
+    });
+  }
+  for (auto &client : clients) {
+    client.join();
+  }
+
+  ComparisonClient client;
+  assert(client.Connect(socket_path));
+  LatencyStats stats;
+  assert(client.GetLatencyStats(&stats));
+  assert(stats.num_requests == kNumClients * kQueriesPerClient);
+  assert(stats.p50_us <= stats.p90_us && stats.p90_us <= stats.p99_us &&
+         stats.p99_us <= stats.max_us);
+
+  // The idle connection must not keep the server from stopping.
+  server.Stop();
+  server_thread.join();
+}
+
+// Checks that a ComparisonServer closes the connections sending frames larger
+// than its limit, and keeps serving the others.
+void test_comparison_server_frame_limit() {
+  const int k = 5;
+  vector<string> references(1, generate_string(kStringLen));
+  const string socket_path = "/tmp/test_lcsk_server_limit.sock";
+  ComparisonServer server(references, k, 1, /*max_frame_size=*/1024);
+  assert(server.Start(socket_path));
+  thread server_thread(&ComparisonServer::Run, &server);
+
+  // A raw header announcing a payload of 2^62 bytes, which is never sent.
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socket_path.c_str());
+  assert(connect(fd, reinterpret_cast<sockaddr*>(&address),
+                 sizeof(address)) == 0);
+  const uint64_t size = 1ULL << 62;
+  assert(write(fd, &size, sizeof(size)) == sizeof(size));
+  char byte;
+  assert(read(fd, &byte, 1) == 0);
+  close(fd);
+
+  int64_t length = 0;
+  ComparisonClient oversized_client;
+  assert(oversized_client.Connect(socket_path));
+  assert(!oversized_client.Compare(0, generate_string(2000), true, &length,
+                                   nullptr));
+
+  ComparisonClient client;
+  assert(client.Connect(socket_path));
+  const string query = generate_similar(references[0], kPerr);
+  vector<pair<int, int> > expected;
+  LcsKppSparseFast(query, references[0], k, &expected);
+  assert(client.Compare(0, query, true, &length, nullptr));
+  assert(length == expected.size());
+
+  server.Stop();
+  server_thread.join();
+}
+
+// Checks the exact match-pair counts against the match pairs created by the
+// sweep, and the sampled estimates against the exact counts.
+void test_match_estimator() {
+  for (int t = 0; t < 10; ++t) {
+    const string a = generate_string(2000);
+    const string b = generate_similar(a, kPerr);
+    MatchEstimate estimate;
+    EstimateMatches(a, b, kK, 1.0, &estimate);
+
+    const uint64_t objects_created = ObjectCounter<MatchPair>::objects_created;
+    vector<pair<int, int> > recon;
+    LcsKSparseFast(a, b, kK, &recon);
+    // '+1' comes from the dummy MatchPair of the compressed table.
+    assert(estimate.num_match_pairs + 1 ==
+           ObjectCounter<MatchPair>::objects_created - objects_created);
+    assert(0 < estimate.index_bytes);
+    assert(estimate.index_bytes < estimate.peak_bytes);
+  }
+
+  const string a = generate_string(200000);
+  const string b = generate_similar(a, kPerr);
+  const int k = 12;
+  MatchEstimate exact;
+  MatchEstimate sampled;
+  EstimateMatches(a, b, k, 1.0, &exact);
+  EstimateMatches(a, b, k, 0.25, &sampled);
+  assert(fabs(sampled.num_match_pairs - exact.num_match_pairs) <
+         0.1 * exact.num_match_pairs);
+  assert(fabs(sampled.num_distinct_kmers - exact.num_distinct_kmers) <
+         0.1 * exact.num_distinct_kmers);
+  assert(fabs(sampled.peak_bytes - exact.peak_bytes) < 0.1 * exact.peak_bytes);
+}
+
+// Checks the memory predicted by EstimateMatches against the index built for
+// LcsKSparseFast and against the peak memory of LcsKSparseFast, with either
+// string shorter and with k-mers too long for the perfect hash.
+void test_match_estimator_memory() {
+  const int ks[] = {kK, 40};
+  for (int k : ks) {
+    const string a = generate_string(3000);
+    const string b = generate_similar(a, 0.01) + generate_string(9000);
+    for (int transpose = 0; transpose < 2; ++transpose) {
+      const string &x = transpose ? b : a;
+      const string &y = transpose ? a : b;
+      MatchEstimate estimate;
+      EstimateMatches(x, y, k, 1.0, &estimate);
+
+      int64_t bytes = heap_bytes;
+      {
+        // The engine sweeps b and indexes a, the shorter one.
+        auto match_maker = BasicMatchMaker<int16_t>::Create(
+            b, a, k, FastestMatchMakerType(b, a, k));
+        const int64_t index_bytes = heap_bytes - bytes;
+        assert(fabs(estimate.index_bytes - index_bytes) < 0.1 * index_bytes);
+      }
+
+      bytes = heap_bytes;
+      max_heap_bytes = heap_bytes;
+      vector<pair<int, int> > recon;
+      LcsKSparseFast(x, y, k, &recon);
+      const int64_t peak_bytes = max_heap_bytes - bytes;
+      assert(estimate.index_bytes < peak_bytes);
+      assert(peak_bytes <= estimate.peak_bytes);
+    }
+  }
+}
+
+// Runs a long sweep twice in the same scratch. The first sweep grows the
+// buffers and the pool of match pairs, in a logarithmic number of
+// allocations, after which the second one must not allocate at all.
+void test_steady_state_allocations() {
+  const int k = 8;
+  const string a = generate_string(100000);
+  const string b = generate_similar(a, kPerr);
+  vector<vector<int> > rows(a.size() + 1);
+  auto match_maker = MatchMaker::Create(a, b, k, PERFECT_HASH);
+  for (auto& row_matches : rows) {
+    match_maker->GetNextMatches(&row_matches);
+  }
+
+  for (int lcsk_plus = 0; lcsk_plus < 2; ++lcsk_plus) {
+    vector<pair<int, int> > recon;
+    if (lcsk_plus) {
+      LcsKppSparseFast(a, b, k, &recon);
+    } else {
+      LcsKSparseFast(a, b, k, &recon);
+    }
+
+    SweepScratch scratch;
+    for (int run = 0; run < 2; ++run) {
+      const uint64_t allocations = num_allocations;
+      {
+        RowSweeper sweeper(k, lcsk_plus, &scratch);
+        for (int row = 0; row < rows.size(); ++row) {
+          sweeper.ProcessRow(row, rows[row]);
+        }
+        assert(sweeper.BestLength() == recon.size());
+      }
+      const uint64_t sweep_allocations = num_allocations - allocations;
+      assert(sweep_allocations <= (run == 0 ? 100 : 0));
+    }
+  }
+}
+
+// Records the matches of a comparison and checks that replaying the trace
+// gives the same result.
+void test_match_trace() {
+  const string path = "/tmp/test_lcsk_match_trace";
+  const string a = generate_string(5000);
+  const string b = generate_similar(a, kPerr);
+  const int k = 4;
+  vector<pair<int, int> > expected;
+  LcsKppSparseFast(a, b, k, &expected);
+
+  auto match_maker = MatchMaker::Create(a, b, k, PERFECT_HASH);
+  MatchTraceRecorder recorder(match_maker.get(), k, a.size(), b.size(), path);
+  vector<pair<int, int> > recon;
+  LcsKSparseFastWithMatchMaker(&recorder, a.size(), b.size(), k,
+                               /*lcsk_plus=*/true, -1, false, &recon, nullptr);
+  assert(recorder.Close());
+  assert(recon == expected);
+
+  MatchTrace trace;
+  assert(trace.Load(path));
+  assert(trace.k() == k);
+  assert(trace.a_size() == a.size());
+  assert(trace.b_size() == b.size());
+  assert(trace.num_rows() == a.size() - k + 1);
+  for (int run = 0; run < 2; ++run) {
+    TraceMatchMaker replay(trace);
+    LcsKSparseFastWithMatchMaker(&replay, trace.a_size(), trace.b_size(),
+                                 trace.k(), /*lcsk_plus=*/true, -1, false,
+                                 &recon, nullptr);
+    assert(recon == expected);
+  }
+
+  // A trace ending in the middle of a row, or of a number, is rejected.
+  ofstream(path.c_str(), ios::binary | ios::app) << (char)2 << (char)0x80;
+  assert(!trace.Load(path));
+  remove(path.c_str());
+  assert(!trace.Load(path));
+}
+
+// Checks that KmerFilter never rejects a key and rarely accepts others, and
+// that the filtered PerfectHashMatchMaker finds the same matches as the naive
+// one.
+void test_kmer_filter() {
+  KmerFilter bitmap(1000, 500);
+  for (int hash = 0; hash < 1000; hash += 2) bitmap.Insert(hash);
+  for (int hash = 0; hash < 1000; ++hash) {
+    assert(bitmap.MayContain(hash) == (hash % 2 == 0));
+  }
+  assert(!bitmap.MayContain(5000));
+
+  const int num_keys = 100000;
+  KmerFilter bloom(0, num_keys);
+  auto key = [](unsigned long long i) { return i * i * 2654435761ULL + i; };
+  for (int i = 0; i < num_keys; ++i) bloom.Insert(key(i));
+  int false_positives = 0;
+  for (int i = 0; i < num_keys; ++i) {
+    assert(bloom.MayContain(key(i)));
+    false_positives += bloom.MayContain(key(num_keys + i));
+  }
+  assert(false_positives < num_keys / 100);
+
+  // Short k-mers are filtered by a bitmap, long ones by the Bloom filter.
+  for (int k : {3, 16}) {
+    const string a = generate_string(1000);
+    const string b = a.substr(0, 300) + generate_string(700);
+    auto naive = MatchMaker::Create(a, b, k, NAIVE);
+    auto perfect_hash = MatchMaker::Create(a, b, k, PERFECT_HASH);
+    vector<int> expected;
+    vector<int> matches;
+    while (naive->GetNextMatches(&expected)) {
+      assert(perfect_hash->GetNextMatches(&matches));
+      assert(matches == expected);
+    }
+    assert(!perfect_hash->GetNextMatches(&matches));
+  }
+}
+
+// Compares the randomized hash match maker against the naive one, and checks
+// LCSk++ with k-mers too long for the perfect hash against the slow
+// computation.
+void test_randomized_hash() {
+  for (int k : {1, 5, 50}) {
+    const string a = generate_string(1000);
+    const string b = a.substr(500) + generate_similar(a.substr(0, 500), 0.01);
+    auto naive = MatchMaker::Create(a, b, k, NAIVE);
+    auto randomized = MatchMaker::Create(a, b, k, RANDOMIZED_HASH);
+    vector<int> expected;
+    vector<int> matches;
+    while (naive->GetNextMatches(&expected)) {
+      assert(randomized->GetNextMatches(&matches));
+      assert(matches == expected);
+    }
+    assert(!randomized->GetNextMatches(&matches));
+  }
+
+  const string a = generate_string(1000);
+  const string b = generate_similar(a, 0.01);
+  const int k = 40;
+  assert(FastestMatchMakerType(a, b, 31) == RANDOMIZED_HASH);
+  assert(FastestMatchMakerType(a, b, 30) == PERFECT_HASH);
+  vector<pair<int, int> > recon;
+  LcsKppSparseFast(a, b, k, &recon);
+  assert(ValidLcskpp(a, b, k, recon));
+  int expected_length = 0;
+  LcskppSlow(a, b, k, &expected_length);
+  assert(recon.size() == expected_length);
+}
+
+// Checks that the sparse engine gives the same result whichever of the
+// strings is longer, i.e. whichever of them it indexes.
+void test_orientation() {
+  const string a = generate_string(3000);
+  const string b = generate_similar(a.substr(1000, 500), 0.05);
+  const int k = 4;
+  vector<pair<int, int> > ab_recon;
+  vector<pair<int, int> > ba_recon;
+  LcsKppSparseFast(a, b, k, &ab_recon);
+  LcsKppSparseFast(b, a, k, &ba_recon);
+  assert(ValidLcskpp(a, b, k, ab_recon));
+  assert(ValidLcskpp(b, a, k, ba_recon));
+  assert(ab_recon.size() == ba_recon.size());
+  int expected_length = 0;
+  LcskppSlow(b, a, k, &expected_length);
+  assert(ba_recon.size() == expected_length);
+
+  LcsKSparseFast(b, a, k, &ba_recon);
+  LcsKSparseFast(a, b, k, &ab_recon);
+  assert(ab_recon.size() == ba_recon.size());
+  assert(ba_recon.size() % k == 0);
+}
+
+// Checks that the minimizer match maker generates all the matches for w = 1
+// and a subset of them otherwise, and that the approximate LCSk++ is valid
+// and exact on identical strings.
+void test_minimizer_index() {
+  const string a = generate_string(2000);
+  const string b = a.substr(700) + generate_similar(a.substr(0, 700), 0.05);
+  for (int k : {3, 8}) {
+    for (int w : {1, 4, 12}) {
+      auto naive = MatchMaker::Create(a, b, k, NAIVE);
+      MinimizerMatchMaker minimizer(a, b, k, w);
+      vector<int> expected;
+      vector<int> matches;
+      while (naive->GetNextMatches(&expected)) {
+        assert(minimizer.GetNextMatches(&matches));
+        if (w == 1) {
+          assert(matches == expected);
+        } else {
+          assert(is_sorted(matches.begin(), matches.end()));
+          assert(includes(expected.begin(), expected.end(), matches.begin(),
+                          matches.end()));
+        }
+      }
+      assert(!minimizer.GetNextMatches(&matches));
+
+      vector<pair<int, int> > recon;
+      vector<pair<int, int> > exact_recon;
+      LcsKppSparseMinimizer(a, b, k, w, &recon);
+      LcsKppSparseFast(a, b, k, &exact_recon);
+      assert(ValidLcskpp(a, b, k, recon));
+      assert(recon.size() <= exact_recon.size());
+      assert(w > 1 || recon.size() == exact_recon.size());
+      LcsKppSparseMinimizer(a, a, k, w, &recon);
+      assert(recon.size() == a.size());
+    }
+  }
+}
+
+// Builds on-disk indices with various numbers of partitions and checks that
+// streaming the matches from them gives the matches and the results of the
+// in-memory index, also when the matches are sorted in many small runs.
+void test_partitioned_index() {
+  const string path = "/tmp/test_lcsk_partitioned_index";
+  const string scratch_path = "/tmp/test_lcsk_partitioned_index_scratch";
+  string b = generate_string(6000);
+  // k-mers with other characters than A, C, G and T are not indexed.
+  b[5000] = 'N';
+  const string a = generate_similar(b.substr(1500, 2500), kPerr);
+  for (int k : {4, 12}) {
+    for (int prefix_length : {0, 2, 9}) {
+      assert(BuildPartitionedIndex(b, k, prefix_length, path));
+      PartitionedIndex index;
+      assert(index.Open(path));
+      assert(index.k() == k);
+      assert(index.b_size() == b.size());
+      assert(index.prefix_length() == min(prefix_length, 4));
+
+      auto naive = MatchMaker::Create(a, b, k, NAIVE);
+      const int64_t bytes = heap_bytes;
+      max_heap_bytes = heap_bytes;
+      OutOfCoreMatchMaker match_maker(index, a, scratch_path,
+                                      /*max_run_matches=*/1000);
+      // The k-mers of a are joined one partition at a time, so with few
+      // matches less memory is taken than by all of them (16 bytes each),
+      // and their files are removed.
+      if (k == 12 && prefix_length > 0) {
+        assert(max_heap_bytes - bytes < 16 * (int64_t)a.size());
+      }
+      for (int p = 0; p < index.num_partitions(); ++p) {
+        const string kmers_path = scratch_path + ".kmers." + to_string(p);
+        assert(fopen(kmers_path.c_str(), "rb") == nullptr);
+      }
+      vector<int> expected;
+      vector<int> matches;
+      while (naive->GetNextMatches(&expected)) {
+        assert(match_maker.GetNextMatches(&matches));
+        assert(matches == expected);
+      }
+      assert(!match_maker.GetNextMatches(&matches));
+      assert(match_maker.ok());
+
+      for (bool lcsk_plus : {false, true}) {
+        vector<pair<int, int> > recon;
+        vector<pair<int, int> > expected_recon;
+        assert(LcsKSparseOutOfCore(a, path, scratch_path, lcsk_plus, &recon));
+        if (lcsk_plus) {
+          LcsKppSparseFast(a, b, k, &expected_recon);
+        } else {
+          LcsKSparseFast(a, b, k, &expected_recon);
+        }
+        // The in-memory index is built over the shorter a, so the
+        // reconstructions may differ between optimal solutions.
+        assert(recon.size() == expected_recon.size());
+        assert(lcsk_plus ? ValidLcskpp(a, b, k, recon)
+                         : ValidLcsk(a, b, k, recon));
+      }
+
+      remove(path.c_str());
+      for (int p = 0; p < index.num_partitions(); ++p) {
+        remove((path + "." + to_string(p)).c_str());
+      }
+    }
+  }
+  PartitionedIndex index;
+  assert(!index.Open(path));
+  vector<pair<int, int> > recon;
+  assert(!LcsKSparseOutOfCore(a, path, scratch_path, true, &recon));
+}
+
+// Checks that the memory arena recycles small blocks and maps large ones on
+// their own, and that the sweep gives the same results under every memory
+// policy (explicit huge pages fall back to transparent ones if none are
+// reserved, and binding to the local node is a no-op without NUMA).
+void test_memory_policy() {
+  MemoryArena arena(MemoryPolicy(TRANSPARENT_HUGE_PAGES, true));
+  char* small = static_cast<char*>(arena.Allocate(100));
+  assert(small != nullptr && arena.mapped_bytes() == 2 << 20);
+  memset(small, 1, 100);
+  arena.Deallocate(small, 100);
+  assert(arena.Allocate(112) == small);
+  char* large = static_cast<char*>(arena.Allocate(3 << 20));
+  assert(large != nullptr && arena.mapped_bytes() == 6 << 20);
+  assert((uintptr_t)large % (2 << 20) == 0);
+  memset(large, 1, 3 << 20);
+  arena.Deallocate(large, 3 << 20);
+  assert(arena.mapped_bytes() == 2 << 20);
+
+  const string a = generate_string(20000);
+  const string b = generate_similar(a, kPerr);
+  const int k = 4;
+  vector<pair<int, int> > expected;
+  LcsKppSparseFast(a, b, k, &expected);
+  for (HugePages huge_pages :
+       {NO_HUGE_PAGES, TRANSPARENT_HUGE_PAGES, EXPLICIT_HUGE_PAGES}) {
+    for (bool bind_to_local_node : {false, true}) {
+      vector<pair<int, int> > recon;
+      LcsKSparseFastWithMemoryPolicy(
+          a, b, k, /*lcsk_plus=*/true,
+          MemoryPolicy(huge_pages, bind_to_local_node), &recon);
+      assert(recon == expected);
+    }
+  }
+}
+
+// Compares the similarity profile, computed by several threads, with
+// independent comparisons of the windows.
+void test_similarity_profile() {
+  const string b = generate_string(4000);
+  const string a = generate_similar(b.substr(1000, 2000), kPerr) +
+                   generate_string(1000) + b.substr(0, 555);
+  const int k = 5;
+  ReferenceIndex index(b, k);
+  for (int num_threads : {1, 3}) {
+    for (bool lcsk_plus : {false, true}) {
+      ProfileOptions options;
+      options.window_size = 700;
+      options.stride = 250;
+      options.lcsk_plus = lcsk_plus;
+      options.num_threads = num_threads;
+      vector<ProfileWindow> windows;
+      SimilarityProfile(index, a, options,
+                        [&windows](const ProfileWindow& window) {
+                          windows.push_back(window);
+                        });
+
+      assert(windows.size() == 13);
+      for (size_t w = 0; w < windows.size(); ++w) {
+        assert(windows[w].begin == 250 * w);
+        assert(windows[w].end == min<int>(250 * w + 700, a.size()));
+        const string window = a.substr(windows[w].begin, windows[w].end -
+                                                             windows[w].begin);
+        vector<pair<int, int> > recon;
+        if (lcsk_plus) {
+          LcsKppSparseFast(window, b, k, &recon);
+        } else {
+          LcsKSparseFast(window, b, k, &recon);
+        }
+        assert(windows[w].score == recon.size());
+      }
+    }
+  }
+
+  ProfileOptions options;
+  options.window_size = 1000;
+  options.stride = 5000;
+  ostringstream out;
+  WriteSimilarityProfile(index, b.substr(0, 3000), options, out);
+  assert(out.str() == "0 1000 1000\n");
+}
+
+void test_result_cache() {
+  const string dir = "/tmp/test_lcsk_result_cache";
+  assert(system(("rm -rf " + dir + " && mkdir " + dir).c_str()) == 0);
+  const int k = 4;
+  vector<string> strings;
+  for (int i = 0; i < 4; ++i) {
+    strings.push_back(generate_string(500 + 100 * i));
+  }
+  strings.push_back(generate_similar(strings[0], kPerr));
+
+  ResultCacheOptions options;
+  options.disk_directory = dir;
+  {
+    ResultCache cache(options);
+    for (int round = 0; round < 2; ++round) {
+      for (size_t i = 0; i < strings.size(); ++i) {
+        for (bool lcsk_plus : {false, true}) {
+          vector<pair<int, int> > cached;
+          vector<pair<int, int> > expected;
+          if (lcsk_plus) {
+            cache.LcsKppSparseFast(strings[i], strings[0], k, &cached);
+            LcsKppSparseFast(strings[i], strings[0], k, &expected);
+          } else {
+            cache.LcsKSparseFast(strings[i], strings[0], k, &cached);
+            LcsKSparseFast(strings[i], strings[0], k, &expected);
+          }
+          assert(cached == expected);
+        }
+      }
+    }
+    // The second round, and the swapped pair below, are not misses.
+    ResultCacheStats stats = cache.stats();
+    assert(stats.misses == 10 && stats.memory_hits == 10);
+    assert(stats.disk_hits == 0 && stats.disk_bytes > 0);
+    vector<pair<int, int> > recon;
+    cache.LcsKSparseFast(strings[0], strings[1], k, &recon);
+    cache.LcsKSparseFast(strings[0], strings[1], k + 1, &recon);
+    assert(cache.stats().misses == 12);
+  }
+
+  // A new cache with room for a couple of results in memory finds the others
+  // on disk.
+  options.memory_budget = 2000;
+  options.disk_budget = 1 << 20;
+  ResultCache cache(options);
+  for (int round = 0; round < 2; ++round) {
+    for (size_t i = 0; i < strings.size(); ++i) {
+      vector<pair<int, int> > cached;
+      vector<pair<int, int> > expected;
+      cache.LcsKppSparseFast(strings[i], strings[0], k, &cached);
+      LcsKppSparseFast(strings[i], strings[0], k, &expected);
+      assert(cached == expected);
+    }
+  }
+  ResultCacheStats stats = cache.stats();
+  assert(stats.misses == 0 && stats.disk_hits + stats.memory_hits == 10);
+  assert(stats.disk_hits > 5 && stats.memory_bytes <= 2000);
+
+  // Shrinking the disk budget deletes the least recently used files.
+  options.disk_budget = stats.disk_bytes / 2;
+  ResultCache small_cache(options);
+  assert(small_cache.stats().disk_bytes <= options.disk_budget);
+
+  // Corrupt files, here claiming 2^63 - 1 pairs, are misses and are replaced.
+  assert(system(("for f in " + dir + "/*.lcskres; do printf "
+                 "'\\377\\377\\377\\377\\377\\377\\377\\177' | "
+                 "dd of=$f bs=1 seek=8 conv=notrunc 2>/dev/null; done")
+                    .c_str()) == 0);
+  options.memory_budget = 0;
+  options.disk_budget = 1 << 20;
+  for (int round = 0; round < 2; ++round) {
+    ResultCache corrupt_cache(options);
+    for (size_t i = 0; i < strings.size(); ++i) {
+      vector<pair<int, int> > cached;
+      vector<pair<int, int> > expected;
+      corrupt_cache.LcsKppSparseFast(strings[i], strings[0], k, &cached);
+      LcsKppSparseFast(strings[i], strings[0], k, &expected);
+      assert(cached == expected);
+    }
+    const ResultCacheStats corrupt_stats = corrupt_cache.stats();
+    assert(corrupt_stats.misses == (round == 0 ? 5 : 0));
+    assert(corrupt_stats.disk_hits == (round == 0 ? 0 : 5));
+  }
+  assert(system(("rm -rf " + dir).c_str()) == 0);
+}
+
+void test_all_vs_all_shards() {
+  const int k = 8;
+  vector<string> sequences;
+  for (int i = 0; i < 24; ++i) {
+    sequences.push_back(i % 4 == 0 ? generate_string(kStringLen)
+                                   : generate_similar(sequences.back(), kPerr));
+  }
+  KmerCollectionIndex index(sequences, k);
+  AllVsAllOptions options;
+  options.min_score = kStringLen / 2;
+  vector<SimilarityEntry> expected;
+  AllVsAll(index, options, &expected, nullptr);
+
+  const string manifest_path = "/tmp/test_lcsk_all_vs_all.manifest";
+  ShardManifest manifest;
+  manifest.input_path = "reads.txt";
+  manifest.k = k;
+  manifest.options = options;
+  manifest.num_shards = 3;
+  manifest.num_sequences = sequences.size();
+  manifest.fingerprint = CollectionFingerprint(sequences);
+  assert(WriteShardManifest(manifest, manifest_path));
+  ShardManifest read_manifest;
+  assert(ReadShardManifest(manifest_path, &read_manifest));
+  assert(read_manifest.input_path == manifest.input_path);
+  assert(read_manifest.k == k && read_manifest.num_shards == 3);
+  assert(read_manifest.options.min_score == options.min_score);
+  assert(read_manifest.options.lcsk_plus == options.lcsk_plus);
+  assert(read_manifest.num_sequences == sequences.size());
+  assert(read_manifest.fingerprint == manifest.fingerprint);
+  sequences[5][7] = sequences[5][7] == 'A' ? 'C' : 'A';
+  assert(CollectionFingerprint(sequences) != manifest.fingerprint);
+
+  vector<string> shard_paths;
+  long long num_pairs = 0;
+  for (int shard = 0; shard < manifest.num_shards; ++shard) {
+    shard_paths.push_back(ShardPath(manifest_path, shard));
+    remove(shard_paths.back().c_str());
+    ShardStats stats;
+    assert(RunAllVsAllShard(index, manifest, shard, 2, shard_paths.back(),
+                            &stats));
+    assert(stats.num_pairs_resumed == 0);
+    num_pairs += stats.num_pairs;
+  }
+  assert(num_pairs > 3);
+
+  // Simulates shard 1 being killed in the middle of a line.
+  string shard_file;
+  {
+    ifstream in(shard_paths[1]);
+    shard_file.assign(istreambuf_iterator<char>(in),
+                      istreambuf_iterator<char>());
+  }
+  const size_t last_line = shard_file.rfind('\n', shard_file.size() - 2);
+  const size_t cut = shard_file.rfind('\n', last_line - 1) + 3;
+  {
+    ofstream out(shard_paths[1]);
+    out << shard_file.substr(0, cut);
+  }
+  vector<SimilarityEntry> entries;
+  vector<int> incomplete_shards;
+  assert(!MergeAllVsAllShards(manifest, shard_paths, &entries,
+                              &incomplete_shards));
+  assert(incomplete_shards == vector<int>{1});
+
+  ShardStats stats;
+  assert(RunAllVsAllShard(index, manifest, 1, 1, shard_paths[1], &stats));
+  assert(stats.num_pairs_resumed == stats.num_pairs - 1);
+  // Complete shards are not run again, and files of other manifests are
+  // started over.
+  assert(RunAllVsAllShard(index, manifest, 1, 1, shard_paths[1], &stats));
+  assert(stats.num_pairs_resumed == stats.num_pairs);
+  ShardManifest other_manifest = manifest;
+  other_manifest.options.min_score = options.min_score - 1;
+  assert(RunAllVsAllShard(index, other_manifest, 2, 1, shard_paths[2],
+                          &stats));
+  assert(stats.num_pairs_resumed == 0);
+  assert(!MergeAllVsAllShards(manifest, shard_paths, &entries,
+                              &incomplete_shards));
+  assert(incomplete_shards == vector<int>{2});
+  assert(RunAllVsAllShard(index, manifest, 2, 1, shard_paths[2], &stats));
+
+  assert(MergeAllVsAllShards(manifest, shard_paths, &entries,
+                             &incomplete_shards));
+  assert(entries.size() == expected.size() && !expected.empty());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    assert(entries[i].a_id == expected[i].a_id);
+    assert(entries[i].b_id == expected[i].b_id);
+    assert(entries[i].score == expected[i].score);
+  }
+  for (const string& path : shard_paths) remove(path.c_str());
+  remove(manifest_path.c_str());
+}
+
+void test_sweep_timeline() {
+  const int k = 4;
+  const string b = generate_string(3000);
+  // a is the shorter string, which the timeline still sweeps.
+  const string a = generate_similar(b.substr(200, 2000), kPerr);
+  const int sample_every_rows = 128;
+  for (bool lcsk_plus : {false, true}) {
+    SweepTimeline timeline(sample_every_rows);
+    vector<pair<int, int> > recon;
+    LcsKSparseFastWithTimeline(a, b, k, lcsk_plus, &timeline, &recon);
+    vector<pair<int, int> > expected;
+    if (lcsk_plus) {
+      LcsKppSparseFast(a, b, k, &expected);
+      assert(ValidLcskpp(a, b, k, recon));
+    } else {
+      LcsKSparseFast(a, b, k, &expected);
+      assert(ValidLcsk(a, b, k, recon));
+    }
+    assert(recon.size() == expected.size());
+
+    MatchEstimate estimate;
+    EstimateMatches(a, b, k, /*sampling_rate=*/1.0, &estimate);
+    const vector<TimelineSample>& samples = timeline.samples();
+    assert(samples.size() == (a.size() + sample_every_rows) /
+                                 sample_every_rows);
+    int64_t begin_events = 0;
+    int64_t end_events = 0;
+    for (size_t i = 0; i < samples.size(); ++i) {
+      assert(samples[i].row == min<int64_t>((i + 1) * sample_every_rows,
+                                            a.size() + 1));
+      assert(samples[i].match_pairs_alive > 0);
+      assert(samples[i].elapsed_ns >= 0);
+      assert(i == 0 || samples[i].compressed_table_size >=
+                           samples[i - 1].compressed_table_size);
+      begin_events += samples[i].begin_events;
+      end_events += samples[i].end_events;
+    }
+    assert(begin_events == estimate.num_match_pairs);
+    assert(end_events == begin_events);
+    assert(samples.back().compressed_table_size - 1 ==
+           (lcsk_plus ? recon.size() : recon.size() / k));
+
+    const string path = "/tmp/test_lcsk_sweep_timeline";
+    assert(timeline.WriteBinary(path));
+    SweepTimeline read_timeline(1);
+    assert(read_timeline.ReadBinary(path));
+    assert(read_timeline.sample_every_rows() == sample_every_rows);
+    assert(read_timeline.samples().size() == samples.size());
+    // A header claiming 2^63 - 1 samples is rejected without allocating them,
+    // as is a truncated file, and the timeline is left as it was.
+    assert(system(("printf '\\377\\377\\377\\377\\377\\377\\377\\177' | "
+                   "dd of=" + path + " bs=1 seek=12 conv=notrunc 2>/dev/null")
+                      .c_str()) == 0);
+    assert(!read_timeline.ReadBinary(path));
+    assert(timeline.WriteBinary(path));
+    assert(truncate(path.c_str(), 20 + sizeof(TimelineSample)) == 0);
+    assert(!read_timeline.ReadBinary(path));
+    remove(path.c_str());
+    assert(read_timeline.sample_every_rows() == sample_every_rows);
+    assert(read_timeline.samples().size() == samples.size());
+    assert(memcmp(read_timeline.samples().data(), samples.data(),
+                  samples.size() * sizeof(TimelineSample)) == 0);
+
+    ostringstream csv;
+    timeline.WriteCsv(csv);
+    const string csv_lines = csv.str();
+    assert(count(csv_lines.begin(), csv_lines.end(), '\n') ==
+           samples.size() + 1);
+  }
+}
+
+// Checks LCSk++ of near-identical strings, whose long runs of continuations
+// retain one match pair each, against the slow version and the parallel one.
+void test_continuation_runs() {
+  const int k = 5;
+  for (int t = 0; t < 20; ++t) {
+    const string a = generate_string(1000);
+    const string b = generate_similar(a, 0.02);
+    int expected_length = -1;
+    LcskppSlow(a, b, k, &expected_length);
+    vector<pair<int, int> > recon;
+    LcsKppSparseFast(a, b, k, &recon);
+    assert(recon.size() == expected_length);
+    assert(ValidLcskpp(a, b, k, recon));
+    LcsKppSparseFastParallel(a, b, k, 3, &recon);
+    assert(recon.size() == expected_length);
+    assert(ValidLcskpp(a, b, k, recon));
+  }
+
+  const string a = generate_string(100000);
+  const string b = generate_similar(a, 0.01);
+  const uint64_t objects_alive = ObjectCounter<MatchPair>::objects_alive;
+  ObjectCounter<MatchPair>::max_objects_alive = objects_alive;
+  vector<pair<int, int> > recon;
+  LcsKppSparseFast(a, b, 12, &recon);
+  assert(ValidLcskpp(a, b, 12, recon));
+  assert(recon.size() > a.size() * 9 / 10);
+  // Without the runs, the compressed table and the chain of the result would
+  // hold about one match pair per character.
+  assert(ObjectCounter<MatchPair>::max_objects_alive - objects_alive <
+         recon.size() / 10);
+}
+
+// Checks the comparisons against a ReferenceIndex whose k-mers are too long
+// for the perfect hash of its alphabet, including the catch-all symbol, with
+// the pairwise engine.
+void test_reference_index_long_kmers() {
+  const string alphabets[] = {"0123456789abcde", "ACGT"};
+  const int ks[] = {16, 40};
+  for (int t = 0; t < 2; ++t) {
+    string b;
+    for (int i = 0; i < 3000; ++i) {
+      b += alphabets[t][rand() % alphabets[t].size()];
+    }
+    // Repeats make many matches; 'z' is outside the alphabet of b.
+    b += b.substr(0, 500);
+    string a = generate_similar(b.substr(300, 2000), 0.01) + "zzz" +
+               b.substr(2500, 700);
+    for (char& c : a) {
+      if (alphabets[t].find(c) == string::npos && c != 'z') {
+        c = alphabets[t][0];
+      }
+    }
+
+    ReferenceIndex index(b, ks[t]);
+    for (bool lcsk_plus : {false, true}) {
+      ReferenceMatchMaker match_maker(index, a);
+      vector<pair<int, int> > recon;
+      LcsKSparseFastWithMatchMaker(&match_maker, a.size(), b.size(), ks[t],
+                                   lcsk_plus, -1, false, &recon, nullptr);
+      vector<pair<int, int> > expected;
+      if (lcsk_plus) {
+        LcsKppSparseFast(a, b, ks[t], &expected);
+        assert(ValidLcskpp(a, b, ks[t], recon));
+      } else {
+        LcsKSparseFast(a, b, ks[t], &expected);
+        assert(ValidLcsk(a, b, ks[t], recon));
+      }
+      assert(recon.size() == expected.size());
+      assert(recon.size() > 2000);
+    }
+  }
+}
+
+// Checks the self-comparison mode with k-mers too long for the perfect hash
+// of DNA.
+void test_self_long_kmers() {
+  for (int k : {32, 40}) {
+    string a = generate_string(3000);
+    // Repeats make many matches above the main diagonal.
+    a += generate_similar(a.substr(200, 1500), 0.01) + a.substr(0, 700);
+    test_lcsk_self(a, k);
+
+    vector<pair<int, int> > recon;
+    LcsKSparseFastSelf(a, k, &recon);
+    assert(recon.size() > 1500);
+  }
+}
+
+// Checks the dense engine against the sparse one on tables of odd and even
+// sizes, including empty ones and identical strings (one long extension), and
+// the dispatcher forced onto either engine by its costs.
+void test_dense_engine() {
+  const int sizes[] = {0, 1, 7, 64, 301};
+  for (int n : sizes) {
+    for (int m : sizes) {
+      const string a = generate_string(n);
+      const string b = generate_similar(a.substr(0, m), 0.05) +
+                       generate_string(m - min(n, m));
+      for (int k : {1, 3, 10}) {
+        for (const string *y : {&b, &a}) {
+          vector<pair<int, int> > sparse_recon;
+          vector<pair<int, int> > dense_recon;
+          LcsKSparseFast(a, *y, k, &sparse_recon);
+          LcsKDense(a, *y, k, &dense_recon);
+          assert(dense_recon.size() == sparse_recon.size());
+          assert(ValidLcsk(a, *y, k, dense_recon));
+          LcsKppSparseFast(a, *y, k, &sparse_recon);
+          LcsKppDense(a, *y, k, &dense_recon);
+          assert(dense_recon.size() == sparse_recon.size());
+          assert(ValidLcskpp(a, *y, k, dense_recon));
+
+          DenseEngineCosts dense_costs;
+          dense_costs.dense_cell_ns = 0;
+          DenseEngineCosts sparse_costs;
+          sparse_costs.max_cells = -1;
+          vector<pair<int, int> > recon;
+          LcsKppFast(a, *y, k, dense_costs, &recon);
+          assert(recon == dense_recon);
+          LcsKppFast(a, *y, k, sparse_costs, &recon);
+          assert(recon == sparse_recon);
+        }
+      }
+    }
+  }
+}
+
+// Checks that the match pair counters add up over sweeps which create match
+// pairs in one thread and release them in another.
+void test_object_counter_threads() {
+  const string a = generate_string(20000);
+  const string b = generate_similar(a, 0.05);
+  vector<pair<int, int> > recon;
+  LcsKppSparseFast(a, b, kK, &recon);
+  const size_t expected_length = recon.size();
+
+  const uint64_t objects_alive = ObjectCounter<MatchPair>::objects_alive;
+  const uint64_t objects_created = ObjectCounter<MatchPair>::objects_created;
+  LcsKppSparseFastParallel(a, b, kK, 3, &recon);
+  assert(recon.size() == expected_length);
+  LcsKppSparseFastDualStrand(a, b, kK, 2, &recon);
+  assert(recon.size() >= expected_length);
+  recon.clear();
+  recon.shrink_to_fit();
+  assert(ObjectCounter<MatchPair>::objects_alive == objects_alive);
+  assert(ObjectCounter<MatchPair>::objects_created >
+         objects_created + 2 * expected_length / kK);
+  assert(ObjectCounter<MatchPair>::max_objects_alive > objects_alive);
+}
+
+// Compares the batched dense engine against the sparse one, on pairs of
+// different lengths.
+void test_dense_batch() {
+  for (int k = 1; k <= 6; k += 5) {
+    vector<string> as;
+    vector<string> bs;
+    for (int p = 0; p < 37; ++p) {
+      as.push_back(generate_string(1 + rand() % 300));
+      bs.push_back(p % 5 == 0 ? generate_string(1 + rand() % 300)
+                              : generate_similar(as.back(), kPerr));
+    }
+    for (int lcsk_plus = 0; lcsk_plus < 2; ++lcsk_plus) {
+      vector<int> lengths;
+      LcsKDenseBatch(as, bs, k, lcsk_plus, &lengths);
+      assert(lengths.size() == as.size());
+      for (int p = 0; p < as.size(); ++p) {
+        vector<pair<int, int> > recon;
+        if (lcsk_plus) {
+          LcsKppSparseFast(as[p], bs[p], k, &recon);
+        } else {
+          LcsKSparseFast(as[p], bs[p], k, &recon);
+        }
+        assert(lengths[p] == recon.size());
+      }
+    }
+  }
+}
+
+// Compares the all-vs-all mode against pairwise LcsKppSparseFast calls, on
+// groups of similar sequences with p_err errors.
+void test_all_vs_all(const int k, const double p_err) {
+  vector<string> sequences;
+  for (int i = 0; i < 30; ++i) {
+    sequences.push_back(i % 3 == 0 || sequences.empty()
+                            ? generate_string(kStringLen)
+                            : generate_similar(sequences.back(), p_err));
+  }
+
+  AllVsAllOptions options;
+  options.min_score = kStringLen / 2;
+  options.num_threads = 4;
+  KmerCollectionIndex index(sequences, k);
+  vector<SimilarityEntry> entries;
+  AllVsAllStats stats;
+  AllVsAll(index, options, &entries, &stats);
+  assert(stats.num_pairs == stats.num_pairs_pruned + stats.num_pairs_compared);
+
+  vector<SimilarityEntry> expected;
+  for (int x = 0; x < sequences.size(); ++x) {
+    for (int y = x + 1; y < sequences.size(); ++y) {
+      vector<pair<int, int> > recon;
+      LcsKppSparseFast(sequences[x], sequences[y], k, &recon);
+      if (recon.size() >= options.min_score) {
+        expected.push_back(SimilarityEntry{x, y, (int)recon.size()});
+      }
+    }
+  }
+
+  assert(entries.size() == expected.size());
+  for (int i = 0; i < entries.size(); ++i) {
+    assert(entries[i].a_id == expected[i].a_id);
+    assert(entries[i].b_id == expected[i].b_id);
+    assert(entries[i].score == expected[i].score);
+  }
+  assert(!entries.empty());
+  printf("All-vs-all (k=%d): %d pairs reported, %lld of %lld pairs pruned\n",
+         k, (int)entries.size(), stats.num_pairs_pruned, stats.num_pairs);
+}
+
 int main(int argc, char *argv[]) {
   printf("Running tests on %d random pairs ", kSimulationRuns);
   printf("with the following parameters:\n");
@@ -118,6 +1440,36 @@ int main(int argc, char *argv[]) {
   }
 
   assert(0.99999 <= sum_prob <= 1.00001);
+  test_position_types();
+  // k is large enough for random pairs not to share most of their k-mers.
+  test_all_vs_all(8, kPerr);
+  // k-mers too long for the perfect hash of DNA.
+  test_all_vs_all(32, 0.01);
+  test_all_vs_all(40, 0.01);
+  test_sequence_reader();
+  test_comparison_server();
+  test_comparison_server_frame_limit();
+  test_match_estimator();
+  test_match_estimator_memory();
+  test_dense_engine();
+  test_dense_batch();
+  test_steady_state_allocations();
+  test_match_trace();
+  test_kmer_filter();
+  test_randomized_hash();
+  test_orientation();
+  test_minimizer_index();
+  test_partitioned_index();
+  test_memory_policy();
+  test_similarity_profile();
+  test_result_cache();
+  test_all_vs_all_shards();
+  test_sweep_timeline();
+  test_continuation_runs();
+  test_reference_index_long_kmers();
+  test_self_long_kmers();
+  test_lcsk_at_least_early_exit();
+  test_object_counter_threads();
   printf("Expected LCSk++=%0.3lf\n", e_lcs);
   printf("Test PASSED!\n");
   return 0;
@@ -15,25 +15,37 @@
 #ifndef OBJECT_COUNTER
 #define OBJECT_COUNTER
 
+#include <atomic>
+#include <cstdint>
+
+// Counts the instances of T. The counters are shared by all threads, and
+// updated with relaxed atomics: match pairs created by one thread are often
+// released by another (e.g. by the stripes of a parallel sweep), so per-thread
+// counters would drift. The counts of concurrent comparisons add up.
 template <typename T>
 struct ObjectCounter {
   ObjectCounter() {
-    objects_created++;
-    objects_alive++;
-    max_objects_alive = std::max(max_objects_alive, objects_alive);
+    objects_created.fetch_add(1, std::memory_order_relaxed);
+    const uint64_t alive =
+        objects_alive.fetch_add(1, std::memory_order_relaxed) + 1;
+    uint64_t max_alive = max_objects_alive.load(std::memory_order_relaxed);
+    while (max_alive < alive &&
+           !max_objects_alive.compare_exchange_weak(
+               max_alive, alive, std::memory_order_relaxed)) {
+    }
   }
 
   virtual ~ObjectCounter() {
-    --objects_alive;
+    objects_alive.fetch_sub(1, std::memory_order_relaxed);
   }
 
-  static uint64_t objects_created;
-  static uint64_t objects_alive;
-  static uint64_t max_objects_alive;
+  static std::atomic<uint64_t> objects_created;
+  static std::atomic<uint64_t> objects_alive;
+  static std::atomic<uint64_t> max_objects_alive;
 };
 
-template <typename T> uint64_t ObjectCounter<T>::objects_created(0);
-template <typename T> uint64_t ObjectCounter<T>::objects_alive(0);
-template <typename T> uint64_t ObjectCounter<T>::max_objects_alive(0);
+template <typename T> std::atomic<uint64_t> ObjectCounter<T>::objects_created(0);
+template <typename T> std::atomic<uint64_t> ObjectCounter<T>::objects_alive(0);
+template <typename T> std::atomic<uint64_t> ObjectCounter<T>::max_objects_alive(0);
 
 #endif
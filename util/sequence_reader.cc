@@ -0,0 +1,330 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "sequence_reader.h"
+
+using namespace std;
+
+namespace {
+
+// Size of the chunks inflated by the helper thread, and maximum number of
+// chunks waiting to be parsed.
+const size_t kInflateChunkSize = 1 << 20;
+const size_t kMaxInflatedChunks = 8;
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+ public:
+  explicit MappedFile(const string& path) : data_(nullptr), size_(0) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+      ok_ = true;
+      size_ = st.st_size;
+      if (size_ > 0) {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+          ok_ = false;
+          size_ = 0;
+        } else {
+          data_ = static_cast<const char*>(data);
+          madvise(data, size_, MADV_SEQUENTIAL);
+        }
+      }
+    }
+    close(fd);
+  }
+
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+  }
+
+  bool ok() const { return ok_; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  bool ok_ = false;
+  const char* data_;
+  size_t size_;
+};
+
+// Single-pass parser of FASTA, FASTQ and plain text, fed with consecutive
+// chunks of the file.
+class SequenceParser {
+ public:
+  SequenceParser(bool acgt_only, string* sequence)
+      : sequence_(sequence), state_(START), fastq_(false) {
+    for (int c = 0; c < 256; ++c) {
+      keep_[c] = !acgt_only && c != '\n';
+    }
+    if (acgt_only) {
+      keep_['A'] = keep_['C'] = keep_['G'] = keep_['T'] = true;
+    }
+  }
+
+  // Parses the next chunk. Returns false once the rest of the file does not
+  // have to be read.
+  bool Consume(const char* data, size_t size) {
+    const char* p = data;
+    const char* end = data + size;
+    while (p < end) {
+      switch (state_) {
+        case START:
+          fastq_ = *p == '@';
+          state_ = *p == '>' || *p == '@' ? HEADER : PLAIN;
+          break;
+        case PLAIN: {
+          // Unlike the records of FASTA and FASTQ, '\r' is kept here.
+          const char* line_end = FindNewline(p, end);
+          AppendBases(p, line_end);
+          if (line_end != end) {
+            state_ = DONE;
+            return false;
+          }
+          p = end;
+          break;
+        }
+        case HEADER:
+        case SKIP_LINE:
+        case PLUS_LINE: {
+          const char* line_end = FindNewline(p, end);
+          if (line_end == end) {
+            p = end;
+            break;
+          }
+          p = line_end + 1;
+          if (state_ == HEADER) record_length_ = 0;
+          if (state_ == PLUS_LINE) {
+            remaining_quality_ = record_length_;
+            state_ = QUALITY;
+          } else {
+            state_ = LINE_START;
+          }
+          break;
+        }
+        case LINE_START:
+          if (*p == (fastq_ ? '@' : '>')) {
+            state_ = HEADER;
+          } else if (fastq_ && *p == '+') {
+            state_ = PLUS_LINE;
+          } else if (!fastq_ && *p == ',') {
+            state_ = SKIP_LINE;
+          } else {
+            state_ = SEQUENCE;
+          }
+          break;
+        case SEQUENCE: {
+          const char* line_end = FindNewline(p, end);
+          record_length_ += (line_end - p) - count(p, line_end, '\r');
+          AppendBases(p, line_end);
+          if (line_end != end) state_ = LINE_START;
+          p = line_end + (line_end != end);
+          break;
+        }
+        case QUALITY:
+          // The quality string may span several lines and start with '@', so
+          // it is skipped by its length.
+          for (; p < end && remaining_quality_ > 0; ++p) {
+            remaining_quality_ -= *p != '\n' && *p != '\r';
+          }
+          if (remaining_quality_ == 0) state_ = SKIP_LINE;
+          break;
+        case DONE:
+          return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  enum State {
+    START, PLAIN, HEADER, LINE_START, SEQUENCE, SKIP_LINE, PLUS_LINE, QUALITY,
+    DONE,
+  };
+
+  static const char* FindNewline(const char* begin, const char* end) {
+    const void* newline = memchr(begin, '\n', end - begin);
+    return newline == nullptr ? end : static_cast<const char*>(newline);
+  }
+
+  // Appends the kept characters of [begin, end) to the sequence, writing
+  // directly into its buffer.
+  void AppendBases(const char* begin, const char* end) {
+    const size_t old_size = sequence_->size();
+    sequence_->resize(old_size + (end - begin));
+    char* out = &(*sequence_)[old_size];
+    for (const char* p = begin; p < end; ++p) {
+      *out = *p;
+      out += keep_[(unsigned char)*p] && (state_ == PLAIN || *p != '\r');
+    }
+    sequence_->resize(out - &(*sequence_)[0]);
+  }
+
+  string* sequence_;
+  State state_;
+  bool fastq_;
+  bool keep_[256];
+  // Number of characters in the sequence of the current FASTQ record, and in
+  // the part of its quality string not yet skipped.
+  long long record_length_ = 0;
+  long long remaining_quality_ = 0;
+};
+
+// Bounded single producer, single consumer queue of inflated chunks. The
+// consumer may stop early, after which the producer is not blocked anymore.
+class ChunkQueue {
+ public:
+  // Returns false if the consumer has stopped.
+  bool Push(vector<char>* chunk) {
+    unique_lock<mutex> lock(mutex_);
+    not_full_.wait(lock, [this] {
+      return chunks_.size() < kMaxInflatedChunks || stopped_;
+    });
+    if (stopped_) return false;
+    chunks_.emplace_back();
+    chunks_.back().swap(*chunk);
+    not_empty_.notify_one();
+    return true;
+  }
+
+  void Close() {
+    lock_guard<mutex> lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_one();
+  }
+
+  // Returns false once the queue is closed and empty.
+  bool Pop(vector<char>* chunk) {
+    unique_lock<mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return !chunks_.empty() || closed_; });
+    if (chunks_.empty()) return false;
+    chunk->swap(chunks_.front());
+    chunks_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  void Stop() {
+    lock_guard<mutex> lock(mutex_);
+    stopped_ = true;
+    not_full_.notify_one();
+  }
+
+ private:
+  mutex mutex_;
+  condition_variable not_empty_;
+  condition_variable not_full_;
+  deque<vector<char>> chunks_;
+  bool closed_ = false;
+  bool stopped_ = false;
+};
+
+// Inflates the (possibly multi-member) gzip data into chunks pushed to queue,
+// closing it at the end. Sets *ok to false if the data is corrupt.
+void InflateChunks(const unsigned char* data, size_t size, ChunkQueue* queue,
+                   bool* ok) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (inflateInit2(&stream, 15 + 16) != Z_OK) {
+    *ok = false;
+    queue->Close();
+    return;
+  }
+
+  size_t consumed = 0;
+  vector<char> chunk(kInflateChunkSize);
+  stream.next_out = reinterpret_cast<Bytef*>(chunk.data());
+  stream.avail_out = chunk.size();
+  bool pushing = true;
+  while (pushing) {
+    if (stream.avail_in == 0 && consumed < size) {
+      const size_t available = min<size_t>(size - consumed, 1 << 30);
+      stream.next_in = const_cast<Bytef*>(data + consumed);
+      stream.avail_in = available;
+      consumed += available;
+    }
+
+    const int ret = inflate(&stream, Z_NO_FLUSH);
+    const bool stream_end = ret == Z_STREAM_END;
+    if (ret != Z_OK && !stream_end) {
+      // Corrupt or truncated data.
+      *ok = false;
+    }
+    const bool more_input = stream.avail_in > 0 || consumed < size;
+    const bool done = !*ok || (stream_end && !more_input);
+    if (stream_end && more_input) {
+      inflateReset(&stream);
+    }
+
+    if (stream.avail_out == 0 || done) {
+      chunk.resize(chunk.size() - stream.avail_out);
+      pushing = queue->Push(&chunk) && !done;
+      chunk.assign(kInflateChunkSize, 0);
+      stream.next_out = reinterpret_cast<Bytef*>(chunk.data());
+      stream.avail_out = chunk.size();
+    }
+  }
+
+  inflateEnd(&stream);
+  queue->Close();
+}
+
+}  // namespace
+
+bool ReadSequenceFile(const std::string& path, bool acgt_only,
+                      std::string* sequence) {
+  sequence->clear();
+  MappedFile file(path);
+  if (!file.ok()) return false;
+
+  SequenceParser parser(acgt_only, sequence);
+  const unsigned char* data =
+      reinterpret_cast<const unsigned char*>(file.data());
+  if (file.size() < 2 || data[0] != 0x1f || data[1] != 0x8b) {
+    // The sequence is at most as long as the file.
+    sequence->reserve(file.size());
+    parser.Consume(file.data(), file.size());
+    return true;
+  }
+
+  ChunkQueue queue;
+  bool ok = true;
+  thread inflater(InflateChunks, data, file.size(), &queue, &ok);
+  vector<char> chunk;
+  while (queue.Pop(&chunk)) {
+    if (!parser.Consume(chunk.data(), chunk.size())) break;
+  }
+  queue.Stop();
+  inflater.join();
+  return ok;
+}
@@ -0,0 +1,38 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SEQUENCE_READER
+#define SEQUENCE_READER
+
+#include <string>
+
+// Reads the sequence stored in the file at path into *sequence. The format is
+// detected from the first character of the file:
+// - '>': FASTA, the sequences of all records are concatenated (lines starting
+//   with ',' are skipped as comments),
+// - '@': FASTQ, likewise, skipping the quality strings,
+// - anything else: plain text, of which only the first line is read.
+// The file may be gzip-compressed, in which case it is inflated by a helper
+// thread while the main thread parses.
+//
+// The file is mapped into memory and parsed in a single pass, appending the
+// bases straight into *sequence, which for uncompressed files is reserved
+// upfront. If acgt_only is set, every character of the sequence other than
+// A, C, G and T is dropped; '\r' is always dropped from FASTA and FASTQ.
+//
+// Returns false if the file cannot be read.
+bool ReadSequenceFile(const std::string& path, bool acgt_only,
+                      std::string* sequence);
+
+#endif